@@ -4,19 +4,98 @@
 #include <SDL2/SDL.h>
 #include <glad/glad.h>
 #include "Camera.hpp"
+#include "GeometryPool.hpp"
+#include "GpuProfiler.hpp"
+#include "Headless.hpp"
+#include "Pipeline.hpp"
+#include "PipelineBuilder.hpp"
+#include "ProgramCache.hpp"
+#include "ProgramPipelines.hpp"
+#include "ResourceManager.hpp"
+#include "ShaderHotReload.hpp"
+#include "ShaderPreprocessor.hpp"
+#include "UniformBuffers.hpp"
+
+// How MainLoop submits the scene
+enum class RenderPath {
+    // Sorted render queue for meshes, one instanced draw per MeshData for instances
+    Queue,
+    // Same, but generated scene objects sharing a mesh are drawn as instances
+    // instead of going through the queue one draw each
+    Instanced,
+    // Everything in the geometry pool goes out through one multi-draw-indirect
+    Indirect
+};
 
 struct App {
     int mScreenWidth = 640;
     int mScreenHeight = 480;
     SDL_Window* mGraphicsApplicationWindow = nullptr;
     SDL_GLContext mOpenGLContext = nullptr;
+    // No window, the context comes from EGL and frames go to an offscreen framebuffer
+    bool mHeadless = false;
+    HeadlessContext mHeadlessContext;
     bool mQuit = false;
+    // MainLoop stops after this many frames, 0 runs until quit
+    unsigned int mFrameLimit = 0;
+    // The last frame is saved here as a PPM when set
+    std::string mCapturePath;
+    RenderPath mRenderPath = RenderPath::Queue;
+    // Meshes outside the camera frustum are skipped
+    bool mFrustumCulling = true;
+    // Threads the culler may use, 0 is one per core
+    uint32_t mCullingThreads = 0;
+    // Cull through the scene BVH instead of testing every mesh
+    bool mBvhCulling = false;
+    // Meshes hidden behind the largest visible ones are skipped too
+    bool mOcclusionCulling = false;
+    // Milliseconds of CPU time occlusion culling may take per frame
+    double mOcclusionBudget = 2.0;
+    // Frustum and Hi-Z culling in compute shaders, drawn indirectly. Needs GL 4.3,
+    // falls back to the CPU culling of RenderPath::Indirect without it.
+    bool mGpuCulling = false;
+    // Meshes seen hidden are drawn under hardware occlusion queries, render queue path only
+    bool mOcclusionQueries = false;
+    // Instances are frustum culled on the GPU through transform feedback, works on 4.1.
+    // Only for the instanced renderer, so not with RenderPath::Indirect.
+    bool mInstanceCulling = false;
+    // Owns GL objects that outlive a single function, deletes them once the GPU is done
+    ResourceManager mResources;
     // Program Object (for our shaders)
-    GLuint mGraphicsPipelineShaderProgram = 0;
+    Pipeline mGraphicsPipeline;
+    // Same shading, but the model matrix comes from a per-instance attribute stream
+    Pipeline mInstancedPipeline;
+    // Stand-ins drawn until the pipelines above finish building
+    Pipeline mFallbackPipeline;
+    Pipeline mFallbackInstancedPipeline;
+    // Linked program binaries from earlier runs
+    ProgramCache mProgramCache;
+    PipelineBuilder mPipelineBuilder;
+    // Vertex and fragment stages shared across pipelines
+    ProgramPipelineCache mProgramPipelines;
+    // Build pipelines from separable stages instead of whole programs
+    bool mSeparableStages = false;
+    // Preprocessed shader permutations, built on first use
+    ShaderLibrary mShaderLibrary;
+    ShaderHotReload mShaderHotReload;
+    // Uniform blocks shared by every pipeline
+    FrameUniforms mFrameUniforms;
+    // Shared vertex/index storage for meshes in the Vertex format
+    GeometryPool mGeometryPool;
     Camera mCamera;
+    GpuProfiler mGpuProfiler;
+    // Where the CPU zones go, written when P is pressed
+    std::string mTracePath = "cpu_trace.json";
+    bool mTraceRequested = false;
+    // Packs the geometry pool after the frame, G or --defragment for the first one
+    bool mDefragmentRequested = false;
+    // Left click, picks whatever is under the crosshair
+    bool mPickRequested = false;
 };
 
 void InitializeProgram(App* app);
+// Shows the frame, nothing to do for headless rendering
+void PresentFrame(App& app);
 void CleanUp(App& app);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,71 @@
+#ifndef BENCHMARK_HPP
+#define BENCHMARK_HPP
+
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "Camera.hpp"
+#include "GpuProfiler.hpp"
+#include "RenderQueue.hpp"
+#include "SceneGenerator.hpp"
+
+struct CameraPathPoint {
+    glm::vec3 mEye;
+    glm::vec3 mTarget;
+};
+
+// Closed Catmull-Rom spline through the points, eye and target interpolated separately
+struct CameraPath {
+    std::vector<CameraPathPoint> mPoints;
+};
+
+// A loop in front of the default scene, staying inside the far plane
+CameraPath DefaultCameraPath();
+// t in [0, 1) goes once around the loop
+void CameraPathEvaluate(const CameraPath& path, float t, glm::vec3* eye, glm::vec3* target);
+
+struct BenchmarkOptions {
+    std::string mScene;
+    uint32_t mWarmupFrames = 60;
+    uint32_t mMeasuredFrames = 600;
+    // glFinish after every frame, so the CPU frame time covers the GPU work too
+    bool mFinish = false;
+    std::string mOutputPath = "benchmark.json";
+};
+
+// Replaces input with a scripted camera and a fixed frame count. Time is
+// derived from the frame number, so every run draws the same frames.
+struct Benchmark {
+    BenchmarkOptions mOptions;
+    CameraPath mPath;
+    uint32_t mFrame = 0;
+    std::vector<double> mCpuFrameTimes;
+    // Summed over the measured frames
+    uint64_t mDrawCalls = 0;
+    uint64_t mTriangles = 0;
+    uint64_t mVisible = 0;
+    uint64_t mCulled = 0;
+    uint64_t mOccluded = 0;
+    uint64_t mQueries = 0;
+};
+
+void CreateBenchmark(Benchmark* benchmark, const BenchmarkOptions& options, GpuProfiler* profiler);
+// Moves the camera along the path, returns the time the frame should use in seconds
+float BenchmarkBeginFrame(Benchmark* benchmark, Camera* camera);
+// Warm-up plus measured frames, the loop has to stop after this many
+uint32_t BenchmarkFrameCount(const Benchmark& benchmark);
+void BenchmarkEndFrame(Benchmark* benchmark, GpuProfiler* profiler, double cpuFrameTime, const RenderStats& stats);
+// Writes the results as JSON and prints a summary
+bool BenchmarkWriteResults(const Benchmark& benchmark, GpuProfiler* profiler);
+// Compares two result files, regressions are metrics more than thresholdPercent
+// slower than the baseline. Returns the number of regressions, -1 if a file can't be read.
+int CompareBenchmarks(const std::string& baselinePath, const std::string& currentPath, double thresholdPercent);
+
+// CPU only: builds a BVH over a generated scene and times the build, refits
+// with the animated share of the objects moving, frustum culling against the
+// flat culler, and ray and sphere queries
+void RunBvhBenchmark(const SceneGeneratorOptions& options);
+
+#endif
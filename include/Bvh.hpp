@@ -0,0 +1,76 @@
+#ifndef BVH_HPP
+#define BVH_HPP
+
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <vector>
+
+#include "Culling.hpp"
+
+struct Aabb {
+    glm::vec3 mMin{ glm::vec3(0.0f) };
+    glm::vec3 mMax{ glm::vec3(0.0f) };
+};
+
+Aabb AabbFromSphere(const glm::vec3& center, float radius);
+Aabb AabbUnion(const Aabb& a, const Aabb& b);
+float AabbSurfaceArea(const Aabb& aabb);
+
+const uint32_t BVH_NULL = 0xffffffff;
+// Leaves hold at most this many objects
+const uint32_t BVH_MAX_LEAF_SIZE = 4;
+// Candidate split planes per axis of the binned SAH build
+const uint32_t BVH_SAH_BINS = 16;
+
+struct BvhNode {
+    Aabb mBounds;
+    uint32_t mParent = BVH_NULL;
+    // Internal nodes have both children, leaves have neither
+    uint32_t mLeft = BVH_NULL;
+    uint32_t mRight = BVH_NULL;
+    // Leaves: range of Bvh::mLeafObjects
+    uint32_t mFirst = 0;
+    uint32_t mCount = 0;
+};
+
+// Bounding volume hierarchy over a range of object AABBs, root at node 0.
+// Built top-down with a binned surface area heuristic. Objects that move
+// afterwards are handled by refitting the nodes above them, and tree rotations
+// on the way up keep the moved subtrees from growing into a badly balanced
+// tree. Moving objects are best kept in a tree of their own, so the static
+// tree stays as good as the build made it.
+struct Bvh {
+    std::vector<BvhNode> mNodes;
+    // Object indices relative to mFirstObject, queries report them with it added
+    uint32_t mFirstObject = 0;
+    std::vector<uint32_t> mLeafObjects;
+    std::vector<Aabb> mObjectBounds;
+    // Leaf that holds each object
+    std::vector<uint32_t> mObjectLeaf;
+    // Leaves with objects moved since the last refit, and whether a leaf is in the list
+    std::vector<uint32_t> mDirtyLeaves;
+    std::vector<bool> mLeafDirty;
+    // Try rotations while refitting, off gives plain refits
+    bool mRotate = true;
+    // Rotations done by the last refit
+    uint32_t mRotations = 0;
+};
+
+// Builds over objectBounds[first, first + count)
+void BvhBuild(Bvh* bvh, const std::vector<Aabb>& objectBounds, uint32_t first, uint32_t count);
+// Call for every object of the tree that moved, then BvhRefit once
+void BvhUpdateObject(Bvh* bvh, uint32_t object, const Aabb& bounds);
+void BvhRefit(Bvh* bvh);
+// SAH cost of the tree relative to its root, lower traverses faster
+float BvhCost(const Bvh& bvh);
+
+// Appends the objects whose bounds intersect the frustum. Subtrees completely
+// inside are taken without testing anything below them.
+void BvhCullFrustum(const Bvh& bvh, const Frustum& frustum, std::vector<uint32_t>* objects);
+// Nearest object whose bounds the ray enters within maxDistance, direction has to be normalized
+bool BvhRaycast(const Bvh& bvh, const glm::vec3& origin, const glm::vec3& direction, float maxDistance,
+                uint32_t* object, float* distance);
+// Appends the objects whose bounds are within radius of center
+void BvhQuerySphere(const Bvh& bvh, const glm::vec3& center, float radius, std::vector<uint32_t>* objects);
+
+#endif
@@ -13,7 +13,11 @@ class Camera {
         glm::mat4 GetViewMatrix() const;
         void SetProjectionMatrix(float fovy, float aspect, float near, float far);
         glm::mat4 GetProjectionMatrix() const;
+        glm::vec3 GetPosition() const;
+        glm::vec3 GetViewDirection() const;
 
+        // Places the camera at eye, looking at target
+        void LookAt(const glm::vec3& eye, const glm::vec3& target);
         void MouseLook(int mouseX, int mouseY);
         void MoveForward(float);
         void MoveBackward(float);
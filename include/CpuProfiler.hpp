@@ -0,0 +1,60 @@
+#ifndef CPUPROFILER_HPP
+#define CPUPROFILER_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+// Instrumentation is compiled in with -DCPU_PROFILER (make PROFILE=1).
+// Without it the zone macros expand to nothing, so they cost nothing.
+
+// Events each thread keeps, older ones are overwritten
+const uint32_t CPU_PROFILER_EVENTS_PER_THREAD = 1 << 16;
+
+struct CpuZoneEvent {
+    // Must be a string literal (or otherwise live until the trace is written)
+    const char* mName = nullptr;
+    // Nanoseconds since the profiler started
+    uint64_t mStart = 0;
+    uint64_t mEnd = 0;
+};
+
+// One per thread that records zones. Only the owning thread writes; the
+// head is published with release stores, so exporting never takes a lock.
+struct CpuProfilerThread {
+    uint32_t mThreadId = 0;
+    std::string mName;
+    std::atomic<uint64_t> mHead{0};
+    CpuZoneEvent mEvents[CPU_PROFILER_EVENTS_PER_THREAD];
+};
+
+uint64_t CpuProfilerNow();
+void CpuProfilerRecord(const char* name, uint64_t start, uint64_t end);
+// Shown as the thread's name in the trace viewer
+void CpuProfilerSetThreadName(const char* name);
+// Writes every recorded event as Chrome trace-event JSON (chrome://tracing, Perfetto)
+bool CpuProfilerWriteTrace(const std::string& path);
+
+struct CpuProfileScope {
+    const char* mName;
+    uint64_t mStart;
+    explicit CpuProfileScope(const char* name) : mName(name), mStart(CpuProfilerNow()) {}
+    ~CpuProfileScope() {
+        CpuProfilerRecord(mName, mStart, CpuProfilerNow());
+    }
+};
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+
+#ifdef CPU_PROFILER
+#define PROFILE_ZONE(name) CpuProfileScope PROFILE_CONCAT(profileZone, __LINE__)(name)
+#define PROFILE_FUNCTION() PROFILE_ZONE(__func__)
+#define PROFILE_THREAD_NAME(name) CpuProfilerSetThreadName(name)
+#else
+#define PROFILE_ZONE(name) ((void)0)
+#define PROFILE_FUNCTION() ((void)0)
+#define PROFILE_THREAD_NAME(name) ((void)0)
+#endif
+
+#endif
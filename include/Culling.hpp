@@ -0,0 +1,91 @@
+#ifndef CULLING_HPP
+#define CULLING_HPP
+
+#include <glm/glm.hpp>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "Camera.hpp"
+
+// Bounds are stored and tested in blocks of this many, the widest kernel (AVX)
+const uint32_t CULLING_BLOCK_SIZE = 8;
+// Below this many bounds a single thread is faster than waking the workers
+const uint32_t CULLING_PARALLEL_THRESHOLD = 32768;
+const uint32_t CULLING_MAX_THREADS = 8;
+
+// Planes as (normal, distance) with normals pointing inwards, a point p is
+// inside a plane when dot(normal, p) + distance >= 0
+struct Frustum {
+    glm::vec4 mPlanes[6];
+};
+
+// Gribb/Hartmann extraction for GL clip space (-w <= z <= w), planes normalized
+Frustum ExtractFrustum(const glm::mat4& viewProjection);
+Frustum FrustumFromCamera(const Camera& camera);
+
+enum class CullingKernel {
+    Scalar,
+    // 4 spheres per iteration
+    SSE,
+    // 8 spheres per iteration, picked at runtime when the CPU has it
+    AVX
+};
+
+const char* CullingKernelName(CullingKernel kernel);
+
+// World-space bounding spheres in structure-of-arrays layout, padded to a
+// whole number of blocks. Padding has a radius of -infinity so it never passes.
+struct CullingBounds {
+    std::vector<float> mCenterX;
+    std::vector<float> mCenterY;
+    std::vector<float> mCenterZ;
+    std::vector<float> mRadius;
+    uint32_t mCount = 0;
+};
+
+void CullingBoundsResize(CullingBounds* bounds, uint32_t count);
+// Moves a local-space sphere (center, radius) into world space with modelMatrix
+void CullingBoundsSet(CullingBounds* bounds, uint32_t index, const glm::mat4& modelMatrix,
+                      const glm::vec4& localSphere);
+
+// Counters of the last FrustumCullerRun
+struct CullingStats {
+    uint32_t mTested = 0;
+    uint32_t mVisible = 0;
+    uint32_t mCulled = 0;
+    uint32_t mThreads = 0;
+};
+
+// Tests CullingBounds against a frustum and writes the indices of the
+// visible ones, in ascending order, to mVisible. Large sets are split in
+// contiguous ranges over persistent worker threads, each range is compacted
+// in place and the ranges are then moved together.
+struct FrustumCuller {
+    CullingBounds mBounds;
+    std::vector<uint32_t> mVisible;
+    CullingStats mStats;
+    CullingKernel mKernel = CullingKernel::Scalar;
+
+    // Workers take ranges 1..mThreads.size(), the calling thread range 0
+    std::vector<std::thread> mThreads;
+    std::mutex mMutex;
+    std::condition_variable mWake;
+    std::condition_variable mDone;
+    uint64_t mGeneration = 0;
+    uint32_t mPending = 0;
+    bool mQuit = false;
+    // The job the workers wake up for
+    Frustum mFrustum;
+    uint32_t mRangeCount = 0;
+    std::vector<uint32_t> mRangeVisible;
+};
+
+// threadCount 0 picks one per core up to CULLING_MAX_THREADS, counting the caller
+void CreateFrustumCuller(FrustumCuller* culler, uint32_t threadCount);
+void DestroyFrustumCuller(FrustumCuller* culler);
+void FrustumCullerRun(FrustumCuller* culler, const Frustum& frustum);
+
+#endif
@@ -0,0 +1,81 @@
+#ifndef GEOMETRYPOOL_HPP
+#define GEOMETRYPOOL_HPP
+
+#include <glad/glad.h>
+#include <vector>
+
+#include "GpuResources.hpp"
+#include "MeshData.hpp"
+
+// Layout of the vertices stored in a pool, each format gets its own pool and VAO
+enum class VertexFormat : GLuint {
+    PositionColor = 0 // struct Vertex
+};
+
+GLsizei VertexFormatStride(VertexFormat format);
+const VertexAttribute* VertexFormatAttributes(VertexFormat format, GLuint* count);
+
+// Unused range of a pool buffer, in elements
+struct FreeBlock {
+    GLuint mOffset = 0;
+    GLuint mSize = 0;
+};
+
+// First-fit free-list allocator. Free blocks are kept sorted by offset and
+// neighbours are merged on free, so fragmentation only comes from live ranges.
+struct RangeAllocator {
+    GLuint mCapacity = 0;
+    std::vector<FreeBlock> mFreeBlocks;
+};
+
+void CreateRangeAllocator(RangeAllocator* allocator, GLuint capacity);
+bool RangeAllocatorAllocate(RangeAllocator* allocator, GLuint size, GLuint* offset);
+void RangeAllocatorFree(RangeAllocator* allocator, GLuint offset, GLuint size);
+void RangeAllocatorGrow(RangeAllocator* allocator, GLuint capacity);
+
+// Where one mesh lives inside the pool buffers
+struct GeometryAllocation {
+    // Added to every index by glDrawElementsBaseVertex
+    GLuint mBaseVertex = 0;
+    GLuint mVertexCount = 0;
+    GLuint mFirstIndex = 0;
+    GLuint mIndexCount = 0;
+    bool mLive = false;
+};
+
+// Index into GeometryPool::mAllocations. Handles stay valid when the pool
+// grows or is defragmented, only the allocation they point to moves.
+typedef GLuint GeometryHandle;
+
+struct GeometryPool {
+    VertexFormat mFormat = VertexFormat::PositionColor;
+    GLuint mVertexArrayObject = 0;
+    GLuint mVertexBufferObject = 0;
+    GLuint mIndexBufferObject = 0;
+    RangeAllocator mVertexAllocator;
+    RangeAllocator mIndexAllocator;
+    std::vector<GeometryAllocation> mAllocations;
+    std::vector<GeometryHandle> mFreeHandles;
+};
+
+// What one GeometryPoolDefragment found and did
+struct GeometryDefragmentStats {
+    GLuint mAllocations = 0;
+    // Before packing, there is one block of each left afterwards
+    GLuint mVertexFreeBlocks = 0;
+    GLuint mIndexFreeBlocks = 0;
+    // Moved to the front, in elements
+    GLuint mVertices = 0;
+    GLuint mIndices = 0;
+};
+
+void CreateGeometryPool(GeometryPool* pool, VertexFormat format, GLuint vertexCapacity, GLuint indexCapacity);
+void DestroyGeometryPool(GeometryPool* pool);
+GeometryHandle GeometryPoolAllocate(GeometryPool* pool, const MeshData& meshData);
+void GeometryPoolFree(GeometryPool* pool, GeometryHandle handle);
+const GeometryAllocation& GeometryPoolGet(const GeometryPool& pool, GeometryHandle handle);
+// Packs all live allocations to the front of the buffers
+GeometryDefragmentStats GeometryPoolDefragment(GeometryPool* pool);
+void GeometryPoolDraw(const GeometryPool& pool, GeometryHandle handle);
+
+#endif
@@ -0,0 +1,116 @@
+#ifndef GPUCULLER_HPP
+#define GPUCULLER_HPP
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <vector>
+
+#include "GeometryPool.hpp"
+#include "IndirectRenderer.hpp"
+#include "InstancedRenderer.hpp"
+#include "Pipeline.hpp"
+#include "RenderQueue.hpp"
+#include "ShaderPreprocessor.hpp"
+
+// Work group sizes of shaders/cull.comp.glsl and shaders/hiz.comp.glsl
+const GLuint GPU_CULL_GROUP_SIZE = 64;
+const GLuint GPU_HIZ_GROUP_SIZE = 8;
+// Frames between writing the counters and reading them back, so reading never waits
+const uint32_t GPU_CULL_READBACK_FRAMES = 3;
+
+// All objects of one geometry, consecutive in the object list
+struct GpuCullDraw {
+    GeometryHandle mGeometry = 0;
+    // Local bounding sphere of the geometry, the shader moves it with every object
+    glm::vec4 mSphere{ glm::vec4(0.0f) };
+    uint32_t mFirstObject = 0;
+    uint32_t mObjectCount = 0;
+};
+
+// Results are a few frames old, the GPU reports them asynchronously
+struct GpuCullStats {
+    uint32_t mObjects = 0;
+    uint32_t mVisible = 0;
+    uint32_t mCulled = 0;
+    uint32_t mOccluded = 0;
+};
+
+// Culling on the GPU, GL 4.3 and up. Every frame a compute pass reduces the
+// last frame's depth buffer into a pyramid of farthest depths (Hi-Z). A
+// second one tests every object's bounds against the frustum and, with the
+// camera the depth was drawn with, against the pyramid. Survivors are
+// appended to their draw's range of the visible instance buffer, and their
+// count goes straight into the draw's indirect command. A single
+// glMultiDrawElementsIndirect then draws them.
+//
+// Only objects that move are uploaded, so the CPU cost does not grow with the
+// object count. Testing against the last frame's depth means an object that
+// comes out from behind something appears a frame late.
+struct GpuCuller {
+    const GeometryPool* mPool = nullptr;
+    // Draws the survivors, reads InstanceData as per-instance attributes
+    const Pipeline* mPipeline = nullptr;
+    Pipeline mCullProgram;
+    Pipeline mHiZProgram;
+    Uniform<GLint> mObjectCountUniform;
+    GLint mPlanesLocation = -1;
+    Uniform<GLint> mHiZLevelsUniform;
+    Uniform<glm::mat4> mHiZViewProjectionUniform;
+    Uniform<glm::vec2> mScreenSizeUniform;
+    Uniform<GLint> mSourceLevelUniform;
+
+    std::vector<GpuCullDraw> mDraws;
+    // Until GpuCullerFinalize, the buffers take it from there
+    std::vector<InstanceData> mInitialObjects;
+    std::vector<GLuint> mInitialObjectDraws;
+    uint32_t mObjectCount = 0;
+
+    GLuint mObjectBuffer = 0;
+    GLuint mObjectDrawBuffer = 0;
+    GLuint mDrawSphereBuffer = 0;
+    // Rewritten every frame, the pool may have moved the geometry
+    GLuint mCommandBuffer = 0;
+    std::vector<DrawElementsIndirectCommand> mCommands;
+    // Same layout as mObjectBuffer, each draw's survivors packed at the start of its range
+    GLuint mVisibleBuffer = 0;
+    GLuint mCounterBuffer = 0;
+
+    // Pool geometry plus the visible instances
+    GLuint mVertexArrayObject = 0;
+    GLuint mSpecifiedVertexBuffer = 0;
+    GLuint mSpecifiedIndexBuffer = 0;
+
+    // The last frame's depth, and the pyramid over it at half its size and down
+    int mWidth = 0;
+    int mHeight = 0;
+    GLuint mDepthTexture = 0;
+    GLuint mHiZTexture = 0;
+    GLint mHiZLevels = 0;
+    bool mHiZValid = false;
+    glm::mat4 mHiZViewProjection{ glm::mat4(1.0f) };
+
+    // Copies of mCounterBuffer on their way back to the CPU
+    GLuint mReadbackBuffer = 0;
+    GLsync mReadbackFences[GPU_CULL_READBACK_FRAMES] = {};
+    uint32_t mFrame = 0;
+    GpuCullStats mStats;
+};
+
+// GL 4.3 with compute shaders, storage buffers and multi draw indirect
+bool GpuCullingSupported();
+void CreateGpuCuller(GpuCuller* culler, const GeometryPool* pool, const Pipeline* pipeline,
+                     ShaderLibrary* shaderLibrary, int width, int height);
+void DestroyGpuCuller(GpuCuller* culler);
+// Returns the index of the first object, add every draw before GpuCullerFinalize
+uint32_t GpuCullerAddDraw(GpuCuller* culler, GeometryHandle geometry, const glm::vec4& localSphere,
+                          const InstanceData* instances, uint32_t count);
+void GpuCullerFinalize(GpuCuller* culler);
+// Uploads objects [first, first + count) again, for the ones that moved
+void GpuCullerUpdate(GpuCuller* culler, uint32_t first, const InstanceData* instances, uint32_t count);
+// Builds the pyramid from the last frame, culls and draws what is left
+void GpuCullerDraw(GpuCuller* culler, const glm::mat4& viewProjection, RenderStats* stats);
+// Keeps the depth buffer for the next frame's pyramid, call once everything opaque is drawn
+void GpuCullerEndFrame(GpuCuller* culler, const glm::mat4& viewProjection);
+
+#endif
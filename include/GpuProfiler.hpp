@@ -0,0 +1,87 @@
+#ifndef GPUPROFILER_HPP
+#define GPUPROFILER_HPP
+
+#include <glad/glad.h>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "Utilities.hpp"
+
+// Frames of results kept per zone for the rolling statistics, by default
+const uint32_t GPU_PROFILER_WINDOW = 128;
+// Frames allowed in flight before the oldest results are dropped instead of waited for
+const uint32_t GPU_PROFILER_MAX_PENDING = 8;
+
+struct GpuZone {
+    std::string mName;
+    // Nesting depth when the zone was first seen, only used to indent the log
+    uint32_t mDepth = 0;
+    // Per-frame milliseconds, circular once GpuProfiler::mWindow is reached.
+    // Several scopes of one zone in a frame are summed.
+    std::vector<double> mSamples;
+    uint32_t mNextSample = 0;
+};
+
+// Two GL_TIMESTAMP queries bracketing a zone scope
+struct GpuZoneQuery {
+    uint32_t mZone = 0;
+    GLuint mBegin = 0;
+    GLuint mEnd = 0;
+};
+
+struct GpuProfilerFrame {
+    std::vector<GpuZoneQuery> mQueries;
+    // The timestamp issued most recently, the enclosing zones end after the inner ones
+    GLuint mLastQuery = 0;
+};
+
+// GPU time per zone from timestamp query pairs. Timestamps are used rather
+// than GL_TIME_ELAPSED, which cannot nest. Queries come from a pool and are
+// only read once GL_QUERY_RESULT_AVAILABLE says so, usually a few frames
+// later, so the profiler never stalls the pipeline.
+struct GpuProfiler {
+    bool mEnabled = false;
+    // Also time every draw of the render queue, as zone "Draw"
+    bool mDrawZones = false;
+    uint32_t mWindow = GPU_PROFILER_WINDOW;
+    std::vector<GLuint> mFreeQueries;
+    GLuint mQueryCount = 0;
+    std::vector<GpuZone> mZones;
+    std::unordered_map<std::string, uint32_t> mZoneIds;
+    // Oldest first, the last one is being recorded
+    std::deque<GpuProfilerFrame> mFrames;
+    // Open scopes, as indices into the recording frame's mQueries
+    std::vector<size_t> mOpenZones;
+    uint64_t mDroppedFrames = 0;
+};
+
+void CreateGpuProfiler(GpuProfiler* profiler, bool enabled);
+void DestroyGpuProfiler(GpuProfiler* profiler);
+// Collects whatever results are available and starts recording a new frame
+void GpuProfilerBeginFrame(GpuProfiler* profiler);
+// Scopes must be closed in reverse order of opening
+void GpuProfilerBeginZone(GpuProfiler* profiler, const char* name);
+void GpuProfilerEndZone(GpuProfiler* profiler);
+// Waits for every pending result, only meant for shutdown or explicit dumps
+void GpuProfilerFlush(GpuProfiler* profiler);
+// Forgets every sample collected so far, zones stay known
+void GpuProfilerReset(GpuProfiler* profiler);
+// Returns false if the zone has no results yet
+bool GpuProfilerGetStats(const GpuProfiler& profiler, const char* name, TimingStats* stats);
+void GpuProfilerLog(const GpuProfiler& profiler);
+
+// Opens a zone for the rest of the enclosing block
+struct GpuProfileScope {
+    GpuProfiler* mProfiler;
+    GpuProfileScope(GpuProfiler* profiler, const char* name) : mProfiler(profiler) {
+        GpuProfilerBeginZone(mProfiler, name);
+    }
+    ~GpuProfileScope() {
+        GpuProfilerEndZone(mProfiler);
+    }
+};
+
+#endif
@@ -0,0 +1,38 @@
+#ifndef GPURESOURCES_HPP
+#define GPURESOURCES_HPP
+
+#include <glad/glad.h>
+
+// One attribute sourced from a vertex buffer, offset is relative to the vertex
+struct VertexAttribute {
+    GLuint mLocation = 0;
+    GLint mComponents = 0;
+    GLenum mType = GL_FLOAT;
+    GLuint mOffset = 0;
+};
+
+// Buffers and vertex arrays are created and edited through direct state access
+// (ARB_direct_state_access, core in 4.5) when the context has it, so loading
+// never touches the bindings used for drawing. Without it the calls fall back
+// to bind-to-edit and put every binding they change back to 0.
+bool GpuHasDirectStateAccess();
+
+// Empty buffer name that can be handed to any of the functions below
+GLuint CreateBuffer();
+// Buffer whose size never changes, dynamic allows BufferUpload afterwards
+GLuint CreateStaticBuffer(GLsizeiptr size, const void* data, bool dynamic);
+// Gives a buffer from CreateBuffer fresh storage of size bytes, orphaning the old
+// one so draws still reading it don't stall the caller
+void BufferRespecify(GLuint buffer, GLsizeiptr size, const void* data, GLenum usage);
+void BufferUpload(GLuint buffer, GLintptr offset, GLsizeiptr size, const void* data);
+void BufferCopy(GLuint source, GLuint destination, GLintptr sourceOffset, GLintptr destinationOffset,
+                GLsizeiptr size);
+
+GLuint CreateVertexArray();
+// Sources attributes from buffer, starting at offset. On the DSA path the attributes
+// share the vertex buffer binding point binding, divisor 1 makes them per-instance.
+void VertexArrayVertexBuffer(GLuint vertexArray, GLuint binding, GLuint buffer, GLintptr offset, GLsizei stride,
+                             GLuint divisor, const VertexAttribute* attributes, GLuint attributeCount);
+void VertexArrayIndexBuffer(GLuint vertexArray, GLuint buffer);
+
+#endif
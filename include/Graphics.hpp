@@ -6,15 +6,27 @@
 #include <string>
 #include <vector>
 
+#include "GeometryPool.hpp"
 #include "MeshData.hpp"
+#include "Pipeline.hpp"
+#include "ProgramCache.hpp"
+#include "ResourceManager.hpp"
 
 #include "App.hpp"
 #include "Utilities.hpp"
 
+#define SHADER_DIRECTORY "./shaders"
+
 struct Transform {
     glm::mat4 mModelMatrix{ glm::mat4(1.0f) };
 };
 
+// Passes are drawn in this order, transparent meshes are blended back-to-front
+enum class RenderPass : GLuint {
+    Opaque = 0,
+    Transparent = 1
+};
+
 struct Mesh3D {
     GLuint mVertexArrayObject = 0;
     GLuint mVertexBufferObject = 0;
@@ -23,18 +35,45 @@ struct Mesh3D {
     // to draw from, when we do indexed drawing
     GLuint mIndexBufferObject = 0;
     GLsizei mIndexCount = 0;
+    // Local-space bounding sphere of the geometry, center in xyz and radius in w
+    glm::vec4 mBoundingSphere{ glm::vec4(0.0f) };
+    // Ownership of the objects above, the raw names are kept for drawing
+    ResourceHandle mVertexArrayHandle;
+    ResourceHandle mVertexBufferHandle;
+    ResourceHandle mIndexBufferHandle;
+    // Set when the geometry lives in a shared pool instead of buffers owned
+    // by this mesh. mVertexArrayObject is then the pool's VAO.
+    const GeometryPool* mGeometryPool = nullptr;
+    GeometryHandle mGeometry = 0;
     // This is the graphics pipeline used with this mesh
-    GLuint mPipeline = 0;
+    const Pipeline* mPipeline = nullptr;
+    // Slot of this mesh in the frame's PerObject uniform buffer
+    GLuint mObjectIndex = 0;
+    RenderPass mRenderPass = RenderPass::Opaque;
     Transform mTransform;
 };
 
 void CreateGraphicsPipeline(App* app);
-GLuint CreateShaderProgram(const std::string& vertexshadersource, const std::string& fragmentshadersource);
+Pipeline CreateShaderProgram(const std::string& vertexshadersource, const std::string& fragmentshadersource,
+                             ProgramCache* cache = nullptr);
+// Needs GL 4.3, see GpuCullingSupported
+Pipeline CreateComputeProgram(const std::string& computeshadersource, const std::string& label);
+// Vertex and geometry stages whose outputs transform feedback captures interleaved.
+// With an empty geometry source the vertex stage's outputs are captured.
+Pipeline CreateFeedbackProgram(const std::string& vertexshadersource, const std::string& geometryshadersource,
+                               const char* const* varyings, GLsizei varyingCount, const std::string& label);
 GLuint CompileShader(GLuint type, const std::string& source);
-void MeshDataVertexSpecification(Mesh3D* mesh, const MeshData& meshData);
-void MeshSetPipeline(Mesh3D* mesh, GLuint pipeline);
-void MeshDraw(Mesh3D* mesh, App app);
-GLuint FindUniformLocation(GLuint pipeline, const GLchar* name);
+// Print the info log and return false on failure
+bool CheckShaderCompileStatus(GLuint shader, const std::string& label);
+bool CheckProgramLinkStatus(GLuint program, const std::string& label);
+// Reflects a linked program and binds the shared uniform blocks
+Pipeline CreatePipelineFromProgram(GLuint program);
+void MeshDataVertexSpecification(Mesh3D* mesh, ResourceManager* resources, const MeshData& meshData);
+// Drops the mesh's references, the objects go once the GPU is done with them
+void MeshRelease(Mesh3D* mesh, ResourceManager* resources);
+void MeshDataPoolSpecification(Mesh3D* mesh, GeometryPool* pool, const MeshData& meshData);
+void MeshDrawElements(const Mesh3D* mesh);
+void MeshSetPipeline(Mesh3D* mesh, const Pipeline* pipeline);
 void MeshTraslate(Mesh3D* mesh, float x, float y, float z);
 void MeshRotateY(Mesh3D *mesh, float yAngle, glm::vec3 axis);
 void MeshScale(Mesh3D* mesh, float x, float y, float z);
@@ -0,0 +1,25 @@
+#ifndef HEADLESS_HPP
+#define HEADLESS_HPP
+
+#include <glad/glad.h>
+
+// GL context without a window or display server, for build and perf machines.
+// The context comes from EGL (surfaceless Mesa platform when available, so
+// llvmpipe works on a plain Linux box) and everything is drawn into an FBO
+// that stays bound as the draw framebuffer. Only available on Linux.
+struct HeadlessContext {
+    // EGLDisplay, EGLContext and EGLSurface, kept opaque so EGL stays out of the headers
+    void* mDisplay = nullptr;
+    void* mContext = nullptr;
+    // 1x1 pbuffer, only created when the driver can't make a context current without a surface
+    void* mSurface = nullptr;
+    GLuint mFramebuffer = 0;
+    GLuint mColorRenderbuffer = 0;
+    GLuint mDepthRenderbuffer = 0;
+};
+
+// Creates a GL 4.1 core context, loads glad and binds a width x height framebuffer. False on failure.
+bool CreateHeadlessContext(HeadlessContext* context, int width, int height);
+void DestroyHeadlessContext(HeadlessContext* context);
+
+#endif
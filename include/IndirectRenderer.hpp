@@ -0,0 +1,62 @@
+#ifndef INDIRECTRENDERER_HPP
+#define INDIRECTRENDERER_HPP
+
+#include <glad/glad.h>
+#include <vector>
+
+#include "GeometryPool.hpp"
+#include "InstancedRenderer.hpp"
+#include "Pipeline.hpp"
+#include "RenderQueue.hpp"
+#include "RingBuffer.hpp"
+
+// Layout fixed by the GL spec for commands read from GL_DRAW_INDIRECT_BUFFER
+struct DrawElementsIndirectCommand {
+    GLuint mCount = 0;
+    GLuint mInstanceCount = 0;
+    GLuint mFirstIndex = 0;
+    GLint mBaseVertex = 0;
+    GLuint mBaseInstance = 0;
+};
+
+// How the command list reaches the GPU, picked from the context's capabilities
+enum class IndirectSubmitMode {
+    // One glMultiDrawElementsIndirect for the whole list
+    MultiDrawIndirect,
+    // One glDrawElementsInstancedBaseVertexBaseInstance per command
+    BaseInstanceLoop,
+    // Plain GL 4.1: one glDrawElementsInstancedBaseVertex per command, with
+    // the instance attributes re-pointed to emulate the base instance
+    AttributeRebaseLoop
+};
+
+// Draws everything stored in one GeometryPool with a single pipeline. Every
+// command reads its per-draw data (model matrix, color) from the instance
+// stream starting at its baseInstance, so no uniform changes between draws.
+struct IndirectRenderer {
+    const GeometryPool* mPool = nullptr;
+    const Pipeline* mPipeline = nullptr;
+    IndirectSubmitMode mMode = IndirectSubmitMode::AttributeRebaseLoop;
+
+    // Pool geometry plus the instance stream
+    GLuint mVertexArrayObject = 0;
+    // Pool buffers the VAO was last specified with, they change when the pool grows
+    GLuint mSpecifiedVertexBuffer = 0;
+    GLuint mSpecifiedIndexBuffer = 0;
+
+    // Commands and instances are rewritten every frame
+    RingBuffer mCommandRing;
+    RingBuffer mInstanceRing;
+
+    std::vector<DrawElementsIndirectCommand> mCommands;
+    std::vector<InstanceData> mInstances;
+};
+
+void CreateIndirectRenderer(IndirectRenderer* renderer, const GeometryPool* pool, const Pipeline* pipeline);
+void DestroyIndirectRenderer(IndirectRenderer* renderer);
+void IndirectRendererBegin(IndirectRenderer* renderer);
+void IndirectRendererPush(IndirectRenderer* renderer, GeometryHandle geometry,
+                          const InstanceData* instances, GLuint instanceCount);
+void IndirectRendererSubmit(IndirectRenderer* renderer, RenderStats* stats);
+
+#endif
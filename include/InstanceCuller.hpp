@@ -0,0 +1,99 @@
+#ifndef INSTANCECULLER_HPP
+#define INSTANCECULLER_HPP
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <vector>
+
+#include "InstancedRenderer.hpp"
+#include "Pipeline.hpp"
+#include "RenderQueue.hpp"
+#include "ShaderPreprocessor.hpp"
+
+// Attribute locations of shaders/instancecull.vert.glsl, InstanceData read per vertex
+const GLuint INSTANCE_CULL_MODEL_MATRIX_LOCATION = 0;
+const GLuint INSTANCE_CULL_COLOR_LOCATION = 4;
+
+// Frames alternate between the slots, one is captured into while the other is drawn
+const uint32_t INSTANCE_CULL_SLOTS = 2;
+// The frustum culled against is this much wider and taller, in tangent of the
+// field of view, so last frame's survivors still cover what turned into view
+const float INSTANCE_CULL_FRUSTUM_PADDING = 1.1f;
+
+// What the culler keeps next to one InstanceGroup, same index
+struct InstanceCullGroup {
+    // The group's instance buffer as per-vertex attributes, one point per instance
+    GLuint mCullVertexArray = 0;
+    // The group's instance buffer again, for the gather pass to fetch from
+    GLuint mInstanceTexture = 0;
+    // Per slot, indices of the survivors packed from the start, and a buffer
+    // texture over them. Grows like the instance buffer does.
+    GLuint mIndexBuffers[INSTANCE_CULL_SLOTS] = {};
+    GLuint mIndexTextures[INSTANCE_CULL_SLOTS] = {};
+    GLsizeiptr mIndexCapacity[INSTANCE_CULL_SLOTS] = {};
+    // GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN, the survivor count
+    GLuint mQueries[INSTANCE_CULL_SLOTS] = {};
+    // Instances culled into the slot, 0 until it has a query in flight
+    GLuint mCulledCount[INSTANCE_CULL_SLOTS] = {};
+    // Current InstanceData of the survivors, gathered right before the draw
+    GLuint mVisibleBuffer = 0;
+    GLsizeiptr mVisibleCapacity = 0;
+    // The group's geometry, with mVisibleBuffer as the instance stream
+    GLuint mDrawVertexArray = 0;
+    // Survivors of the slot culled the frame before, only valid when mReady
+    GLuint mVisibleCount = 0;
+    bool mReady = false;
+    // Local bounding sphere of the geometry
+    glm::vec4 mSphere{ glm::vec4(0.0f) };
+};
+
+// Counters of what InstanceCullerDraw draws after the last InstanceCullerRun
+struct InstanceCullStats {
+    uint32_t mInstances = 0;
+    uint32_t mVisible = 0;
+};
+
+// Frustum culling of the instanced renderer's groups on the GPU, without
+// compute shaders, so it works on the GL 4.1 contexts this project targets.
+// Every group is drawn once as points with the rasterizer off: the vertex
+// stage tests an instance's sphere, the geometry stage emits only the ones
+// inside, and transform feedback packs their indices into the group's index
+// buffer. A primitives written query per group counts them.
+//
+// Reading the count in the frame it was queried would wait for the GPU to
+// catch up, so each frame draws the indices culled the frame before. A
+// gather pass first copies those instances' current InstanceData out of the
+// instance buffer, so survivors are drawn with this frame's transforms. Only
+// the visibility is a frame old: the frustum is padded for camera turns, but
+// an instance that came into view by more than the padding since then, or
+// across the near or far plane, appears a frame late. A group whose count
+// isn't there yet is drawn unculled.
+//
+// glDrawTransformFeedbackInstanced would skip the count, but it needs 4.2 and
+// takes the captured points as vertices, not instances.
+struct InstanceCuller {
+    Pipeline mProgram;
+    Uniform<glm::vec4> mSphereUniform;
+    GLint mPlanesLocation = -1;
+    // Vertex stage only, fetches everything from buffer textures
+    Pipeline mGatherProgram;
+    // No attributes, the gather pass still needs one bound to draw
+    GLuint mGatherVertexArray = 0;
+    // Largest group the instance buffer texture can hold, larger ones aren't culled
+    uint32_t mMaxInstances = 0;
+    // Slot the last InstanceCullerRun captured into
+    uint32_t mSlot = 0;
+    std::vector<InstanceCullGroup> mGroups;
+    InstanceCullStats mStats;
+};
+
+void CreateInstanceCuller(InstanceCuller* culler, ShaderLibrary* shaderLibrary);
+void DestroyInstanceCuller(InstanceCuller* culler);
+// Culls every group of renderer, upload its instances first. Also gathers
+// the survivors of the run before, if the GPU has their counts.
+void InstanceCullerRun(InstanceCuller* culler, const InstancedRenderer& renderer, const glm::mat4& viewProjection);
+// Draws what the last InstanceCullerRun gathered, one instanced draw per group
+void InstanceCullerDraw(const InstanceCuller& culler, const InstancedRenderer& renderer, RenderStats* stats);
+
+#endif
@@ -0,0 +1,66 @@
+#ifndef INSTANCEDRENDERER_HPP
+#define INSTANCEDRENDERER_HPP
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <unordered_map>
+#include <vector>
+
+#include "Graphics.hpp"
+#include "MeshData.hpp"
+#include "Pipeline.hpp"
+#include "RenderQueue.hpp"
+
+// Attribute locations of the per-instance stream in shaders/vert.glsl (INSTANCING permutation).
+// A mat4 attribute takes four consecutive locations, one per column.
+const GLuint INSTANCE_MODEL_MATRIX_LOCATION = 2;
+const GLuint INSTANCE_COLOR_LOCATION = 6;
+
+// Per-instance attributes, advanced once per instance (divisor 1)
+struct InstanceData {
+    glm::mat4 mModelMatrix{ glm::mat4(1.0f) };
+    glm::vec4 mColor{ glm::vec4(1.0f) };
+};
+
+// Vertex buffer binding the instance stream is attached to, geometry uses 0
+const GLuint INSTANCE_BUFFER_BINDING = 1;
+
+// Model matrix columns and color, as read from an InstanceData stream
+const VertexAttribute* InstanceDataAttributes(GLuint* count);
+
+// All instances of one MeshData, drawn with a single glDrawElementsInstanced
+struct InstanceGroup {
+    const MeshData* mMeshData = nullptr;
+    // Shared geometry, its VAO also sources the instance buffer
+    Mesh3D mMesh;
+    GLuint mInstanceBuffer = 0;
+    ResourceHandle mInstanceBufferHandle;
+    GLsizeiptr mInstanceCapacity = 0;
+    std::vector<InstanceData> mInstances;
+    // Set when mInstances changed since the last upload
+    bool mDirty = false;
+};
+
+// Identifies one instance for later updates
+struct InstanceId {
+    GLuint mGroup = 0;
+    GLuint mIndex = 0;
+};
+
+struct InstancedRenderer {
+    const Pipeline* mPipeline = nullptr;
+    ResourceManager* mResources = nullptr;
+    std::vector<InstanceGroup> mGroups;
+    // Groups are keyed by geometry, so MeshTemplates share one group each
+    std::unordered_map<const MeshData*, GLuint> mGroupIndex;
+};
+
+void CreateInstancedRenderer(InstancedRenderer* renderer, const Pipeline* pipeline, ResourceManager* resources);
+void DestroyInstancedRenderer(InstancedRenderer* renderer);
+InstanceId InstancedRendererAdd(InstancedRenderer* renderer, const MeshData& meshData,
+                                const glm::mat4& modelMatrix, const glm::vec4& color);
+InstanceData* InstancedRendererGet(InstancedRenderer* renderer, InstanceId id);
+void InstancedRendererUpload(InstancedRenderer* renderer);
+void InstancedRendererDraw(const InstancedRenderer& renderer, RenderStats* stats);
+
+#endif
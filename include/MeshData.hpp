@@ -18,53 +18,18 @@ struct MeshData {
 };
 
 const MeshData GenerateSphere(unsigned int subdivisions);
+// Center of the vertex bounds in xyz, distance to the farthest vertex in w
+glm::vec4 MeshDataBoundingSphere(const MeshData& meshData);
 
-// Define reusable mesh templates
+// Define reusable mesh templates, defined once in MeshData.cpp so every
+// translation unit refers to the same geometry
 namespace MeshTemplates {
-    const MeshData Square = {
-        {
-            //  x      y     z  |   r     g     b
-            { -0.5f, -0.5f, 0.0f, 1.0f, 0.0f, 0.0f }, // Vertex 1
-            {  0.5f, -0.5f, 0.0f, 0.0f, 1.0f, 0.0f }, // Vertex 2
-            { -0.5f,  0.5f, 0.0f, 0.0f, 0.0f, 1.0f }, // Vertex 3
-            {  0.5f,  0.5f, 0.0f, 1.0f, 0.0f, 0.0f }  // Vertex 4
-        },
-        { 2, 0, 1, 3, 2, 1 } // Indices
-    };
-
-    const MeshData Cube = {
-        {
-            {-0.5f, -0.5f, -0.5f, 1.0f, 0.0f, 0.0f},
-            { 0.5f, -0.5f, -0.5f, 0.0f, 1.0f, 0.0f},
-            { 0.5f,  0.5f, -0.5f, 0.0f, 0.0f, 1.0f},
-            {-0.5f,  0.5f, -0.5f, 1.0f, 1.0f, 0.0f},
-            {-0.5f, -0.5f,  0.5f, 1.0f, 0.0f, 1.0f},
-            { 0.5f, -0.5f,  0.5f, 0.0f, 1.0f, 1.0f},
-            { 0.5f,  0.5f,  0.5f, 1.0f, 1.0f, 1.0f},
-            {-0.5f,  0.5f,  0.5f, 0.5f, 0.5f, 0.5f}
-        },
-        { 0, 1, 2, 2, 3, 0,  // Front face
-        1, 5, 6, 6, 2, 1,  // Right face
-        5, 4, 7, 7, 6, 5,  // Back face
-        4, 0, 3, 3, 7, 4,  // Left face
-        3, 2, 6, 6, 7, 3,  // Top face
-        4, 5, 1, 1, 0, 4 } // Bottom face
-    };
-
-    const MeshData Tetrahedron = {
-        {
-            {  0.0f, 0.5f,   0.5f,  1.0f, 0.0f, 0.0f }, // Vertex 0 - Top
-            {  0.5f, 0.5f,   0.0f,  0.0f, 1.0f, 0.0f }, // Vertex 1 - Front Left
-            {  0.0f, 0.0f,  0.0f,  0.0f, 0.0f, 1.0f }, // Vertex 2 - Front Right
-            {  0.5f, 0.0f,  0.5f,  1.0f, 1.0f, 0.0f }  // Vertex 3 - Back
-        },
-        {0, 1, 2, // Front Face
-        0, 2, 3, // Right Face
-        0, 3, 1, // Left Face
-        1, 2, 3}  // Bottom Face
-    };
-    
-    const MeshData Sphere = GenerateSphere(9);
+    extern const MeshData Square;
+    extern const MeshData Cube;
+    extern const MeshData Tetrahedron;
+    extern const MeshData Sphere;
+    // Cheap sphere for drawing large numbers of instances
+    extern const MeshData SphereLowPoly;
 }
 
 #endif
\ No newline at end of file
@@ -0,0 +1,134 @@
+#ifndef OCCLUSIONCULLER_HPP
+#define OCCLUSIONCULLER_HPP
+
+#include <glm/glm.hpp>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "Culling.hpp"
+#include "MeshData.hpp"
+
+// Depth buffer resolution, a fraction of the screen is plenty to find hidden objects
+const uint32_t OCCLUSION_WIDTH = 256;
+const uint32_t OCCLUSION_HEIGHT = 192;
+// Triangles are binned to tiles and every tile is rasterized by one thread
+const uint32_t OCCLUSION_TILE_WIDTH = 32;
+const uint32_t OCCLUSION_TILE_HEIGHT = 16;
+const uint32_t OCCLUSION_TILES_X = OCCLUSION_WIDTH / OCCLUSION_TILE_WIDTH;
+const uint32_t OCCLUSION_TILES_Y = OCCLUSION_HEIGHT / OCCLUSION_TILE_HEIGHT;
+const uint32_t OCCLUSION_TILE_PIXELS = OCCLUSION_TILE_WIDTH * OCCLUSION_TILE_HEIGHT;
+// Occluder triangles rasterized per frame at most, the largest occluders go first
+const uint32_t OCCLUSION_TRIANGLE_BUDGET = 32768;
+// Bounding radius over view distance an occluder needs, about a pixel of the
+// depth buffer. The triangle budget then goes to the largest ones.
+const float OCCLUSION_MIN_OCCLUDER_SIZE = 0.005f;
+// Candidates sorted for the budget per frame, the rest are never reached anyway
+const uint32_t OCCLUSION_MAX_OCCLUDERS = 1024;
+
+// A triangle after setup: edge functions that are >= 0 inside, a depth plane
+// and the pixels it can touch
+struct OcclusionTriangle {
+    float mEdgeA[3];
+    float mEdgeB[3];
+    float mEdgeC[3];
+    // Depth at a pixel center is mDepthA * x + mDepthB * y + mDepthC
+    float mDepthA, mDepthB, mDepthC;
+    int mMinX, mMinY, mMaxX, mMaxY;
+};
+
+struct OcclusionOccluder {
+    const MeshData* mMeshData = nullptr;
+    glm::mat4 mModelMatrix{ glm::mat4(1.0f) };
+};
+
+enum class OcclusionPhase {
+    // Transform the occluders and bin their triangles, occluders split over threads
+    Setup,
+    // Rasterize the bins, threads take one tile at a time
+    Raster,
+    // Test the bounds, split in contiguous ranges
+    Test
+};
+
+// Counters of the last OcclusionCullerRun
+struct OcclusionStats {
+    uint32_t mOccluders = 0;
+    uint32_t mTriangles = 0;
+    uint32_t mTested = 0;
+    uint32_t mOccluded = 0;
+    // Left visible without a test because the time budget ran out
+    uint32_t mUntested = 0;
+    uint32_t mThreads = 0;
+    double mRasterTime = 0.0;
+    double mTestTime = 0.0;
+};
+
+// CPU occlusion culling. Occluders are rasterized into a small depth buffer,
+// then the bounds of the objects that passed frustum culling are tested
+// against it. The buffer is stored tile by tile, with the depth range of
+// every tile as the coarse level. Setup bins triangles per
+// thread, and rasterizing goes tile by tile, so no two threads write the same
+// pixels.
+//
+// Occluders are sampled at pixel centers with depth pushed to the farthest
+// value inside the pixel, and occludee rectangles are grown by a pixel, so
+// occluder silhouettes don't hide what is next to them. A gap narrower than
+// a pixel between two occluders still gets closed, so an object seen only
+// through one can be dropped.
+struct OcclusionCuller {
+    // Tile-major, OCCLUSION_TILE_PIXELS floats per tile in rows, NDC depth
+    std::vector<float> mDepth;
+    // Farthest and nearest depth of every tile, most tests are decided by
+    // these before looking at a pixel
+    std::vector<float> mTileMaxDepth;
+    std::vector<float> mTileMinDepth;
+    glm::mat4 mViewProjection{ glm::mat4(1.0f) };
+    std::vector<OcclusionOccluder> mOccluders;
+    uint32_t mTriangleBudget = OCCLUSION_TRIANGLE_BUDGET;
+    uint32_t mBudgetTriangles = 0;
+    // Milliseconds for rasterizing and testing, work left when it runs out is
+    // skipped. Occluders stop at half of it, whatever is left goes to tests.
+    double mTimeBudget = 2.0;
+    OcclusionStats mStats;
+
+    // Per thread: projected vertices, set up triangles and one bin per tile
+    std::vector<std::vector<glm::vec4>> mProjectedVertices;
+    std::vector<std::vector<OcclusionTriangle>> mTriangles;
+    std::vector<std::vector<std::vector<uint32_t>>> mBins;
+
+    // Workers take index 1..mThreads.size(), the calling thread index 0
+    std::vector<std::thread> mThreads;
+    std::mutex mMutex;
+    std::condition_variable mWake;
+    std::condition_variable mDone;
+    uint64_t mGeneration = 0;
+    uint32_t mPending = 0;
+    bool mQuit = false;
+    // The job the workers wake up for
+    OcclusionPhase mPhase = OcclusionPhase::Setup;
+    uint32_t mWorkerCount = 1;
+    std::atomic<uint32_t> mNextTile{ 0 };
+    std::chrono::steady_clock::time_point mStart;
+    const CullingBounds* mBounds = nullptr;
+    std::vector<uint32_t>* mVisible = nullptr;
+    std::vector<uint32_t> mRangeVisible;
+    std::vector<uint32_t> mRangeUntested;
+};
+
+// threadCount 0 picks one per core up to CULLING_MAX_THREADS, counting the caller
+void CreateOcclusionCuller(OcclusionCuller* culler, uint32_t threadCount);
+void DestroyOcclusionCuller(OcclusionCuller* culler);
+// Starts a frame, forgetting the occluders of the last one
+void OcclusionCullerBegin(OcclusionCuller* culler, const glm::mat4& viewProjection);
+// Returns false when the occluder doesn't fit the triangle budget
+bool OcclusionCullerAddOccluder(OcclusionCuller* culler, const MeshData* meshData, const glm::mat4& modelMatrix);
+// Rasterizes the occluders, then removes the occluded bounds from visible,
+// keeping its order
+void OcclusionCullerRun(OcclusionCuller* culler, const CullingBounds& bounds, std::vector<uint32_t>* visible);
+
+#endif
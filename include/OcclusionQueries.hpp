@@ -0,0 +1,55 @@
+#ifndef OCCLUSIONQUERIES_HPP
+#define OCCLUSIONQUERIES_HPP
+
+#include <glad/glad.h>
+#include <cstdint>
+#include <vector>
+
+// Frames between the queries of an object that was visible last time, objects
+// last seen hidden are queried every frame they are in the frustum
+const uint32_t OCCLUSION_QUERY_INTERVAL = 8;
+
+struct OcclusionQueryObject {
+    // Made the first time the object is queried
+    GLuint mQuery = 0;
+    // Issued, but its result was not available yet
+    bool mPending = false;
+    // Last result read back, objects start out visible
+    bool mVisible = true;
+};
+
+// Counters of the last frame
+struct OcclusionQueryStats {
+    uint32_t mIssued = 0;
+    uint32_t mResultsRead = 0;
+    // Queried objects whose last result said hidden, their draws are most
+    // likely skipped by the GPU
+    uint32_t mHidden = 0;
+};
+
+// Hardware occlusion queries, one per object. Objects visible last time are
+// drawn normally and only queried every mInterval frames, staggered so the
+// queries of a frame stay few. Queried objects draw their bounding box with
+// color and depth writes off inside the query, then the object itself under
+// conditional rendering without waiting, so the GPU decides whether it is
+// drawn and the CPU never blocks. Results are read back a frame or more later,
+// only once GL_QUERY_RESULT_AVAILABLE says so, to decide what to query next.
+struct OcclusionQueries {
+    // GL_ANY_SAMPLES_PASSED_CONSERVATIVE when the context has it
+    GLenum mTarget = GL_ANY_SAMPLES_PASSED;
+    uint32_t mInterval = OCCLUSION_QUERY_INTERVAL;
+    uint64_t mFrame = 0;
+    std::vector<OcclusionQueryObject> mObjects;
+    // Objects with mPending set
+    std::vector<uint32_t> mPendingObjects;
+    OcclusionQueryStats mStats;
+};
+
+void CreateOcclusionQueries(OcclusionQueries* queries, uint32_t objectCount);
+void DestroyOcclusionQueries(OcclusionQueries* queries);
+// Reads the results that arrived since the last frame, never waits for the others
+void OcclusionQueriesBeginFrame(OcclusionQueries* queries);
+// Query to draw the object under this frame, 0 when it is drawn without one
+GLuint OcclusionQueriesIssue(OcclusionQueries* queries, uint32_t object);
+
+#endif
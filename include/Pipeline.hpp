@@ -0,0 +1,99 @@
+#ifndef PIPELINE_HPP
+#define PIPELINE_HPP
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+
+#include "ResourceManager.hpp"
+
+// Reflected information about an active uniform or vertex attribute
+struct ShaderVariable {
+    GLint mLocation = -1;
+    GLenum mType = GL_NONE;
+    // Number of array elements (1 for non-arrays)
+    GLint mSize = 0;
+    // Program the location belongs to, differs between the stages of a program pipeline
+    GLuint mProgram = 0;
+};
+
+// Typed handle to a uniform, resolved once when the pipeline is created.
+// A location of -1 is silently ignored by glProgramUniform*, so a handle to
+// a uniform the compiler optimized out is still safe to set.
+template <typename T>
+struct Uniform {
+    GLuint mProgram = 0;
+    GLint mLocation = -1;
+};
+
+// A linked program object together with everything we reflected from it
+struct Pipeline {
+    GLuint mProgram = 0;
+    // Set for separable stages combined in a program pipeline object, which is
+    // bound instead of mProgram. mProgram is then the vertex stage.
+    GLuint mProgramPipeline = 0;
+    // Ownership of mProgram (or of mProgramPipeline), when it is registered with a ResourceManager
+    ResourceHandle mHandle;
+    // ProgramCache entry mProgram was loaded or stored as, 0 when it has none
+    uint64_t mCacheKey = 0;
+    std::unordered_map<std::string, ShaderVariable> mUniforms;
+    std::unordered_map<std::string, ShaderVariable> mAttributes;
+    // Active uniform block indices by block name
+    std::unordered_map<std::string, GLuint> mUniformBlocks;
+};
+
+void PipelineReflect(Pipeline* pipeline);
+// Makes the pipeline current for drawing
+void PipelineBind(const Pipeline& pipeline);
+// Set in a binding id when the name is a program pipeline rather than a program
+const uint64_t PIPELINE_BINDING_SEPARABLE = 1ull << 32;
+
+// Identifies what PipelineBind binds, for sorting and redundant bind checks
+uint64_t PipelineBindingId(const Pipeline& pipeline);
+void PipelineBindUniformBlock(Pipeline* pipeline, const GLchar* name, GLuint binding);
+GLint FindUniformLocation(const Pipeline& pipeline, const GLchar* name);
+
+// Maps a C++ type to the GLSL type glGetActiveUniform reports for it
+template <typename T> constexpr GLenum UniformGLType();
+template <> constexpr GLenum UniformGLType<GLfloat>() { return GL_FLOAT; }
+template <> constexpr GLenum UniformGLType<GLint>() { return GL_INT; }
+template <> constexpr GLenum UniformGLType<glm::vec2>() { return GL_FLOAT_VEC2; }
+template <> constexpr GLenum UniformGLType<glm::vec3>() { return GL_FLOAT_VEC3; }
+template <> constexpr GLenum UniformGLType<glm::vec4>() { return GL_FLOAT_VEC4; }
+template <> constexpr GLenum UniformGLType<glm::mat3>() { return GL_FLOAT_MAT3; }
+template <> constexpr GLenum UniformGLType<glm::mat4>() { return GL_FLOAT_MAT4; }
+
+template <typename T>
+Uniform<T> PipelineGetUniform(const Pipeline& pipeline, const GLchar* name) {
+    Uniform<T> uniform;
+    uniform.mProgram = pipeline.mProgram;
+
+    auto it = pipeline.mUniforms.find(name);
+    if (it == pipeline.mUniforms.end()) {
+        std::cerr << "Uniform " << name << " is not active, maybe a misspelling" << std::endl;
+        return uniform;
+    }
+    if (it->second.mType != UniformGLType<T>()) {
+        std::cerr << "Uniform " << name << " does not match the requested type" << std::endl;
+        return uniform;
+    }
+
+    uniform.mProgram = it->second.mProgram;
+    uniform.mLocation = it->second.mLocation;
+    return uniform;
+}
+
+// Uniforms are written straight into the program object (glProgramUniform*),
+// so the program does not have to be bound with glUseProgram first
+void SetUniform(const Uniform<GLfloat>& uniform, GLfloat value);
+void SetUniform(const Uniform<GLint>& uniform, GLint value);
+void SetUniform(const Uniform<glm::vec2>& uniform, const glm::vec2& value);
+void SetUniform(const Uniform<glm::vec3>& uniform, const glm::vec3& value);
+void SetUniform(const Uniform<glm::vec4>& uniform, const glm::vec4& value);
+void SetUniform(const Uniform<glm::mat3>& uniform, const glm::mat3& value);
+void SetUniform(const Uniform<glm::mat4>& uniform, const glm::mat4& value);
+
+#endif
@@ -0,0 +1,63 @@
+#ifndef PIPELINEBUILDER_HPP
+#define PIPELINEBUILDER_HPP
+
+#include <glad/glad.h>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "Pipeline.hpp"
+#include "ProgramCache.hpp"
+#include "ProgramPipelines.hpp"
+#include "ResourceManager.hpp"
+
+enum class PipelineBuildState {
+    Compiling,
+    Linking,
+    Done
+};
+
+// One program on its way from source to a Pipeline
+struct PipelineBuild {
+    std::string mName;
+    uint64_t mCacheKey = 0;
+    GLuint mVertexShader = 0;
+    GLuint mFragmentShader = 0;
+    GLuint mProgram = 0;
+    PipelineBuildState mState = PipelineBuildState::Compiling;
+    // Overwritten with the finished pipeline, keep whatever they held until then.
+    // Identical submissions share one build and end up sharing the program.
+    std::vector<Pipeline*> mTargets;
+    // When the build was asked for, the logged time to ready starts here
+    std::chrono::steady_clock::time_point mRequestTime;
+};
+
+// Compiles and links programs without blocking the frame. Every compile is
+// issued as soon as the build is submitted; with KHR_parallel_shader_compile
+// the driver runs them on its own threads and Poll only looks at
+// GL_COMPLETION_STATUS. Without it, Poll advances one build per call, so the
+// stall is spread over several frames.
+struct PipelineBuilder {
+    ProgramCache* mCache = nullptr;
+    ResourceManager* mResources = nullptr;
+    bool mParallel = false;
+    // When set, programs are made of separable stages from this cache instead
+    // of being linked whole. Stages are compiled on submission, once each.
+    ProgramPipelineCache* mProgramPipelines = nullptr;
+    std::vector<PipelineBuild> mBuilds;
+    uint32_t mFailed = 0;
+};
+
+void CreatePipelineBuilder(PipelineBuilder* builder, ProgramCache* cache, ResourceManager* resources);
+void DestroyPipelineBuilder(PipelineBuilder* builder);
+// target keeps drawing with its current (fallback) pipeline until the build finishes
+void PipelineBuilderSubmit(PipelineBuilder* builder, const std::string& name, const std::string& vertexSource,
+                           const std::string& fragmentSource, Pipeline* target,
+                           std::chrono::steady_clock::time_point requestTime = std::chrono::steady_clock::now());
+// Returns the number of builds that finished during this call
+uint32_t PipelineBuilderPoll(PipelineBuilder* builder);
+// Blocks until every submitted build is done
+void PipelineBuilderFinish(PipelineBuilder* builder);
+bool PipelineBuilderIdle(const PipelineBuilder& builder);
+
+#endif
@@ -0,0 +1,77 @@
+#ifndef PROGRAMCACHE_HPP
+#define PROGRAMCACHE_HPP
+
+#include <glad/glad.h>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#define PROGRAM_CACHE_PATH "./program_cache.bin"
+
+// On-disk layout: header, then mEntryCount records, then the binaries the records point at
+const uint32_t PROGRAM_CACHE_MAGIC = 0x31434250; // "PBC1"
+const uint32_t PROGRAM_CACHE_VERSION = 1;
+
+struct ProgramCacheHeader {
+    uint32_t mMagic = PROGRAM_CACHE_MAGIC;
+    uint32_t mVersion = PROGRAM_CACHE_VERSION;
+    uint32_t mEntryCount = 0;
+    uint32_t mReserved = 0;
+};
+
+struct ProgramCacheRecord {
+    uint64_t mKey = 0;
+    uint32_t mFormat = 0;
+    // Byte offset of the binary from the start of the file
+    uint32_t mOffset = 0;
+    uint32_t mSize = 0;
+    uint32_t mReserved = 0;
+};
+
+struct ProgramCacheEntry {
+    GLenum mFormat = 0;
+    // Points into the mapped file, or into mOwned for binaries added this run
+    const unsigned char* mData = nullptr;
+    GLsizei mSize = 0;
+    std::vector<unsigned char> mOwned;
+    // Loaded or stored by a program that is still around, the pruning save drops the others
+    bool mUsed = false;
+};
+
+// Linked program binaries from glGetProgramBinary, keyed by a hash of the
+// shader sources, defines and the driver strings. Changing any of them
+// changes the key, so the program is compiled from source again.
+struct ProgramCache {
+    std::string mPath;
+    void* mMapped = nullptr;
+    size_t mMappedSize = 0;
+    // Vendor, renderer and version, part of every key
+    std::string mDriver;
+    // False when the driver offers no binary formats, everything compiles from source then
+    bool mSupported = false;
+    std::unordered_map<uint64_t, ProgramCacheEntry> mEntries;
+    bool mDirty = false;
+    uint32_t mHits = 0;
+    uint32_t mMisses = 0;
+};
+
+uint64_t HashString(const std::string& string, uint64_t seed = 14695981039346656037ull);
+
+// Maps path if it exists, needs a current GL context for the driver strings
+void LoadProgramCache(ProgramCache* cache, const std::string& path);
+void CloseProgramCache(ProgramCache* cache);
+uint64_t ProgramCacheKey(const ProgramCache& cache, const std::string& vertexSource,
+                         const std::string& fragmentSource, const std::string& defines);
+// Loads the binary into program, false on a miss or when the driver rejects it
+bool ProgramCacheLoad(ProgramCache* cache, uint64_t key, GLuint program);
+// Stores a linked program, it must have been linked with GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+void ProgramCacheStore(ProgramCache* cache, uint64_t key, GLuint program);
+// The program built from key was replaced, its entry is stale unless something loads it again
+void ProgramCacheRelease(ProgramCache* cache, uint64_t key);
+// Rewrites the cache file if anything changed. Pruning first drops the entries
+// nothing used this run, only do that once every program had its chance.
+void ProgramCacheSave(ProgramCache* cache, bool prune);
+
+#endif
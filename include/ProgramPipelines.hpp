@@ -0,0 +1,45 @@
+#ifndef PROGRAMPIPELINES_HPP
+#define PROGRAMPIPELINES_HPP
+
+#include <glad/glad.h>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+
+#include "Pipeline.hpp"
+#include "ResourceManager.hpp"
+
+// Separable stages (ARB_separate_shader_objects, core in 4.1). Every stage is
+// compiled and linked once on its own with glCreateShaderProgramv and only
+// combined at draw time through a program pipeline object, so N vertex and M
+// fragment shaders cost N + M links instead of N * M. The pipeline objects
+// are cached by the pair of stages they combine.
+struct ProgramPipelineEntry {
+    Pipeline mPipeline;
+    uint64_t mVertexKey = 0;
+    uint64_t mFragmentKey = 0;
+};
+
+struct ProgramPipelineCache {
+    ResourceManager* mResources = nullptr;
+    // Keyed by stage type and source hash. A stage that failed is kept with
+    // mProgram 0, so the same source is not compiled again.
+    std::unordered_map<uint64_t, Pipeline> mStages;
+    // Keyed by the pair of stage keys
+    std::unordered_map<uint64_t, ProgramPipelineEntry> mPipelines;
+    uint32_t mStageCompiles = 0;
+    uint32_t mStageHits = 0;
+};
+
+void CreateProgramPipelineCache(ProgramPipelineCache* cache, ResourceManager* resources);
+// Drops the cache's references, pipelines still used elsewhere stay alive
+void DestroyProgramPipelineCache(ProgramPipelineCache* cache);
+// Builds (or finds) the pipeline combining both stages. On success out holds
+// a reference of its own to the program pipeline, release it like any other.
+bool ProgramPipelineCacheGet(ProgramPipelineCache* cache, const std::string& vertexSource,
+                             const std::string& fragmentSource, Pipeline* out);
+// Releases the pipelines only the cache still references, then the stages
+// none of the remaining pipelines combine. Call after replacing a pipeline.
+void ProgramPipelineCachePrune(ProgramPipelineCache* cache);
+
+#endif
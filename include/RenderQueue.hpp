@@ -0,0 +1,68 @@
+#ifndef RENDERQUEUE_HPP
+#define RENDERQUEUE_HPP
+
+#include <cstdint>
+#include <vector>
+
+#include "App.hpp"
+#include "GpuProfiler.hpp"
+#include "Graphics.hpp"
+
+// Everything needed to issue one draw, plus the key it is sorted by
+struct DrawPacket {
+    uint64_t mSortKey = 0;
+    const Mesh3D* mMesh = nullptr;
+    // Drawn under conditional rendering on this query when set, after
+    // RenderQueue::mProxy ran it with the mProxyObject transform
+    GLuint mQuery = 0;
+    GLuint mProxyObject = 0;
+};
+
+// Counters of the last submitted frame
+struct RenderStats {
+    uint32_t mDrawCalls = 0;
+    uint64_t mTriangles = 0;
+    uint32_t mProgramBinds = 0;
+    uint32_t mVertexArrayBinds = 0;
+    uint32_t mPassChanges = 0;
+    // Binds skipped because the object was already bound
+    uint32_t mStateChangesAvoided = 0;
+    // Meshes drawn, outside the frustum, and inside but hidden by occluders
+    uint32_t mVisible = 0;
+    uint32_t mCulled = 0;
+    uint32_t mOccluded = 0;
+    // Occlusion queries issued, their draws count in mDrawCalls whether the GPU skips them or not
+    uint32_t mQueries = 0;
+    // Milliseconds spent waiting on ring buffer fences
+    double mFenceWait = 0.0;
+};
+
+struct RenderQueue {
+    std::vector<DrawPacket> mPackets;
+    // Ping-pong buffer for the radix sort
+    std::vector<DrawPacket> mScratch;
+    RenderStats mStats;
+    // Times every draw when set and its mDrawZones is on
+    GpuProfiler* mProfiler = nullptr;
+    // Bounding box drawn for packets with a query, with the pipeline of the packet's mesh
+    const Mesh3D* mProxy = nullptr;
+    GLenum mQueryTarget = GL_ANY_SAMPLES_PASSED;
+};
+
+// Sort key layout, most significant bits first:
+//   opaque:      pass(2) | kind(1) | pipeline(16) | vertex array(16) | depth(24) front-to-back | unused(5)
+//   transparent: pass(2) | depth(24) back-to-front | kind(1) | pipeline(16) | vertex array(16) | unused(5)
+// kind is set for program pipelines. Submission compares whole binding ids,
+// so names past 16 bits only cost sorting, never a skipped bind.
+uint64_t EncodeSortKey(RenderPass pass, uint64_t pipeline, GLuint vertexArray, float viewDepth);
+
+void RenderQueueClear(RenderQueue* queue);
+void RenderQueuePush(RenderQueue* queue, const Mesh3D* mesh, const glm::mat4& viewMatrix);
+// The proxies of every queried packet are drawn before anything else of the
+// queue, so the meshes that should hide them have to go through a queue submitted earlier
+void RenderQueuePushQueried(RenderQueue* queue, const Mesh3D* mesh, const glm::mat4& viewMatrix,
+                            GLuint query, GLuint proxyObject);
+void RenderQueueSort(RenderQueue* queue);
+void RenderQueueSubmit(RenderQueue* queue, const App& app);
+
+#endif
@@ -0,0 +1,73 @@
+#ifndef RESOURCEMANAGER_HPP
+#define RESOURCEMANAGER_HPP
+
+#include <glad/glad.h>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+enum class ResourceType : uint8_t {
+    Buffer,
+    VertexArray,
+    Program,
+    ProgramPipeline
+};
+
+// Index into ResourceManager::mSlots plus the generation it was issued for.
+// Once the resource is released the slot's generation moves on, so stale
+// handles are invalid instead of referring to whatever reuses the slot.
+struct ResourceHandle {
+    uint32_t mIndex = 0;
+    uint32_t mGeneration = 0; // 0 is never issued
+};
+
+struct ResourceSlot {
+    ResourceType mType = ResourceType::Buffer;
+    GLuint mName = 0;
+    uint32_t mGeneration = 1;
+    uint32_t mRefCount = 0;
+};
+
+// A released object waits here until the GPU is done with the frame it was released in
+struct PendingDeletion {
+    ResourceType mType = ResourceType::Buffer;
+    GLuint mName = 0;
+    uint64_t mFrame = 0;
+};
+
+struct FrameFence {
+    uint64_t mFrame = 0;
+    GLsync mFence = nullptr;
+};
+
+// Owns GL buffers, vertex arrays, programs and program pipelines. Objects are shared by
+// reference count and deleted once the last reference is gone and the
+// fence of the frame that dropped it has signalled, so nothing still
+// queued on the GPU is destroyed underneath it.
+struct ResourceManager {
+    std::vector<ResourceSlot> mSlots;
+    std::vector<uint32_t> mFreeSlots;
+    std::vector<PendingDeletion> mPendingDeletions;
+    std::deque<FrameFence> mFrameFences;
+    // Frame currently being recorded
+    uint64_t mFrame = 0;
+    // Every frame before this one has finished on the GPU
+    uint64_t mCompletedFrame = 0;
+    uint32_t mLiveCount = 0;
+    uint64_t mDeletedCount = 0;
+};
+
+void CreateResourceManager(ResourceManager* manager);
+// Waits for the GPU and deletes everything, including resources still referenced
+void DestroyResourceManager(ResourceManager* manager);
+// Takes ownership of name with a reference count of 1
+ResourceHandle ResourceManagerRegister(ResourceManager* manager, ResourceType type, GLuint name);
+bool ResourceManagerIsValid(const ResourceManager& manager, ResourceHandle handle);
+// References still held on handle, 0 once it is released or stale
+uint32_t ResourceManagerRefCount(const ResourceManager& manager, ResourceHandle handle);
+void ResourceManagerAddRef(ResourceManager* manager, ResourceHandle handle);
+void ResourceManagerRelease(ResourceManager* manager, ResourceHandle handle);
+// Fences the frame and deletes whatever the GPU has finished with, call once per frame
+void ResourceManagerEndFrame(ResourceManager* manager);
+
+#endif
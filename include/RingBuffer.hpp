@@ -0,0 +1,54 @@
+#ifndef RINGBUFFER_HPP
+#define RINGBUFFER_HPP
+
+#include <glad/glad.h>
+
+// Number of frames the CPU may run ahead of the GPU before it has to wait
+const GLuint RING_BUFFER_FRAMES = 3;
+
+// Streaming buffer for data that is rewritten every frame. The buffer is split
+// into one region per frame in flight; a frame only writes its own region and
+// a fence guards the region until the GPU is done reading it.
+//
+// With ARB_buffer_storage the buffer is mapped once, persistently and coherently.
+// Otherwise (plain 4.1) each region is mapped unsynchronized for the frame, and
+// the buffer storage is orphaned every time the ring wraps around.
+struct RingBuffer {
+    GLuint mBuffer = 0;
+    bool mPersistent = false;
+    // Bytes one frame may use, the buffer holds RING_BUFFER_FRAMES of these
+    GLsizeiptr mFrameCapacity = 0;
+    GLuint mFrameIndex = 0;
+    // Start of the current frame's region in the buffer
+    GLintptr mFrameOffset = 0;
+    // Bytes used in the current frame's region
+    GLsizeiptr mHead = 0;
+    // Whole buffer when persistent, current region only otherwise
+    unsigned char* mMapped = nullptr;
+    GLsync mFences[RING_BUFFER_FRAMES] = {};
+
+    // Time spent in glClientWaitSync, in milliseconds
+    double mLastFenceWait = 0.0;
+    double mTotalFenceWait = 0.0;
+    GLuint mFrameCount = 0;
+};
+
+// A piece of the current frame's region. mData is only valid until the next
+// allocation, since the ring may grow. mOffset is relative to the region and
+// stays valid for the whole frame; bind at RingBuffer::mFrameOffset + mOffset.
+struct RingAllocation {
+    void* mData = nullptr;
+    GLintptr mOffset = 0;
+};
+
+void CreateRingBuffer(RingBuffer* ring, GLsizeiptr frameCapacity);
+void DestroyRingBuffer(RingBuffer* ring);
+// Waits until the GPU released this frame's region
+void RingBufferBeginFrame(RingBuffer* ring);
+RingAllocation RingBufferAllocate(RingBuffer* ring, GLsizeiptr size, GLsizeiptr alignment);
+// Must be called after the last allocation and before any draw reads the data
+void RingBufferFinishWrites(RingBuffer* ring);
+// Fences the region after the last draw that reads it
+void RingBufferEndFrame(RingBuffer* ring);
+
+#endif
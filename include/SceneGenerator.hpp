@@ -0,0 +1,57 @@
+#ifndef SCENEGENERATOR_HPP
+#define SCENEGENERATOR_HPP
+
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "MeshData.hpp"
+
+// How generated objects are spread over the volume in front of the camera
+enum class SceneLayout {
+    // Regular 3D grid, every object the same size
+    Grid,
+    // Uniformly random positions and sizes
+    Cloud,
+    // Blocks of stacked "buildings" on a ground plane, separated by streets
+    City
+};
+
+struct SceneGeneratorOptions {
+    uint32_t mObjectCount = 1000;
+    SceneLayout mLayout = SceneLayout::Grid;
+    // Share of the objects that spin every frame, the rest never move
+    float mAnimatedFraction = 0.1f;
+    // Objects pick from a cube, a tetrahedron and a sphere at every level in this range
+    uint32_t mMinSubdivision = 1;
+    uint32_t mMaxSubdivision = 3;
+    // Same seed, same scene
+    uint32_t mSeed = 1;
+};
+
+// Highest sphere subdivision the generator accepts, level 7 is already 64k triangles
+const uint32_t SCENE_MAX_SUBDIVISION = 7;
+
+struct SceneObject {
+    // Index into GeneratedScene::mMeshes
+    uint32_t mMesh = 0;
+    glm::mat4 mModelMatrix{ glm::mat4(1.0f) };
+    glm::vec4 mColor{ glm::vec4(1.0f) };
+};
+
+// Plain data, the renderers decide how to draw it
+struct GeneratedScene {
+    // Filled once by GenerateScene and never resized afterwards, renderers
+    // key their batches on the addresses of these
+    std::vector<MeshData> mMeshes;
+    std::vector<SceneObject> mObjects;
+    // The first mAnimatedCount objects are the animated ones
+    uint32_t mAnimatedCount = 0;
+};
+
+// "grid", "cloud" or "city", false for anything else
+bool ParseSceneLayout(const std::string& name, SceneLayout* layout);
+void GenerateScene(GeneratedScene* scene, const SceneGeneratorOptions& options);
+
+#endif
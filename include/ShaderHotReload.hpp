@@ -0,0 +1,49 @@
+#ifndef SHADERHOTRELOAD_HPP
+#define SHADERHOTRELOAD_HPP
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "Pipeline.hpp"
+#include "PipelineBuilder.hpp"
+#include "ShaderPreprocessor.hpp"
+
+// A pipeline rebuilt whenever one of its source files changes
+struct WatchedProgram {
+    std::string mName;
+    std::string mVertexPath;
+    ShaderDefines mVertexDefines;
+    std::string mFragmentPath;
+    ShaderDefines mFragmentDefines;
+    Pipeline* mTarget = nullptr;
+};
+
+// Watches a shader directory with inotify on a background thread. Changed
+// programs are resubmitted to the PipelineBuilder, which swaps them in at the
+// start of a frame once they link, so a broken edit keeps the old program.
+// Only available on Linux, elsewhere starting it just prints a message.
+struct ShaderHotReload {
+    std::string mDirectory;
+    std::thread mThread;
+    std::atomic<bool> mRunning{ false };
+    int mInotify = -1;
+    // Paths changed since the last update, with the time the change was seen
+    std::mutex mMutex;
+    std::unordered_map<std::string, std::chrono::steady_clock::time_point> mChanged;
+    std::vector<WatchedProgram> mPrograms;
+};
+
+void ShaderHotReloadWatch(ShaderHotReload* reload, const std::string& name,
+                          const std::string& vertexPath, const ShaderDefines& vertexDefines,
+                          const std::string& fragmentPath, const ShaderDefines& fragmentDefines, Pipeline* target);
+void StartShaderHotReload(ShaderHotReload* reload, const std::string& directory);
+void StopShaderHotReload(ShaderHotReload* reload);
+// Submits rebuilds for changed programs, call once per frame on the GL thread
+void ShaderHotReloadUpdate(ShaderHotReload* reload, ShaderLibrary* library, PipelineBuilder* builder);
+
+#endif
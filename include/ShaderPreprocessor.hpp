@@ -0,0 +1,51 @@
+#ifndef SHADERPREPROCESSOR_HPP
+#define SHADERPREPROCESSOR_HPP
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "GeometryPool.hpp"
+
+// Permutation keys and baked constants, injected as #define NAME VALUE.
+// Sorted, so the same set always produces the same source text.
+typedef std::map<std::string, std::string> ShaderDefines;
+
+// Defines for the permutation axes every shader understands
+ShaderDefines PermutationDefines(bool instancing, VertexFormat format);
+
+struct PreprocessedShader {
+    std::string mSource;
+    // Root file first, then every file it includes, for hot reload
+    std::vector<std::string> mFiles;
+    // Hash of mSource, permutations with the same hash are the same shader
+    uint64_t mHash = 0;
+    bool mValid = false;
+};
+
+// Expands #include "file" (relative to the including file, each file once) and
+// inserts the defines right after #version. Only defines whose name appears in
+// the expanded source are inserted, so permutations that differ in keys a
+// shader ignores produce identical text. #line directives keep compiler
+// messages pointing at the original file, the source string number being the
+// index into mFiles.
+PreprocessedShader PreprocessShader(const std::string& path, const ShaderDefines& defines);
+
+// Permutations are only preprocessed when first requested, nothing is built up front
+struct ShaderLibrary {
+    // Keyed by a hash of path and defines
+    std::unordered_map<uint64_t, PreprocessedShader> mPermutations;
+    uint32_t mRequests = 0;
+    // Requests that resolved to a source text some other permutation already has
+    uint32_t mDuplicates = 0;
+    std::unordered_map<uint64_t, uint32_t> mSourceUsers;
+};
+
+const PreprocessedShader& ShaderLibraryGet(ShaderLibrary* library, const std::string& path,
+                                           const ShaderDefines& defines);
+// Forgets every permutation that includes file, they are preprocessed again on the next request
+void ShaderLibraryInvalidate(ShaderLibrary* library, const std::string& file);
+
+#endif
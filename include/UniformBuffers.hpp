@@ -0,0 +1,56 @@
+#ifndef UNIFORMBUFFERS_HPP
+#define UNIFORMBUFFERS_HPP
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <vector>
+
+#include "Camera.hpp"
+#include "RingBuffer.hpp"
+
+// Uniform block names and the fixed binding points every pipeline uses for them
+#define PER_FRAME_BLOCK_NAME "PerFrame"
+#define PER_OBJECT_BLOCK_NAME "PerObject"
+const GLuint PER_FRAME_BINDING = 0;
+const GLuint PER_OBJECT_BINDING = 1;
+
+// Mirrors the std140 layout of the PerFrame block in shaders/uniforms.glsl
+struct PerFrameData {
+    glm::mat4 mViewMatrix;
+    glm::mat4 mProjectionMatrix;
+    glm::mat4 mViewProjectionMatrix;
+    glm::vec4 mCameraPosition;
+    GLfloat mTime;
+    GLfloat mPadding[3];
+};
+
+// Mirrors the std140 layout of the PerObject block in shaders/uniforms.glsl
+struct PerObjectData {
+    glm::mat4 mModelMatrix;
+};
+
+struct FrameUniforms {
+    // Both blocks are streamed through one ring buffer
+    RingBuffer mRing;
+    GLint mAlignment = 256;
+    GLintptr mPerFrameOffset = 0;
+    // All objects of the frame are packed into one range, each at an offset
+    // that satisfies GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, and selected per draw
+    // with glBindBufferRange
+    GLintptr mPerObjectOffset = 0;
+    GLsizeiptr mPerObjectStride = 0;
+    std::vector<unsigned char> mPerObjectStaging;
+    GLuint mObjectCount = 0;
+};
+
+void CreateFrameUniforms(FrameUniforms* frameUniforms);
+void DestroyFrameUniforms(FrameUniforms* frameUniforms);
+void FrameUniformsBegin(FrameUniforms* frameUniforms, const Camera& camera, float time);
+GLuint FrameUniformsPushObject(FrameUniforms* frameUniforms, const glm::mat4& modelMatrix);
+// Writes the objects and binds the PerFrame block, call before drawing
+void FrameUniformsUploadObjects(FrameUniforms* frameUniforms);
+void FrameUniformsBindObject(const FrameUniforms& frameUniforms, GLuint objectIndex);
+// Call after the last draw of the frame
+void FrameUniformsEnd(FrameUniforms* frameUniforms);
+
+#endif
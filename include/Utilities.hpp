@@ -3,12 +3,29 @@
 
 #include <glad/glad.h>
 #include <glm/glm.hpp>
+#include <cstdint>
 #include <iostream>
 #include <fstream>
+#include <vector>
+
+// Summary of a set of timings in milliseconds, percentiles are nearest-rank
+struct TimingStats {
+    double mMean = 0.0;
+    double mP50 = 0.0;
+    double mP95 = 0.0;
+    double mP99 = 0.0;
+    double mMax = 0.0;
+    uint32_t mSamples = 0;
+};
 
 static void GLCLearAllErrors();
 static bool GLChekErrorStatus(const char* function, int line);
 void GetOpenGLVersionInfo();
 std::string LoadShaderAsString(const std::string& filename);
+TimingStats ComputeTimingStats(std::vector<double> samples);
+// Saves the bound read framebuffer as a binary PPM, top row first
+bool WriteFramebufferPPM(const std::string& path, int width, int height);
+// Writes string as a quoted JSON string, escaped
+void WriteJsonString(std::ostream& out, const char* string);
 
 #endif
@@ -0,0 +1,134 @@
+#version 430 core
+
+// One thread per object: frustum and Hi-Z test, then the survivors are
+// appended to their draw's instance range and counted in its command
+layout(local_size_x = 64) in;
+
+struct Instance {
+    mat4 modelMatrix;
+    vec4 color;
+};
+
+// Same layout as DrawElementsIndirectCommand
+struct Command {
+    uint count;
+    uint instanceCount;
+    uint firstIndex;
+    int baseVertex;
+    uint baseInstance;
+};
+
+layout(std430, binding = 0) readonly buffer Objects {
+    Instance objects[];
+};
+layout(std430, binding = 1) readonly buffer ObjectDraws {
+    uint objectDraws[];
+};
+// Local bounding sphere of every draw's geometry
+layout(std430, binding = 2) readonly buffer DrawSpheres {
+    vec4 drawSpheres[];
+};
+layout(std430, binding = 3) buffer Commands {
+    Command commands[];
+};
+layout(std430, binding = 4) writeonly buffer Visible {
+    Instance visible[];
+};
+// Objects outside the frustum, and inside but hidden
+layout(std430, binding = 5) buffer Counters {
+    uint culled;
+    uint occluded;
+};
+
+layout(binding = 0) uniform sampler2D u_HiZ;
+
+uniform int u_ObjectCount;
+// Normals point inwards, normalized
+uniform vec4 u_Planes[6];
+// Levels of u_HiZ, 0 until there is a previous frame to test against
+uniform int u_HiZLevels;
+// Camera the depth in u_HiZ was drawn with
+uniform mat4 u_HiZViewProjection;
+uniform vec2 u_ScreenSize;
+
+bool InsideFrustum(vec3 center, float radius) {
+    for (int i = 0; i < 6; ++i) {
+        if (dot(u_Planes[i].xyz, center) + u_Planes[i].w < -radius) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool Occluded(vec3 center, float radius) {
+    if (u_HiZLevels == 0) {
+        return false;
+    }
+
+    // Screen rectangle and nearest depth of the box around the sphere
+    vec2 minScreen = vec2(1.0f);
+    vec2 maxScreen = vec2(-1.0f);
+    float nearest = 1.0f;
+    for (int i = 0; i < 8; ++i) {
+        vec3 corner = center + radius * vec3((i & 1) != 0 ? 1.0f : -1.0f, (i & 2) != 0 ? 1.0f : -1.0f,
+                                             (i & 4) != 0 ? 1.0f : -1.0f);
+        vec4 clip = u_HiZViewProjection * vec4(corner, 1.0f);
+        // Reaches behind the camera, the rectangle would be meaningless
+        if (clip.w <= 1e-5f) {
+            return false;
+        }
+        vec3 ndc = clip.xyz / clip.w;
+        minScreen = min(minScreen, ndc.xy);
+        maxScreen = max(maxScreen, ndc.xy);
+        nearest = min(nearest, ndc.z * 0.5f + 0.5f);
+    }
+    // Whatever reaches past the old screen has no depth to test against
+    if (any(lessThan(minScreen, vec2(-1.0f))) || any(greaterThan(maxScreen, vec2(1.0f)))) {
+        return false;
+    }
+    minScreen = (minScreen * 0.5f + 0.5f) * u_ScreenSize;
+    maxScreen = (maxScreen * 0.5f + 0.5f) * u_ScreenSize;
+    ivec2 minPixel = min(ivec2(minScreen), ivec2(u_ScreenSize) - ivec2(1));
+    ivec2 maxPixel = min(ivec2(maxScreen), ivec2(u_ScreenSize) - ivec2(1));
+
+    // A level-k texel spans 2^(k+1) pixels, pick the first level where the
+    // rectangle covers at most 2x2 texels
+    int extent = max(maxPixel.x - minPixel.x, maxPixel.y - minPixel.y) + 1;
+    int level = clamp(int(ceil(log2(float(extent)))) - 1, 0, u_HiZLevels - 1);
+    // Same rounding as the mip chain, and unlike textureSize fine with a level
+    // that differs from object to object
+    ivec2 levelSize = max(ivec2(u_ScreenSize) >> (level + 1), ivec2(1));
+    // The last texel of a level also covers the pixels the rounding left over
+    ivec2 minTexel = min(minPixel >> (level + 1), levelSize - ivec2(1));
+    ivec2 maxTexel = min(maxPixel >> (level + 1), levelSize - ivec2(1));
+
+    float farthest = max(texelFetch(u_HiZ, minTexel, level).r, texelFetch(u_HiZ, maxTexel, level).r);
+    farthest = max(farthest, texelFetch(u_HiZ, ivec2(maxTexel.x, minTexel.y), level).r);
+    farthest = max(farthest, texelFetch(u_HiZ, ivec2(minTexel.x, maxTexel.y), level).r);
+    return nearest > farthest;
+}
+
+void main() {
+    uint object = gl_GlobalInvocationID.x;
+    if (object >= uint(u_ObjectCount)) {
+        return;
+    }
+
+    uint draw = objectDraws[object];
+    mat4 model = objects[object].modelMatrix;
+    vec4 sphere = drawSpheres[draw];
+    vec3 center = (model * vec4(sphere.xyz, 1.0f)).xyz;
+    // Non-uniform scales stretch the sphere, the largest axis still covers it
+    float radius = sphere.w * max(length(model[0].xyz), max(length(model[1].xyz), length(model[2].xyz)));
+
+    if (!InsideFrustum(center, radius)) {
+        atomicAdd(culled, 1u);
+        return;
+    }
+    if (Occluded(center, radius)) {
+        atomicAdd(occluded, 1u);
+        return;
+    }
+    uint slot = atomicAdd(commands[draw].instanceCount, 1u);
+    visible[commands[draw].baseInstance + slot] = objects[object];
+}
@@ -0,0 +1,38 @@
+#version 430 core
+
+// One level of the Hi-Z pyramid: every texel is the farthest depth of the
+// 2x2 texels below it, level 0 reads the depth buffer itself
+layout(local_size_x = 8, local_size_y = 8) in;
+
+layout(binding = 0) uniform sampler2D u_Source;
+layout(r32f, binding = 0) uniform writeonly image2D u_Destination;
+uniform int u_SourceLevel;
+
+void main() {
+    ivec2 size = imageSize(u_Destination);
+    ivec2 texel = ivec2(gl_GlobalInvocationID.xy);
+    if (texel.x >= size.x || texel.y >= size.y) {
+        return;
+    }
+
+    // Levels are rounded down, so the last texel of an odd row or column
+    // also takes the one left over, and no depth is ever skipped
+    ivec2 sourceSize = textureSize(u_Source, u_SourceLevel);
+    ivec2 first = texel * 2;
+    ivec2 last = first + ivec2(1);
+    if (texel.x == size.x - 1 && (sourceSize.x & 1) != 0) {
+        last.x++;
+    }
+    if (texel.y == size.y - 1 && (sourceSize.y & 1) != 0) {
+        last.y++;
+    }
+    last = min(last, sourceSize - ivec2(1));
+
+    float depth = 0.0f;
+    for (int y = first.y; y <= last.y; ++y) {
+        for (int x = first.x; x <= last.x; ++x) {
+            depth = max(depth, texelFetch(u_Source, ivec2(x, y), u_SourceLevel).r);
+        }
+    }
+    imageStore(u_Destination, texel, vec4(depth));
+}
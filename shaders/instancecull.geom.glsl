@@ -0,0 +1,22 @@
+#version 410 core
+
+// Passes the indices of the instances that survived the vertex stage on to
+// transform feedback, packed one after another in the index buffer
+layout(points) in;
+layout(points, max_vertices = 1) out;
+
+in Instance {
+    flat int index;
+    flat int visible;
+} v_Instance[];
+
+flat out int g_Index;
+
+void main() {
+    if (v_Instance[0].visible == 0) {
+        return;
+    }
+    g_Index = v_Instance[0].index;
+    EmitVertex();
+    EndPrimitive();
+}
@@ -0,0 +1,35 @@
+#version 410 core
+
+// One point per instance, nothing is rasterized. The frustum test happens
+// here, shaders/instancecull.geom.glsl only drops what failed it.
+
+// Same layout as InstanceData, advanced per vertex here
+layout(location=0) in mat4 modelMatrix;
+layout(location=4) in vec4 color;
+
+// Local bounding sphere of the group's geometry, center in xyz and radius in w
+uniform vec4 u_Sphere;
+// Normals point inwards, normalized
+uniform vec4 u_Planes[6];
+
+out Instance {
+    flat int index;
+    flat int visible;
+} v_Instance;
+
+void main() {
+    vec3 center = (modelMatrix * vec4(u_Sphere.xyz, 1.0f)).xyz;
+    // Non-uniform scales stretch the sphere, the largest axis still covers it
+    float radius = u_Sphere.w * max(length(modelMatrix[0].xyz),
+                                    max(length(modelMatrix[1].xyz), length(modelMatrix[2].xyz)));
+
+    int visible = 1;
+    for (int i = 0; i < 6; ++i) {
+        if (dot(u_Planes[i].xyz, center) + u_Planes[i].w < -radius) {
+            visible = 0;
+        }
+    }
+
+    v_Instance.index = gl_VertexID;
+    v_Instance.visible = visible;
+}
@@ -0,0 +1,20 @@
+#version 410 core
+
+// One point per index captured by shaders/instancecull.geom.glsl, nothing is
+// rasterized. Copies that instance's current InstanceData out, so survivors
+// are drawn where they are now and not where they were when culled.
+
+// Survivor indices, and the group's instance buffer as five texels per InstanceData
+uniform isamplerBuffer u_Indices;
+uniform samplerBuffer u_Instances;
+
+// Captured interleaved, in this order they make up an InstanceData
+out mat4 g_ModelMatrix;
+out vec4 g_Color;
+
+void main() {
+    int texel = texelFetch(u_Indices, gl_VertexID).r * 5;
+    g_ModelMatrix = mat4(texelFetch(u_Instances, texel + 0), texelFetch(u_Instances, texel + 1),
+                         texelFetch(u_Instances, texel + 2), texelFetch(u_Instances, texel + 3));
+    g_Color = texelFetch(u_Instances, texel + 4);
+}
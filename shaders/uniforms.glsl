@@ -0,0 +1,17 @@
+// Uniform blocks shared by every pipeline, mirrored by UniformBuffers.hpp
+
+// Per-frame data, written once per frame (binding point 0)
+layout(std140) uniform PerFrame {
+    mat4 u_ViewMatrix;
+    mat4 u_Perspective;
+    mat4 u_ViewProjection;
+    vec4 u_CameraPosition;
+    float u_Time;
+};
+
+#if !INSTANCING
+// Per-object data (binding point 1), instanced draws read the model matrix from an attribute
+layout(std140) uniform PerObject {
+    mat4 u_ModelMatrix;
+};
+#endif
@@ -1,19 +1,33 @@
 #version 410 core
 
-// Uniform variables
-uniform mat4 u_ModelMatrix;
-uniform mat4 u_Perspective;
-uniform mat4 u_ViewMatrix;
+#include "uniforms.glsl"
 
 layout(location=0) in vec3 position;
 layout(location=1) in vec3 vertexColors;
 
+#if INSTANCING
+// Per-instance data (attribute divisor 1)
+layout(location=2) in mat4 instanceModelMatrix;
+layout(location=6) in vec4 instanceColor;
+#endif
+
 out vec3 v_vertexColors;
 
+// Has to be redeclared for the stage to be used as a separable program
+out gl_PerVertex {
+    vec4 gl_Position;
+};
+
 void main() {
+#if INSTANCING
+    v_vertexColors = vertexColors * instanceColor.rgb;
+
+    gl_Position = u_ViewProjection * instanceModelMatrix * vec4(position, 1.0f);
+#else
     v_vertexColors = vertexColors;
 
-    vec4 newPosition = u_Perspective * u_ViewMatrix *  u_ModelMatrix * vec4(position, 1.0f); 
+    vec4 newPosition = u_ViewProjection * u_ModelMatrix * vec4(position, 1.0f);
 
     gl_Position = vec4(newPosition.x, newPosition.y, newPosition.z, newPosition.w);
+#endif
 }
@@ -1,8 +1,19 @@
 #include "App.hpp"
+#include "CpuProfiler.hpp"
 #include <iostream>
 #include <cstdlib>
 
 void InitializeProgram(App* app) {
+    PROFILE_FUNCTION();
+    if (app->mHeadless) {
+        if (!CreateHeadlessContext(&app->mHeadlessContext, app->mScreenWidth, app->mScreenHeight)) {
+            std::cout << "Headless OpenGL context not available" << std::endl;
+            exit(1);
+        }
+        CreateResourceManager(&app->mResources);
+        return;
+    }
+
     if (SDL_Init(SDL_INIT_VIDEO) < 0) {
         std::cout << "SDL2 could not be initialized video subsystem" << std::endl;
         exit(1);
@@ -39,9 +50,35 @@ void InitializeProgram(App* app) {
         std::cout << "glad was not initialized" << std::endl;
         exit(1);
     }
+
+    CreateResourceManager(&app->mResources);
+}
+
+void PresentFrame(App& app) {
+    if (!app.mHeadless) {
+        SDL_GL_SwapWindow(app.mGraphicsApplicationWindow);
+    }
 }
 
 void CleanUp(App& app) {
+    StopShaderHotReload(&app.mShaderHotReload);
+    DestroyFrameUniforms(&app.mFrameUniforms);
+    DestroyGeometryPool(&app.mGeometryPool);
+    ResourceManagerRelease(&app.mResources, app.mGraphicsPipeline.mHandle);
+    ResourceManagerRelease(&app.mResources, app.mInstancedPipeline.mHandle);
+    ResourceManagerRelease(&app.mResources, app.mFallbackPipeline.mHandle);
+    ResourceManagerRelease(&app.mResources, app.mFallbackInstancedPipeline.mHandle);
+    DestroyPipelineBuilder(&app.mPipelineBuilder);
+    DestroyProgramPipelineCache(&app.mProgramPipelines);
+    DestroyGpuProfiler(&app.mGpuProfiler);
+    DestroyResourceManager(&app.mResources);
+    // Every program had its chance by now, what none of them used is stale
+    ProgramCacheSave(&app.mProgramCache, true);
+    CloseProgramCache(&app.mProgramCache);
+    if (app.mHeadless) {
+        DestroyHeadlessContext(&app.mHeadlessContext);
+        return;
+    }
     SDL_DestroyWindow(app.mGraphicsApplicationWindow);
     SDL_Quit();
 }
@@ -0,0 +1,366 @@
+#include "Benchmark.hpp"
+#include "Bvh.hpp"
+#include "Culling.hpp"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+
+CameraPath DefaultCameraPath() {
+    CameraPath path;
+    path.mPoints = {
+        { glm::vec3( 0.0f,  0.0f,  0.5f), glm::vec3( 0.0f, 0.0f, -2.0f) },
+        { glm::vec3( 1.5f,  0.6f, -0.5f), glm::vec3( 0.0f, 0.0f, -3.0f) },
+        { glm::vec3( 0.0f,  1.2f, -1.0f), glm::vec3( 0.0f, 0.0f, -4.0f) },
+        { glm::vec3(-1.5f,  0.3f, -0.5f), glm::vec3( 0.0f, 0.0f, -3.0f) },
+        { glm::vec3(-0.5f, -0.8f,  0.0f), glm::vec3( 0.5f, 0.0f, -2.5f) },
+    };
+    return path;
+}
+
+static glm::vec3 CatmullRom(const glm::vec3& p0, const glm::vec3& p1, const glm::vec3& p2, const glm::vec3& p3,
+                            float u) {
+    float u2 = u * u;
+    float u3 = u2 * u;
+    return 0.5f * ((2.0f * p1) + (p2 - p0) * u + (2.0f * p0 - 5.0f * p1 + 4.0f * p2 - p3) * u2 +
+                   (3.0f * p1 - p0 - 3.0f * p2 + p3) * u3);
+}
+
+void CameraPathEvaluate(const CameraPath& path, float t, glm::vec3* eye, glm::vec3* target) {
+    size_t count = path.mPoints.size();
+    float position = (t - std::floor(t)) * count;
+    size_t segment = (size_t)position % count;
+    float u = position - std::floor(position);
+
+    const CameraPathPoint& p0 = path.mPoints[(segment + count - 1) % count];
+    const CameraPathPoint& p1 = path.mPoints[segment];
+    const CameraPathPoint& p2 = path.mPoints[(segment + 1) % count];
+    const CameraPathPoint& p3 = path.mPoints[(segment + 2) % count];
+    *eye = CatmullRom(p0.mEye, p1.mEye, p2.mEye, p3.mEye, u);
+    *target = CatmullRom(p0.mTarget, p1.mTarget, p2.mTarget, p3.mTarget, u);
+}
+
+void CreateBenchmark(Benchmark* benchmark, const BenchmarkOptions& options, GpuProfiler* profiler) {
+    *benchmark = Benchmark();
+    benchmark->mOptions = options;
+    benchmark->mPath = DefaultCameraPath();
+    benchmark->mCpuFrameTimes.reserve(options.mMeasuredFrames);
+
+    // GPU frame times come from the profiler's "Frame" zone, every measured frame is kept
+    profiler->mEnabled = true;
+    profiler->mWindow = options.mMeasuredFrames > 0 ? options.mMeasuredFrames : 1;
+}
+
+float BenchmarkBeginFrame(Benchmark* benchmark, Camera* camera) {
+    // Warm-up and measured frames together go once around the path
+    uint32_t totalFrames = BenchmarkFrameCount(*benchmark);
+    float t = totalFrames > 0 ? (float)benchmark->mFrame / totalFrames : 0.0f;
+
+    glm::vec3 eye, target;
+    CameraPathEvaluate(benchmark->mPath, t, &eye, &target);
+    camera->LookAt(eye, target);
+
+    // As if running at a steady 60 fps
+    return benchmark->mFrame / 60.0f;
+}
+
+uint32_t BenchmarkFrameCount(const Benchmark& benchmark) {
+    return benchmark.mOptions.mWarmupFrames + benchmark.mOptions.mMeasuredFrames;
+}
+
+void BenchmarkEndFrame(Benchmark* benchmark, GpuProfiler* profiler, double cpuFrameTime, const RenderStats& stats) {
+    const BenchmarkOptions& options = benchmark->mOptions;
+    if (benchmark->mFrame >= options.mWarmupFrames) {
+        benchmark->mCpuFrameTimes.push_back(cpuFrameTime);
+        benchmark->mDrawCalls += stats.mDrawCalls;
+        benchmark->mTriangles += stats.mTriangles;
+        benchmark->mVisible += stats.mVisible;
+        benchmark->mCulled += stats.mCulled;
+        benchmark->mOccluded += stats.mOccluded;
+        benchmark->mQueries += stats.mQueries;
+    }
+    benchmark->mFrame++;
+
+    if (benchmark->mFrame == options.mWarmupFrames) {
+        // Outside the measured range, waiting here is fine
+        GpuProfilerFlush(profiler);
+        GpuProfilerReset(profiler);
+    }
+}
+
+static void WriteStats(std::ostream& out, const char* name, const TimingStats& stats) {
+    out << "  \"" << name << "\": {\"mean\": " << stats.mMean << ", \"p50\": " << stats.mP50 <<
+           ", \"p95\": " << stats.mP95 << ", \"p99\": " << stats.mP99 << ", \"max\": " << stats.mMax <<
+           ", \"samples\": " << stats.mSamples << "}";
+}
+
+bool BenchmarkWriteResults(const Benchmark& benchmark, GpuProfiler* profiler) {
+    const BenchmarkOptions& options = benchmark.mOptions;
+    GpuProfilerFlush(profiler);
+
+    TimingStats cpu = ComputeTimingStats(benchmark.mCpuFrameTimes);
+    TimingStats gpu;
+    GpuProfilerGetStats(*profiler, "Frame", &gpu);
+    uint32_t frames = cpu.mSamples > 0 ? cpu.mSamples : 1;
+
+    std::ofstream file(options.mOutputPath.c_str());
+    if (!file.is_open()) {
+        std::cout << "Could not write " << options.mOutputPath << std::endl;
+        return false;
+    }
+    file << "{\n";
+    file << "  \"scene\": ";
+    WriteJsonString(file, options.mScene.c_str());
+    file << ",\n";
+    file << "  \"warmupFrames\": " << options.mWarmupFrames << ",\n";
+    file << "  \"measuredFrames\": " << options.mMeasuredFrames << ",\n";
+    file << "  \"finish\": " << (options.mFinish ? "true" : "false") << ",\n";
+    WriteStats(file, "cpuFrameMs", cpu);
+    file << ",\n";
+    WriteStats(file, "gpuFrameMs", gpu);
+    file << ",\n";
+    file << "  \"gpuFramesDropped\": " << profiler->mDroppedFrames << ",\n";
+    file << "  \"drawCallsPerFrame\": " << benchmark.mDrawCalls / frames << ",\n";
+    file << "  \"trianglesPerFrame\": " << benchmark.mTriangles / frames << ",\n";
+    file << "  \"visiblePerFrame\": " << benchmark.mVisible / frames << ",\n";
+    file << "  \"culledPerFrame\": " << benchmark.mCulled / frames << ",\n";
+    file << "  \"occludedPerFrame\": " << benchmark.mOccluded / frames << ",\n";
+    file << "  \"queriesPerFrame\": " << benchmark.mQueries / frames << "\n";
+    file << "}\n";
+
+    std::cout << "Benchmark " << options.mScene << ": CPU mean " << cpu.mMean << " ms, p99 " << cpu.mP99 <<
+                 " ms; GPU mean " << gpu.mMean << " ms, p99 " << gpu.mP99 << " ms. Written to " <<
+                 options.mOutputPath << std::endl;
+    return true;
+}
+
+// Only reads files written by BenchmarkWriteResults, so a key lookup is enough.
+// Groups start a line, which no escaped string value can contain.
+static bool ReadMetric(const std::string& json, const std::string& group, const std::string& key, double* value) {
+    size_t start = json.find("\n  \"" + group + "\"");
+    if (start == std::string::npos) {
+        return false;
+    }
+    size_t end = json.find('}', start);
+    size_t found = json.find("\"" + key + "\":", start);
+    if (found == std::string::npos || found > end) {
+        return false;
+    }
+    std::istringstream stream(json.substr(found + key.size() + 3));
+    return (bool)(stream >> *value);
+}
+
+static bool ReadFile(const std::string& path, std::string* contents) {
+    std::ifstream file(path.c_str());
+    if (!file.is_open()) {
+        std::cout << "Could not read " << path << std::endl;
+        return false;
+    }
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+    *contents = buffer.str();
+    return true;
+}
+
+int CompareBenchmarks(const std::string& baselinePath, const std::string& currentPath, double thresholdPercent) {
+    std::string baseline, current;
+    if (!ReadFile(baselinePath, &baseline) || !ReadFile(currentPath, &current)) {
+        return -1;
+    }
+
+    const char* groups[] = { "cpuFrameMs", "gpuFrameMs" };
+    const char* keys[] = { "mean", "p50", "p95", "p99", "max" };
+    int regressions = 0;
+    for (const char* group : groups) {
+        for (const char* key : keys) {
+            double before = 0.0, after = 0.0;
+            if (!ReadMetric(baseline, group, key, &before) || !ReadMetric(current, group, key, &after)) {
+                continue;
+            }
+            double change = before > 0.0 ? (after - before) / before * 100.0 : 0.0;
+            bool regressed = change > thresholdPercent;
+            regressions += regressed ? 1 : 0;
+            std::cout << group << "." << key << ": " << before << " -> " << after << " ms (" <<
+                         (change >= 0.0 ? "+" : "") << change << "%)" << (regressed ? "  REGRESSION" : "") << std::endl;
+        }
+    }
+    std::cout << regressions << " regressions beyond " << thresholdPercent << "%" << std::endl;
+    return regressions;
+}
+
+static double MillisecondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void RunBvhBenchmark(const SceneGeneratorOptions& options) {
+    GeneratedScene scene;
+    GenerateScene(&scene, options);
+    uint32_t count = (uint32_t)scene.mObjects.size();
+    if (count == 0) {
+        std::cout << "Nothing to benchmark" << std::endl;
+        return;
+    }
+
+    std::vector<glm::vec4> meshSpheres;
+    for (const MeshData& meshData : scene.mMeshes) {
+        meshSpheres.push_back(MeshDataBoundingSphere(meshData));
+    }
+    // Spheres for the flat culler, boxes around them for the BVH
+    FrustumCuller culler;
+    CreateFrustumCuller(&culler, 0);
+    CullingBoundsResize(&culler.mBounds, count);
+    std::vector<Aabb> boxes(count);
+    auto updateBounds = [&](uint32_t i) {
+        const SceneObject& object = scene.mObjects[i];
+        CullingBoundsSet(&culler.mBounds, i, object.mModelMatrix, meshSpheres[object.mMesh]);
+        boxes[i] = AabbFromSphere(glm::vec3(culler.mBounds.mCenterX[i], culler.mBounds.mCenterY[i],
+                                            culler.mBounds.mCenterZ[i]), culler.mBounds.mRadius[i]);
+    };
+    for (uint32_t i = 0; i < count; ++i) {
+        updateBounds(i);
+    }
+
+    std::cout << "BVH benchmark, " << count << " objects, " << scene.mAnimatedCount << " moving" << std::endl;
+
+    // Static objects get a tree that is never touched again, the moving ones,
+    // which come first, a tree that is refit every frame
+    uint32_t moving = scene.mAnimatedCount;
+    Bvh staticBvh, dynamicBvh;
+    auto start = std::chrono::steady_clock::now();
+    BvhBuild(&staticBvh, boxes, moving, count - moving);
+    BvhBuild(&dynamicBvh, boxes, 0, moving);
+    double buildTime = MillisecondsSince(start);
+    std::cout << "  Build:   " << buildTime << " ms (" << count / buildTime / 1000.0 << " M objects/s), " <<
+                 staticBvh.mNodes.size() + dynamicBvh.mNodes.size() << " nodes, SAH cost " <<
+                 BvhCost(staticBvh) << " static, " << BvhCost(dynamicBvh) << " moving" << std::endl;
+
+    // Moving objects drift in a fixed random direction. The moving tree is
+    // refit with and without rotations, and for comparison a single tree over
+    // everything is refit with rotations.
+    Bvh refitOnly = dynamicBvh;
+    refitOnly.mRotate = false;
+    Bvh single;
+    BvhBuild(&single, boxes, 0, count);
+    std::mt19937 random(options.mSeed);
+    std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+    std::vector<glm::vec3> velocities(moving);
+    for (glm::vec3& velocity : velocities) {
+        velocity = glm::vec3(unit(random), unit(random), unit(random)) * 0.01f;
+    }
+    const int refits = 60;
+    double refitTime = 0.0, refitOnlyTime = 0.0, singleTime = 0.0;
+    uint64_t rotations = 0;
+    for (int frame = 0; frame < refits; ++frame) {
+        for (uint32_t i = 0; i < moving; ++i) {
+            SceneObject& object = scene.mObjects[i];
+            object.mModelMatrix = glm::translate(glm::mat4(1.0f), velocities[i]) * object.mModelMatrix;
+            updateBounds(i);
+        }
+        start = std::chrono::steady_clock::now();
+        for (uint32_t i = 0; i < moving; ++i) {
+            BvhUpdateObject(&dynamicBvh, i, boxes[i]);
+        }
+        BvhRefit(&dynamicBvh);
+        refitTime += MillisecondsSince(start);
+        rotations += dynamicBvh.mRotations;
+
+        start = std::chrono::steady_clock::now();
+        for (uint32_t i = 0; i < moving; ++i) {
+            BvhUpdateObject(&refitOnly, i, boxes[i]);
+        }
+        BvhRefit(&refitOnly);
+        refitOnlyTime += MillisecondsSince(start);
+
+        start = std::chrono::steady_clock::now();
+        for (uint32_t i = 0; i < moving; ++i) {
+            BvhUpdateObject(&single, i, boxes[i]);
+        }
+        BvhRefit(&single);
+        singleTime += MillisecondsSince(start);
+    }
+    Bvh rebuilt;
+    BvhBuild(&rebuilt, boxes, 0, moving);
+    std::cout << "  Refit:   " << refitTime / refits << " ms per frame with rotations (" << rotations / refits <<
+                 " per frame), " << refitOnlyTime / refits << " ms without, " << singleTime / refits <<
+                 " ms for a single tree" << std::endl;
+    std::cout << "  SAH cost of the moving tree after " << refits << " frames: " << BvhCost(dynamicBvh) <<
+                 " with rotations, " << BvhCost(refitOnly) << " without, " << BvhCost(rebuilt) << " rebuilt" << std::endl;
+    BvhBuild(&rebuilt, boxes, 0, count);
+    std::cout << "  SAH cost of a single tree after " << refits << " frames: " << BvhCost(single) <<
+                 ", " << BvhCost(rebuilt) << " rebuilt" << std::endl;
+
+    // The benchmark camera path, with the default projection
+    Camera camera;
+    camera.SetProjectionMatrix(glm::radians(45.0f), 640.0f / 480.0f, 0.1f, 10.0f);
+    CameraPath path = DefaultCameraPath();
+    const int views = 64;
+    double bvhCullTime = 0.0, flatCullTime = 0.0;
+    uint64_t bvhVisible = 0, flatVisible = 0;
+    std::vector<uint32_t> visible;
+    for (int view = 0; view < views; ++view) {
+        glm::vec3 eye, target;
+        CameraPathEvaluate(path, (float)view / views, &eye, &target);
+        camera.LookAt(eye, target);
+        Frustum frustum = FrustumFromCamera(camera);
+
+        start = std::chrono::steady_clock::now();
+        visible.clear();
+        BvhCullFrustum(dynamicBvh, frustum, &visible);
+        BvhCullFrustum(staticBvh, frustum, &visible);
+        bvhCullTime += MillisecondsSince(start);
+        bvhVisible += visible.size();
+
+        start = std::chrono::steady_clock::now();
+        FrustumCullerRun(&culler, frustum);
+        flatCullTime += MillisecondsSince(start);
+        flatVisible += culler.mStats.mVisible;
+    }
+    std::cout << "  Frustum: " << bvhCullTime / views << " ms BVH (" << bvhVisible / views << " visible), " <<
+                 flatCullTime / views << " ms flat " << CullingKernelName(culler.mKernel) << " (" <<
+                 flatVisible / views << " visible)" << std::endl;
+
+    // Rays from the camera path to random points in the scene bounds
+    const Aabb& sceneBounds = single.mNodes[0].mBounds;
+    std::uniform_real_distribution<float> zeroToOne(0.0f, 1.0f);
+    const int rays = 100000;
+    uint32_t hits = 0;
+    start = std::chrono::steady_clock::now();
+    for (int ray = 0; ray < rays; ++ray) {
+        glm::vec3 eye, target;
+        CameraPathEvaluate(path, zeroToOne(random), &eye, &target);
+        glm::vec3 point = sceneBounds.mMin + (sceneBounds.mMax - sceneBounds.mMin) *
+                          glm::vec3(zeroToOne(random), zeroToOne(random), zeroToOne(random));
+        uint32_t object = 0;
+        float distance = 0.0f;
+        glm::vec3 direction = glm::normalize(point - eye);
+        bool hit = BvhRaycast(dynamicBvh, eye, direction, 100.0f, &object, &distance);
+        hit = BvhRaycast(staticBvh, eye, direction, hit ? distance : 100.0f, &object, &distance) || hit;
+        hits += hit ? 1 : 0;
+    }
+    double rayTime = MillisecondsSince(start);
+    std::cout << "  Rays:    " << rays / rayTime / 1000.0 << " M rays/s, " << 100.0 * hits / rays << "% hit" << std::endl;
+
+    // Proximity around random objects, a few object sizes wide
+    const int queries = 100000;
+    uint64_t found = 0;
+    start = std::chrono::steady_clock::now();
+    for (int query = 0; query < queries; ++query) {
+        uint32_t object = std::uniform_int_distribution<uint32_t>(0, count - 1)(random);
+        glm::vec3 center = (boxes[object].mMin + boxes[object].mMax) * 0.5f;
+        float radius = (boxes[object].mMax.x - boxes[object].mMin.x) * 2.0f;
+        visible.clear();
+        BvhQuerySphere(dynamicBvh, center, radius, &visible);
+        BvhQuerySphere(staticBvh, center, radius, &visible);
+        found += visible.size();
+    }
+    double sphereTime = MillisecondsSince(start);
+    std::cout << "  Spheres: " << queries / sphereTime / 1000.0 << " M queries/s, " <<
+                 (double)found / queries << " objects per query" << std::endl;
+
+    DestroyFrustumCuller(&culler);
+}
@@ -0,0 +1,461 @@
+#include "Bvh.hpp"
+#include "CpuProfiler.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+Aabb AabbFromSphere(const glm::vec3& center, float radius) {
+    Aabb aabb;
+    aabb.mMin = center - glm::vec3(radius);
+    aabb.mMax = center + glm::vec3(radius);
+    return aabb;
+}
+
+Aabb AabbUnion(const Aabb& a, const Aabb& b) {
+    Aabb aabb;
+    aabb.mMin = glm::min(a.mMin, b.mMin);
+    aabb.mMax = glm::max(a.mMax, b.mMax);
+    return aabb;
+}
+
+float AabbSurfaceArea(const Aabb& aabb) {
+    glm::vec3 extent = glm::max(aabb.mMax - aabb.mMin, glm::vec3(0.0f));
+    return 2.0f * (extent.x * extent.y + extent.y * extent.z + extent.z * extent.x);
+}
+
+static bool AabbEqual(const Aabb& a, const Aabb& b) {
+    return a.mMin == b.mMin && a.mMax == b.mMax;
+}
+
+// Empty box that any union replaces
+static Aabb AabbEmpty() {
+    Aabb aabb;
+    aabb.mMin = glm::vec3(std::numeric_limits<float>::max());
+    aabb.mMax = glm::vec3(-std::numeric_limits<float>::max());
+    return aabb;
+}
+
+static bool IsLeaf(const BvhNode& node) {
+    return node.mLeft == BVH_NULL;
+}
+
+static Aabb LeafBounds(const Bvh& bvh, const BvhNode& leaf) {
+    Aabb bounds = AabbEmpty();
+    for (uint32_t i = leaf.mFirst; i < leaf.mFirst + leaf.mCount; ++i) {
+        bounds = AabbUnion(bounds, bvh.mObjectBounds[bvh.mLeafObjects[i]]);
+    }
+    return bounds;
+}
+
+struct SahBin {
+    Aabb mBounds = AabbEmpty();
+    uint32_t mCount = 0;
+};
+
+// Builds the subtree over mLeafObjects[first, first + count) and returns its node
+static uint32_t BuildNode(Bvh* bvh, const std::vector<glm::vec3>& centroids, uint32_t first, uint32_t count,
+                          uint32_t parent) {
+    uint32_t index = (uint32_t)bvh->mNodes.size();
+    bvh->mNodes.emplace_back();
+    bvh->mNodes[index].mParent = parent;
+
+    Aabb bounds = AabbEmpty();
+    Aabb centroidBounds = AabbEmpty();
+    for (uint32_t i = first; i < first + count; ++i) {
+        uint32_t object = bvh->mLeafObjects[i];
+        bounds = AabbUnion(bounds, bvh->mObjectBounds[object]);
+        centroidBounds.mMin = glm::min(centroidBounds.mMin, centroids[object]);
+        centroidBounds.mMax = glm::max(centroidBounds.mMax, centroids[object]);
+    }
+    bvh->mNodes[index].mBounds = bounds;
+
+    if (count <= BVH_MAX_LEAF_SIZE) {
+        bvh->mNodes[index].mFirst = first;
+        bvh->mNodes[index].mCount = count;
+        for (uint32_t i = first; i < first + count; ++i) {
+            bvh->mObjectLeaf[bvh->mLeafObjects[i]] = index;
+        }
+        return index;
+    }
+
+    // Cheapest split of all axes, cost is area times object count on both sides
+    int bestAxis = -1;
+    uint32_t bestSplit = 0;
+    float bestCost = std::numeric_limits<float>::max();
+    glm::vec3 extent = centroidBounds.mMax - centroidBounds.mMin;
+    for (int axis = 0; axis < 3; ++axis) {
+        if (extent[axis] <= 0.0f) {
+            continue;
+        }
+        float scale = BVH_SAH_BINS / extent[axis];
+        SahBin bins[BVH_SAH_BINS];
+        for (uint32_t i = first; i < first + count; ++i) {
+            uint32_t object = bvh->mLeafObjects[i];
+            uint32_t bin = std::min((uint32_t)((centroids[object][axis] - centroidBounds.mMin[axis]) * scale),
+                                    BVH_SAH_BINS - 1);
+            bins[bin].mCount++;
+            bins[bin].mBounds = AabbUnion(bins[bin].mBounds, bvh->mObjectBounds[object]);
+        }
+
+        // Sweep from the right first, then find the best plane from the left
+        float rightArea[BVH_SAH_BINS];
+        uint32_t rightCount[BVH_SAH_BINS];
+        Aabb right = AabbEmpty();
+        uint32_t rightObjects = 0;
+        for (uint32_t bin = BVH_SAH_BINS - 1; bin > 0; --bin) {
+            right = AabbUnion(right, bins[bin].mBounds);
+            rightObjects += bins[bin].mCount;
+            rightArea[bin] = AabbSurfaceArea(right);
+            rightCount[bin] = rightObjects;
+        }
+        Aabb left = AabbEmpty();
+        uint32_t leftObjects = 0;
+        for (uint32_t split = 1; split < BVH_SAH_BINS; ++split) {
+            left = AabbUnion(left, bins[split - 1].mBounds);
+            leftObjects += bins[split - 1].mCount;
+            if (leftObjects == 0 || rightCount[split] == 0) {
+                continue;
+            }
+            float cost = AabbSurfaceArea(left) * leftObjects + rightArea[split] * rightCount[split];
+            if (cost < bestCost) {
+                bestCost = cost;
+                bestAxis = axis;
+                bestSplit = split;
+            }
+        }
+    }
+
+    // With every centroid in one spot any split is as good as another
+    uint32_t middle = first + count / 2;
+    if (bestAxis >= 0) {
+        float scale = BVH_SAH_BINS / extent[bestAxis];
+        float minimum = centroidBounds.mMin[bestAxis];
+        uint32_t* begin = bvh->mLeafObjects.data() + first;
+        uint32_t* split = std::partition(begin, begin + count, [&](uint32_t object) {
+            uint32_t bin = std::min((uint32_t)((centroids[object][bestAxis] - minimum) * scale), BVH_SAH_BINS - 1);
+            return bin < bestSplit;
+        });
+        middle = first + (uint32_t)(split - begin);
+    }
+
+    uint32_t leftNode = BuildNode(bvh, centroids, first, middle - first, index);
+    uint32_t rightNode = BuildNode(bvh, centroids, middle, first + count - middle, index);
+    bvh->mNodes[index].mLeft = leftNode;
+    bvh->mNodes[index].mRight = rightNode;
+    return index;
+}
+
+void BvhBuild(Bvh* bvh, const std::vector<Aabb>& objectBounds, uint32_t first, uint32_t count) {
+    PROFILE_FUNCTION();
+    bvh->mNodes.clear();
+    bvh->mDirtyLeaves.clear();
+    bvh->mFirstObject = first;
+    bvh->mObjectBounds.assign(objectBounds.begin() + first, objectBounds.begin() + first + count);
+    bvh->mObjectLeaf.assign(count, BVH_NULL);
+    bvh->mLeafObjects.resize(count);
+    // A binary tree with leaves of at least one object
+    bvh->mNodes.reserve(count > 0 ? 2 * count : 1);
+
+    std::vector<glm::vec3> centroids(count);
+    for (uint32_t i = 0; i < count; ++i) {
+        bvh->mLeafObjects[i] = i;
+        centroids[i] = (bvh->mObjectBounds[i].mMin + bvh->mObjectBounds[i].mMax) * 0.5f;
+    }
+    if (count > 0) {
+        BuildNode(bvh, centroids, 0, count, BVH_NULL);
+    }
+    bvh->mLeafDirty.assign(bvh->mNodes.size(), false);
+}
+
+void BvhUpdateObject(Bvh* bvh, uint32_t object, const Aabb& bounds) {
+    object -= bvh->mFirstObject;
+    bvh->mObjectBounds[object] = bounds;
+    uint32_t leaf = bvh->mObjectLeaf[object];
+    if (!bvh->mLeafDirty[leaf]) {
+        bvh->mLeafDirty[leaf] = true;
+        bvh->mDirtyLeaves.push_back(leaf);
+    }
+}
+
+static void RefitNode(Bvh* bvh, uint32_t index) {
+    BvhNode& node = bvh->mNodes[index];
+    node.mBounds = AabbUnion(bvh->mNodes[node.mLeft].mBounds, bvh->mNodes[node.mRight].mBounds);
+}
+
+// Swaps child (of node) with grandchild (a child of node's other child)
+static void SwapWithGrandchild(Bvh* bvh, uint32_t node, uint32_t child, uint32_t grandchild) {
+    BvhNode& parent = bvh->mNodes[node];
+    uint32_t other = parent.mLeft == child ? parent.mRight : parent.mLeft;
+    if (parent.mLeft == child) {
+        parent.mLeft = grandchild;
+    } else {
+        parent.mRight = grandchild;
+    }
+
+    BvhNode& otherNode = bvh->mNodes[other];
+    if (otherNode.mLeft == grandchild) {
+        otherNode.mLeft = child;
+    } else {
+        otherNode.mRight = child;
+    }
+    bvh->mNodes[grandchild].mParent = node;
+    bvh->mNodes[child].mParent = other;
+    RefitNode(bvh, other);
+}
+
+// Tree rotations after Kopta et al., "Fast, Effective BVH Updates for Animated
+// Scenes": a child trades places with a grandchild on the other side when that
+// shrinks the other child. The node's own bounds stay the same.
+static bool TryRotate(Bvh* bvh, uint32_t index) {
+    const BvhNode& node = bvh->mNodes[index];
+    float bestGain = 0.0f;
+    uint32_t bestChild = BVH_NULL;
+    uint32_t bestGrandchild = BVH_NULL;
+
+    uint32_t children[2] = { node.mLeft, node.mRight };
+    for (int side = 0; side < 2; ++side) {
+        uint32_t child = children[side];
+        const BvhNode& other = bvh->mNodes[children[1 - side]];
+        if (IsLeaf(other)) {
+            continue;
+        }
+        float area = AabbSurfaceArea(other.mBounds);
+        uint32_t grandchildren[2] = { other.mLeft, other.mRight };
+        for (int pick = 0; pick < 2; ++pick) {
+            // child moves down next to the grandchild that stays
+            Aabb rotated = AabbUnion(bvh->mNodes[child].mBounds, bvh->mNodes[grandchildren[1 - pick]].mBounds);
+            float gain = area - AabbSurfaceArea(rotated);
+            if (gain > bestGain) {
+                bestGain = gain;
+                bestChild = child;
+                bestGrandchild = grandchildren[pick];
+            }
+        }
+    }
+
+    // Tiny gains aren't worth the churn, and floating point could flip them back and forth
+    if (bestChild == BVH_NULL || bestGain < AabbSurfaceArea(node.mBounds) * 1e-3f) {
+        return false;
+    }
+    SwapWithGrandchild(bvh, index, bestChild, bestGrandchild);
+    return true;
+}
+
+void BvhRefit(Bvh* bvh) {
+    PROFILE_FUNCTION();
+    bvh->mRotations = 0;
+    for (uint32_t leaf : bvh->mDirtyLeaves) {
+        bvh->mLeafDirty[leaf] = false;
+        bvh->mNodes[leaf].mBounds = LeafBounds(*bvh, bvh->mNodes[leaf]);
+
+        // Each walk recomputes from the current children, so leaves sharing
+        // ancestors end up right whatever order they come in
+        for (uint32_t index = bvh->mNodes[leaf].mParent; index != BVH_NULL; index = bvh->mNodes[index].mParent) {
+            Aabb previous = bvh->mNodes[index].mBounds;
+            RefitNode(bvh, index);
+            if (bvh->mRotate && TryRotate(bvh, index)) {
+                bvh->mRotations++;
+            }
+            if (AabbEqual(previous, bvh->mNodes[index].mBounds)) {
+                break;
+            }
+        }
+    }
+    bvh->mDirtyLeaves.clear();
+}
+
+float BvhCost(const Bvh& bvh) {
+    if (bvh.mNodes.empty()) {
+        return 0.0f;
+    }
+    float cost = 0.0f;
+    for (const BvhNode& node : bvh.mNodes) {
+        cost += AabbSurfaceArea(node.mBounds) * (IsLeaf(node) ? (float)node.mCount : 1.0f);
+    }
+    float rootArea = AabbSurfaceArea(bvh.mNodes[0].mBounds);
+    return rootArea > 0.0f ? cost / rootArea : 0.0f;
+}
+
+// -1 outside the plane, 1 completely inside, 0 crossing it
+static int ClassifyAabb(const Aabb& aabb, const glm::vec4& plane) {
+    glm::vec3 center = (aabb.mMin + aabb.mMax) * 0.5f;
+    glm::vec3 extent = (aabb.mMax - aabb.mMin) * 0.5f;
+    glm::vec3 normal(plane);
+    float distance = glm::dot(normal, center) + plane.w;
+    float reach = glm::dot(glm::abs(normal), extent);
+    if (distance + reach < 0.0f) {
+        return -1;
+    }
+    return distance - reach >= 0.0f ? 1 : 0;
+}
+
+// Everything under index, no tests needed
+static void CollectSubtree(const Bvh& bvh, uint32_t index, std::vector<uint32_t>* objects,
+                           std::vector<uint32_t>* stack) {
+    size_t bottom = stack->size();
+    stack->push_back(index);
+    while (stack->size() > bottom) {
+        const BvhNode& node = bvh.mNodes[stack->back()];
+        stack->pop_back();
+        if (IsLeaf(node)) {
+            for (uint32_t i = node.mFirst; i < node.mFirst + node.mCount; ++i) {
+                objects->push_back(bvh.mFirstObject + bvh.mLeafObjects[i]);
+            }
+        } else {
+            stack->push_back(node.mRight);
+            stack->push_back(node.mLeft);
+        }
+    }
+}
+
+void BvhCullFrustum(const Bvh& bvh, const Frustum& frustum, std::vector<uint32_t>* objects) {
+    PROFILE_FUNCTION();
+    if (bvh.mNodes.empty()) {
+        return;
+    }
+    // Bit p set while plane p still has to be tested, children inherit what the parent cleared
+    struct Entry {
+        uint32_t mNode;
+        uint32_t mPlanes;
+    };
+    std::vector<Entry> stack;
+    std::vector<uint32_t> subtreeStack;
+    stack.push_back({ 0, 0x3f });
+
+    while (!stack.empty()) {
+        Entry entry = stack.back();
+        stack.pop_back();
+        const BvhNode& node = bvh.mNodes[entry.mNode];
+
+        bool outside = false;
+        for (uint32_t p = 0; p < 6 && !outside; ++p) {
+            if (entry.mPlanes & (1u << p)) {
+                int side = ClassifyAabb(node.mBounds, frustum.mPlanes[p]);
+                outside = side < 0;
+                if (side > 0) {
+                    entry.mPlanes &= ~(1u << p);
+                }
+            }
+        }
+        if (outside) {
+            continue;
+        }
+        if (entry.mPlanes == 0) {
+            CollectSubtree(bvh, entry.mNode, objects, &subtreeStack);
+            continue;
+        }
+
+        if (!IsLeaf(node)) {
+            stack.push_back({ node.mRight, entry.mPlanes });
+            stack.push_back({ node.mLeft, entry.mPlanes });
+            continue;
+        }
+        for (uint32_t i = node.mFirst; i < node.mFirst + node.mCount; ++i) {
+            uint32_t object = bvh.mLeafObjects[i];
+            bool visible = true;
+            for (uint32_t p = 0; p < 6 && visible; ++p) {
+                visible = !(entry.mPlanes & (1u << p)) || ClassifyAabb(bvh.mObjectBounds[object], frustum.mPlanes[p]) >= 0;
+            }
+            if (visible) {
+                objects->push_back(bvh.mFirstObject + object);
+            }
+        }
+    }
+}
+
+// Slab test, distance where the ray enters the box (0 when it starts inside)
+static bool RayAabb(const Aabb& aabb, const glm::vec3& origin, const glm::vec3& inverseDirection, float maxDistance,
+                    float* entry) {
+    glm::vec3 t1 = (aabb.mMin - origin) * inverseDirection;
+    glm::vec3 t2 = (aabb.mMax - origin) * inverseDirection;
+    glm::vec3 near = glm::min(t1, t2);
+    glm::vec3 far = glm::max(t1, t2);
+    float enter = std::max(std::max(near.x, near.y), std::max(near.z, 0.0f));
+    float exit = std::min(std::min(far.x, far.y), far.z);
+    *entry = enter;
+    return enter <= exit && enter <= maxDistance;
+}
+
+bool BvhRaycast(const Bvh& bvh, const glm::vec3& origin, const glm::vec3& direction, float maxDistance,
+                uint32_t* object, float* distance) {
+    if (bvh.mNodes.empty()) {
+        return false;
+    }
+    glm::vec3 inverseDirection = 1.0f / direction;
+    float best = maxDistance;
+    bool hit = false;
+
+    std::vector<uint32_t> stack;
+    stack.push_back(0);
+    while (!stack.empty()) {
+        const BvhNode& node = bvh.mNodes[stack.back()];
+        stack.pop_back();
+        float entry = 0.0f;
+        if (!RayAabb(node.mBounds, origin, inverseDirection, best, &entry)) {
+            continue;
+        }
+
+        if (IsLeaf(node)) {
+            for (uint32_t i = node.mFirst; i < node.mFirst + node.mCount; ++i) {
+                uint32_t candidate = bvh.mLeafObjects[i];
+                if (RayAabb(bvh.mObjectBounds[candidate], origin, inverseDirection, best, &entry) && entry < best) {
+                    best = entry;
+                    *object = bvh.mFirstObject + candidate;
+                    hit = true;
+                }
+            }
+            continue;
+        }
+
+        // Nearer child on top, so it can shorten the ray before the other one is tested
+        float leftEntry = 0.0f, rightEntry = 0.0f;
+        bool left = RayAabb(bvh.mNodes[node.mLeft].mBounds, origin, inverseDirection, best, &leftEntry);
+        bool right = RayAabb(bvh.mNodes[node.mRight].mBounds, origin, inverseDirection, best, &rightEntry);
+        if (left && right) {
+            bool leftFirst = leftEntry <= rightEntry;
+            stack.push_back(leftFirst ? node.mRight : node.mLeft);
+            stack.push_back(leftFirst ? node.mLeft : node.mRight);
+        } else if (left) {
+            stack.push_back(node.mLeft);
+        } else if (right) {
+            stack.push_back(node.mRight);
+        }
+    }
+    if (hit) {
+        *distance = best;
+    }
+    return hit;
+}
+
+static bool SphereOverlapsAabb(const glm::vec3& center, float radiusSquared, const Aabb& aabb) {
+    glm::vec3 offset = glm::max(glm::max(aabb.mMin - center, center - aabb.mMax), glm::vec3(0.0f));
+    return glm::dot(offset, offset) <= radiusSquared;
+}
+
+void BvhQuerySphere(const Bvh& bvh, const glm::vec3& center, float radius, std::vector<uint32_t>* objects) {
+    if (bvh.mNodes.empty()) {
+        return;
+    }
+    float radiusSquared = radius * radius;
+    std::vector<uint32_t> stack;
+    stack.push_back(0);
+    while (!stack.empty()) {
+        const BvhNode& node = bvh.mNodes[stack.back()];
+        stack.pop_back();
+        if (!SphereOverlapsAabb(center, radiusSquared, node.mBounds)) {
+            continue;
+        }
+        if (IsLeaf(node)) {
+            for (uint32_t i = node.mFirst; i < node.mFirst + node.mCount; ++i) {
+                uint32_t object = bvh.mLeafObjects[i];
+                if (SphereOverlapsAabb(center, radiusSquared, bvh.mObjectBounds[object])) {
+                    objects->push_back(bvh.mFirstObject + object);
+                }
+            }
+        } else {
+            stack.push_back(node.mRight);
+            stack.push_back(node.mLeft);
+        }
+    }
+}
@@ -22,6 +22,19 @@ glm::mat4 Camera::GetProjectionMatrix () const {
     return mProjectionMatrix;
 }
 
+glm::vec3 Camera::GetPosition() const {
+    return mEye;
+}
+
+glm::vec3 Camera::GetViewDirection() const {
+    return mViewDirection;
+}
+
+void Camera::LookAt(const glm::vec3& eye, const glm::vec3& target) {
+    mEye = eye;
+    mViewDirection = glm::normalize(target - eye);
+}
+
 void Camera::MouseLook(int mouseX, int mouseY) {
 
     glm::vec2 currentMouse = glm::vec2(mouseX, mouseY);
@@ -0,0 +1,107 @@
+#include "CpuProfiler.hpp"
+#include "Utilities.hpp"
+
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <vector>
+
+// Zones are recorded during static initialization too (the mesh templates),
+// so nothing here may depend on the order globals are constructed in
+static std::chrono::steady_clock::time_point Epoch() {
+    static const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+    return epoch;
+}
+
+// Threads are only added, registration is the one place that locks
+static std::mutex sThreadsMutex;
+static thread_local CpuProfilerThread* tThread = nullptr;
+
+static std::vector<CpuProfilerThread*>& Threads() {
+    static std::vector<CpuProfilerThread*> threads;
+    return threads;
+}
+
+static CpuProfilerThread* CurrentThread() {
+    if (tThread == nullptr) {
+        // Never freed, so the events of threads that already exited still make it into the trace
+        CpuProfilerThread* thread = new CpuProfilerThread();
+        std::lock_guard<std::mutex> lock(sThreadsMutex);
+        thread->mThreadId = (uint32_t)Threads().size() + 1;
+        thread->mName = thread->mThreadId == 1 ? "Main" : "Thread " + std::to_string(thread->mThreadId);
+        Threads().push_back(thread);
+        tThread = thread;
+    }
+    return tThread;
+}
+
+uint64_t CpuProfilerNow() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - Epoch()).count();
+}
+
+void CpuProfilerRecord(const char* name, uint64_t start, uint64_t end) {
+    CpuProfilerThread* thread = CurrentThread();
+    uint64_t head = thread->mHead.load(std::memory_order_relaxed);
+    CpuZoneEvent& event = thread->mEvents[head % CPU_PROFILER_EVENTS_PER_THREAD];
+    event.mName = name;
+    event.mStart = start;
+    event.mEnd = end;
+    thread->mHead.store(head + 1, std::memory_order_release);
+}
+
+void CpuProfilerSetThreadName(const char* name) {
+    CpuProfilerThread* thread = CurrentThread();
+    std::lock_guard<std::mutex> lock(sThreadsMutex);
+    thread->mName = name;
+}
+
+bool CpuProfilerWriteTrace(const std::string& path) {
+#ifndef CPU_PROFILER
+    std::cout << "Built without CPU_PROFILER (make PROFILE=1), no trace written to " << path << std::endl;
+    return false;
+#else
+    std::ofstream file(path);
+    if (!file) {
+        std::cout << "Could not write trace " << path << std::endl;
+        return false;
+    }
+
+    std::vector<CpuProfilerThread*> threads;
+    {
+        std::lock_guard<std::mutex> lock(sThreadsMutex);
+        threads = Threads();
+    }
+
+    file << std::fixed << std::setprecision(3);
+    file << "{\"traceEvents\":[";
+    bool first = true;
+    uint64_t eventCount = 0;
+    for (CpuProfilerThread* thread : threads) {
+        file << (first ? "\n" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" <<
+                thread->mThreadId << ",\"args\":{\"name\":";
+        WriteJsonString(file, thread->mName.c_str());
+        file << "}}";
+        first = false;
+
+        // The owner may keep writing while we read, stay a quarter of the ring away from it
+        uint64_t head = thread->mHead.load(std::memory_order_acquire);
+        uint64_t available = CPU_PROFILER_EVENTS_PER_THREAD - CPU_PROFILER_EVENTS_PER_THREAD / 4;
+        uint64_t begin = head > available ? head - available : 0;
+        for (uint64_t i = begin; i < head; ++i) {
+            const CpuZoneEvent& event = thread->mEvents[i % CPU_PROFILER_EVENTS_PER_THREAD];
+            file << ",\n{\"name\":";
+            WriteJsonString(file, event.mName);
+            // Complete events, in microseconds
+            file << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << thread->mThreadId <<
+                    ",\"ts\":" << event.mStart / 1000.0 << ",\"dur\":" << (event.mEnd - event.mStart) / 1000.0 << "}";
+            eventCount++;
+        }
+    }
+    file << "\n]}\n";
+
+    std::cout << "Wrote " << eventCount << " CPU zones to " << path << std::endl;
+    return true;
+#endif
+}
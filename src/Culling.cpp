@@ -0,0 +1,291 @@
+#include "Culling.hpp"
+#include "CpuProfiler.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#if defined(__x86_64__) || defined(_M_X64) || (defined(__i386__) && defined(__SSE2__))
+#define CULLING_SSE 1
+#include <immintrin.h>
+// GCC and Clang can compile single functions for AVX and check the CPU at runtime
+#if defined(__GNUC__)
+#define CULLING_AVX 1
+#endif
+#endif
+
+Frustum ExtractFrustum(const glm::mat4& viewProjection) {
+    // GLM is column-major, row i is m[0][i], m[1][i], m[2][i], m[3][i]
+    const glm::mat4& m = viewProjection;
+    glm::vec4 rows[4];
+    for (int i = 0; i < 4; ++i) {
+        rows[i] = glm::vec4(m[0][i], m[1][i], m[2][i], m[3][i]);
+    }
+
+    Frustum frustum;
+    frustum.mPlanes[0] = rows[3] + rows[0]; // Left
+    frustum.mPlanes[1] = rows[3] - rows[0]; // Right
+    frustum.mPlanes[2] = rows[3] + rows[1]; // Bottom
+    frustum.mPlanes[3] = rows[3] - rows[1]; // Top
+    frustum.mPlanes[4] = rows[3] + rows[2]; // Near
+    frustum.mPlanes[5] = rows[3] - rows[2]; // Far
+    for (glm::vec4& plane : frustum.mPlanes) {
+        plane /= glm::length(glm::vec3(plane));
+    }
+    return frustum;
+}
+
+Frustum FrustumFromCamera(const Camera& camera) {
+    return ExtractFrustum(camera.GetProjectionMatrix() * camera.GetViewMatrix());
+}
+
+const char* CullingKernelName(CullingKernel kernel) {
+    switch (kernel) {
+        case CullingKernel::Scalar: return "scalar";
+        case CullingKernel::SSE:    return "SSE";
+        case CullingKernel::AVX:    return "AVX";
+    }
+    return "unknown";
+}
+
+void CullingBoundsResize(CullingBounds* bounds, uint32_t count) {
+    uint32_t padded = (count + CULLING_BLOCK_SIZE - 1) / CULLING_BLOCK_SIZE * CULLING_BLOCK_SIZE;
+    bounds->mCenterX.resize(padded);
+    bounds->mCenterY.resize(padded);
+    bounds->mCenterZ.resize(padded);
+    bounds->mRadius.resize(padded);
+    bounds->mCount = count;
+
+    for (uint32_t i = count; i < padded; ++i) {
+        bounds->mCenterX[i] = 0.0f;
+        bounds->mCenterY[i] = 0.0f;
+        bounds->mCenterZ[i] = 0.0f;
+        bounds->mRadius[i] = -std::numeric_limits<float>::infinity();
+    }
+}
+
+void CullingBoundsSet(CullingBounds* bounds, uint32_t index, const glm::mat4& modelMatrix,
+                      const glm::vec4& localSphere) {
+    glm::vec4 center = modelMatrix * glm::vec4(glm::vec3(localSphere), 1.0f);
+    // Non-uniform scales stretch the sphere, the largest axis still covers it
+    float scale = std::max(glm::length(glm::vec3(modelMatrix[0])),
+                           std::max(glm::length(glm::vec3(modelMatrix[1])), glm::length(glm::vec3(modelMatrix[2]))));
+    bounds->mCenterX[index] = center.x;
+    bounds->mCenterY[index] = center.y;
+    bounds->mCenterZ[index] = center.z;
+    bounds->mRadius[index] = localSphere.w * scale;
+}
+
+// The kernels test bounds [begin, end), both multiples of CULLING_BLOCK_SIZE,
+// and return how many indices they wrote to visible. Every index is written and
+// the count only advanced for visible ones, so there are no branches on the result.
+
+static uint32_t CullScalar(const CullingBounds& bounds, const Frustum& frustum, uint32_t begin, uint32_t end,
+                           uint32_t* visible) {
+    uint32_t count = 0;
+    for (uint32_t i = begin; i < end; ++i) {
+        bool inside = true;
+        for (const glm::vec4& plane : frustum.mPlanes) {
+            float distance = plane.x * bounds.mCenterX[i] + plane.y * bounds.mCenterY[i] +
+                             plane.z * bounds.mCenterZ[i] + plane.w;
+            inside = inside && distance >= -bounds.mRadius[i];
+        }
+        visible[count] = i;
+        count += inside ? 1 : 0;
+    }
+    return count;
+}
+
+#ifdef CULLING_SSE
+static uint32_t CullSSE(const CullingBounds& bounds, const Frustum& frustum, uint32_t begin, uint32_t end,
+                        uint32_t* visible) {
+    __m128 planeX[6], planeY[6], planeZ[6], planeW[6];
+    for (int p = 0; p < 6; ++p) {
+        planeX[p] = _mm_set1_ps(frustum.mPlanes[p].x);
+        planeY[p] = _mm_set1_ps(frustum.mPlanes[p].y);
+        planeZ[p] = _mm_set1_ps(frustum.mPlanes[p].z);
+        planeW[p] = _mm_set1_ps(frustum.mPlanes[p].w);
+    }
+
+    uint32_t count = 0;
+    for (uint32_t i = begin; i < end; i += 4) {
+        __m128 x = _mm_loadu_ps(&bounds.mCenterX[i]);
+        __m128 y = _mm_loadu_ps(&bounds.mCenterY[i]);
+        __m128 z = _mm_loadu_ps(&bounds.mCenterZ[i]);
+        __m128 negativeRadius = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(&bounds.mRadius[i]));
+
+        __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        for (int p = 0; p < 6; ++p) {
+            __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, planeX[p]), _mm_mul_ps(y, planeY[p])),
+                                         _mm_add_ps(_mm_mul_ps(z, planeZ[p]), planeW[p]));
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, negativeRadius));
+        }
+
+        int mask = _mm_movemask_ps(inside);
+        for (uint32_t lane = 0; lane < 4; ++lane) {
+            visible[count] = i + lane;
+            count += (mask >> lane) & 1;
+        }
+    }
+    return count;
+}
+#endif
+
+#ifdef CULLING_AVX
+__attribute__((target("avx")))
+static uint32_t CullAVX(const CullingBounds& bounds, const Frustum& frustum, uint32_t begin, uint32_t end,
+                        uint32_t* visible) {
+    __m256 planeX[6], planeY[6], planeZ[6], planeW[6];
+    for (int p = 0; p < 6; ++p) {
+        planeX[p] = _mm256_set1_ps(frustum.mPlanes[p].x);
+        planeY[p] = _mm256_set1_ps(frustum.mPlanes[p].y);
+        planeZ[p] = _mm256_set1_ps(frustum.mPlanes[p].z);
+        planeW[p] = _mm256_set1_ps(frustum.mPlanes[p].w);
+    }
+
+    uint32_t count = 0;
+    for (uint32_t i = begin; i < end; i += 8) {
+        __m256 x = _mm256_loadu_ps(&bounds.mCenterX[i]);
+        __m256 y = _mm256_loadu_ps(&bounds.mCenterY[i]);
+        __m256 z = _mm256_loadu_ps(&bounds.mCenterZ[i]);
+        __m256 negativeRadius = _mm256_sub_ps(_mm256_setzero_ps(), _mm256_loadu_ps(&bounds.mRadius[i]));
+
+        __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+        for (int p = 0; p < 6; ++p) {
+            __m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(x, planeX[p]), _mm256_mul_ps(y, planeY[p])),
+                                            _mm256_add_ps(_mm256_mul_ps(z, planeZ[p]), planeW[p]));
+            inside = _mm256_and_ps(inside, _mm256_cmp_ps(distance, negativeRadius, _CMP_GE_OQ));
+        }
+
+        int mask = _mm256_movemask_ps(inside);
+        for (uint32_t lane = 0; lane < 8; ++lane) {
+            visible[count] = i + lane;
+            count += (mask >> lane) & 1;
+        }
+    }
+    return count;
+}
+#endif
+
+// First bound of a range, ranges are whole blocks so every kernel can take them
+static uint32_t RangeBegin(const FrustumCuller& culler, uint32_t range) {
+    uint32_t blocks = (uint32_t)culler.mBounds.mRadius.size() / CULLING_BLOCK_SIZE;
+    return (uint32_t)((uint64_t)blocks * range / culler.mRangeCount) * CULLING_BLOCK_SIZE;
+}
+
+static void CullRange(FrustumCuller* culler, uint32_t range) {
+    PROFILE_ZONE("Cull range");
+    uint32_t begin = RangeBegin(*culler, range);
+    uint32_t end = RangeBegin(*culler, range + 1);
+    uint32_t* visible = culler->mVisible.data() + begin;
+
+    uint32_t count = 0;
+    switch (culler->mKernel) {
+#ifdef CULLING_AVX
+        case CullingKernel::AVX:
+            count = CullAVX(culler->mBounds, culler->mFrustum, begin, end, visible);
+            break;
+#endif
+#ifdef CULLING_SSE
+        case CullingKernel::SSE:
+            count = CullSSE(culler->mBounds, culler->mFrustum, begin, end, visible);
+            break;
+#endif
+        default:
+            count = CullScalar(culler->mBounds, culler->mFrustum, begin, end, visible);
+            break;
+    }
+    culler->mRangeVisible[range] = count;
+}
+
+static void WorkerThread(FrustumCuller* culler, uint32_t range) {
+    PROFILE_THREAD_NAME("Culling worker");
+    uint64_t generation = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(culler->mMutex);
+            culler->mWake.wait(lock, [&] { return culler->mQuit || culler->mGeneration != generation; });
+            if (culler->mQuit) {
+                return;
+            }
+            generation = culler->mGeneration;
+        }
+
+        CullRange(culler, range);
+
+        std::lock_guard<std::mutex> lock(culler->mMutex);
+        if (--culler->mPending == 0) {
+            culler->mDone.notify_one();
+        }
+    }
+}
+
+void CreateFrustumCuller(FrustumCuller* culler, uint32_t threadCount) {
+#if defined(CULLING_AVX)
+    culler->mKernel = __builtin_cpu_supports("avx") ? CullingKernel::AVX : CullingKernel::SSE;
+#elif defined(CULLING_SSE)
+    culler->mKernel = CullingKernel::SSE;
+#else
+    culler->mKernel = CullingKernel::Scalar;
+#endif
+
+    if (threadCount == 0) {
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
+    }
+    threadCount = std::min(threadCount, CULLING_MAX_THREADS);
+    for (uint32_t range = 1; range < threadCount; ++range) {
+        culler->mThreads.emplace_back(WorkerThread, culler, range);
+    }
+}
+
+void DestroyFrustumCuller(FrustumCuller* culler) {
+    {
+        std::lock_guard<std::mutex> lock(culler->mMutex);
+        culler->mQuit = true;
+    }
+    culler->mWake.notify_all();
+    for (std::thread& thread : culler->mThreads) {
+        thread.join();
+    }
+    culler->mThreads.clear();
+}
+
+void FrustumCullerRun(FrustumCuller* culler, const Frustum& frustum) {
+    PROFILE_FUNCTION();
+    const CullingBounds& bounds = culler->mBounds;
+    bool parallel = !culler->mThreads.empty() && bounds.mCount >= CULLING_PARALLEL_THRESHOLD;
+
+    // Room for every bound, each range compacts into its own part
+    culler->mVisible.resize(bounds.mRadius.size());
+    culler->mFrustum = frustum;
+    culler->mRangeCount = parallel ? (uint32_t)culler->mThreads.size() + 1 : 1;
+    culler->mRangeVisible.assign(culler->mRangeCount, 0);
+
+    if (parallel) {
+        {
+            std::lock_guard<std::mutex> lock(culler->mMutex);
+            culler->mGeneration++;
+            culler->mPending = (uint32_t)culler->mThreads.size();
+        }
+        culler->mWake.notify_all();
+    }
+    CullRange(culler, 0);
+    if (parallel) {
+        std::unique_lock<std::mutex> lock(culler->mMutex);
+        culler->mDone.wait(lock, [&] { return culler->mPending == 0; });
+    }
+
+    // Ranges are in order, so moving them together keeps the list sorted
+    uint32_t visible = culler->mRangeVisible[0];
+    for (uint32_t range = 1; range < culler->mRangeCount; ++range) {
+        uint32_t* begin = culler->mVisible.data() + RangeBegin(*culler, range);
+        std::copy(begin, begin + culler->mRangeVisible[range], culler->mVisible.data() + visible);
+        visible += culler->mRangeVisible[range];
+    }
+    culler->mVisible.resize(visible);
+
+    culler->mStats.mTested = bounds.mCount;
+    culler->mStats.mVisible = visible;
+    culler->mStats.mCulled = bounds.mCount - visible;
+    culler->mStats.mThreads = culler->mRangeCount;
+}
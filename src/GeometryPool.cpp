@@ -0,0 +1,269 @@
+#include "GeometryPool.hpp"
+#include "CpuProfiler.hpp"
+
+#include <algorithm>
+#include <cstddef>
+
+void CreateRangeAllocator(RangeAllocator* allocator, GLuint capacity) {
+    allocator->mCapacity = capacity;
+    allocator->mFreeBlocks.clear();
+    if (capacity > 0) {
+        allocator->mFreeBlocks.push_back({ 0, capacity });
+    }
+}
+
+bool RangeAllocatorAllocate(RangeAllocator* allocator, GLuint size, GLuint* offset) {
+    for (size_t i = 0; i < allocator->mFreeBlocks.size(); ++i) {
+        FreeBlock& block = allocator->mFreeBlocks[i];
+        if (block.mSize < size) {
+            continue;
+        }
+        *offset = block.mOffset;
+        block.mOffset += size;
+        block.mSize -= size;
+        if (block.mSize == 0) {
+            allocator->mFreeBlocks.erase(allocator->mFreeBlocks.begin() + i);
+        }
+        return true;
+    }
+    return false;
+}
+
+void RangeAllocatorFree(RangeAllocator* allocator, GLuint offset, GLuint size) {
+    if (size == 0) {
+        return;
+    }
+    std::vector<FreeBlock>& blocks = allocator->mFreeBlocks;
+
+    // First block that starts after the freed range
+    auto next = std::upper_bound(blocks.begin(), blocks.end(), offset,
+                                 [](GLuint value, const FreeBlock& block) { return value < block.mOffset; });
+    auto inserted = blocks.insert(next, { offset, size });
+
+    // Merge with the following block
+    auto after = inserted + 1;
+    if (after != blocks.end() && inserted->mOffset + inserted->mSize == after->mOffset) {
+        inserted->mSize += after->mSize;
+        blocks.erase(after);
+    }
+    // Merge with the preceding block
+    if (inserted != blocks.begin()) {
+        auto before = inserted - 1;
+        if (before->mOffset + before->mSize == inserted->mOffset) {
+            before->mSize += inserted->mSize;
+            blocks.erase(inserted);
+        }
+    }
+}
+
+void RangeAllocatorGrow(RangeAllocator* allocator, GLuint capacity) {
+    if (capacity <= allocator->mCapacity) {
+        return;
+    }
+    GLuint oldCapacity = allocator->mCapacity;
+    allocator->mCapacity = capacity;
+    RangeAllocatorFree(allocator, oldCapacity, capacity - oldCapacity);
+}
+
+// Position at location 0, color at location 1
+static const VertexAttribute POSITION_COLOR_ATTRIBUTES[] = {
+    { 0, 3, GL_FLOAT, offsetof(Vertex, x) },
+    { 1, 3, GL_FLOAT, offsetof(Vertex, r) }
+};
+
+GLsizei VertexFormatStride(VertexFormat format) {
+    switch (format) {
+        case VertexFormat::PositionColor:
+        default:
+            return sizeof(Vertex);
+    }
+}
+
+const VertexAttribute* VertexFormatAttributes(VertexFormat format, GLuint* count) {
+    switch (format) {
+        case VertexFormat::PositionColor:
+        default:
+            *count = sizeof(POSITION_COLOR_ATTRIBUTES) / sizeof(VertexAttribute);
+            return POSITION_COLOR_ATTRIBUTES;
+    }
+}
+
+// Points the pool's VAO at its current buffers
+static void GeometryPoolVertexSpecification(GeometryPool* pool) {
+    GLuint attributeCount = 0;
+    const VertexAttribute* attributes = VertexFormatAttributes(pool->mFormat, &attributeCount);
+    VertexArrayVertexBuffer(pool->mVertexArrayObject, 0, pool->mVertexBufferObject, 0,
+                            VertexFormatStride(pool->mFormat), 0, attributes, attributeCount);
+    VertexArrayIndexBuffer(pool->mVertexArrayObject, pool->mIndexBufferObject);
+}
+
+// Creates a buffer of newSize bytes holding the first copySize bytes of buffer, and deletes buffer
+static GLuint ReallocateBuffer(GLuint buffer, GLsizeiptr copySize, GLsizeiptr newSize) {
+    // Sized once, allocations are written into it with BufferUpload
+    GLuint newBuffer = CreateStaticBuffer(newSize, nullptr, true);
+
+    if (buffer != 0 && copySize > 0) {
+        BufferCopy(buffer, newBuffer, 0, 0, copySize);
+    }
+
+    if (buffer != 0) {
+        glDeleteBuffers(1, &buffer);
+    }
+    return newBuffer;
+}
+
+void CreateGeometryPool(GeometryPool* pool, VertexFormat format, GLuint vertexCapacity, GLuint indexCapacity) {
+    pool->mFormat = format;
+    pool->mVertexArrayObject = CreateVertexArray();
+
+    pool->mVertexBufferObject = ReallocateBuffer(0, 0, vertexCapacity * VertexFormatStride(format));
+    pool->mIndexBufferObject = ReallocateBuffer(0, 0, indexCapacity * sizeof(GLuint));
+    CreateRangeAllocator(&pool->mVertexAllocator, vertexCapacity);
+    CreateRangeAllocator(&pool->mIndexAllocator, indexCapacity);
+
+    GeometryPoolVertexSpecification(pool);
+}
+
+void DestroyGeometryPool(GeometryPool* pool) {
+    glDeleteVertexArrays(1, &pool->mVertexArrayObject);
+    glDeleteBuffers(1, &pool->mVertexBufferObject);
+    glDeleteBuffers(1, &pool->mIndexBufferObject);
+    *pool = GeometryPool();
+}
+
+// Makes sure size elements can be allocated, growing the buffer if necessary
+static void ReserveRange(RangeAllocator* allocator, GLuint* buffer, GLsizeiptr stride, GLuint size, bool* grown) {
+    for (const FreeBlock& block : allocator->mFreeBlocks) {
+        if (block.mSize >= size) {
+            return;
+        }
+    }
+
+    GLuint capacity = std::max(allocator->mCapacity * 2, allocator->mCapacity + size);
+    *buffer = ReallocateBuffer(*buffer, allocator->mCapacity * stride, capacity * stride);
+    RangeAllocatorGrow(allocator, capacity);
+    *grown = true;
+}
+
+GeometryHandle GeometryPoolAllocate(GeometryPool* pool, const MeshData& meshData) {
+    PROFILE_FUNCTION();
+    GLuint vertexCount = (GLuint)meshData.vertices.size();
+    GLuint indexCount = (GLuint)meshData.indices.size();
+    GLsizeiptr stride = VertexFormatStride(pool->mFormat);
+
+    bool grown = false;
+    ReserveRange(&pool->mVertexAllocator, &pool->mVertexBufferObject, stride, vertexCount, &grown);
+    ReserveRange(&pool->mIndexAllocator, &pool->mIndexBufferObject, sizeof(GLuint), indexCount, &grown);
+    if (grown) {
+        // The VAO still references the old buffers
+        GeometryPoolVertexSpecification(pool);
+    }
+
+    GeometryAllocation allocation;
+    RangeAllocatorAllocate(&pool->mVertexAllocator, vertexCount, &allocation.mBaseVertex);
+    RangeAllocatorAllocate(&pool->mIndexAllocator, indexCount, &allocation.mFirstIndex);
+    allocation.mVertexCount = vertexCount;
+    allocation.mIndexCount = indexCount;
+    allocation.mLive = true;
+
+    // Indices stay relative to the mesh, the base vertex offsets them at draw time
+    BufferUpload(pool->mVertexBufferObject, allocation.mBaseVertex * stride, vertexCount * stride,
+                 meshData.vertices.data());
+    BufferUpload(pool->mIndexBufferObject, allocation.mFirstIndex * sizeof(GLuint), indexCount * sizeof(GLuint),
+                 meshData.indices.data());
+
+    GeometryHandle handle;
+    if (!pool->mFreeHandles.empty()) {
+        handle = pool->mFreeHandles.back();
+        pool->mFreeHandles.pop_back();
+        pool->mAllocations[handle] = allocation;
+    } else {
+        handle = (GeometryHandle)pool->mAllocations.size();
+        pool->mAllocations.push_back(allocation);
+    }
+    return handle;
+}
+
+void GeometryPoolFree(GeometryPool* pool, GeometryHandle handle) {
+    GeometryAllocation& allocation = pool->mAllocations[handle];
+    if (!allocation.mLive) {
+        return;
+    }
+    RangeAllocatorFree(&pool->mVertexAllocator, allocation.mBaseVertex, allocation.mVertexCount);
+    RangeAllocatorFree(&pool->mIndexAllocator, allocation.mFirstIndex, allocation.mIndexCount);
+    allocation = GeometryAllocation();
+    pool->mFreeHandles.push_back(handle);
+}
+
+const GeometryAllocation& GeometryPoolGet(const GeometryPool& pool, GeometryHandle handle) {
+    return pool.mAllocations[handle];
+}
+
+GeometryDefragmentStats GeometryPoolDefragment(GeometryPool* pool) {
+    GLsizeiptr stride = VertexFormatStride(pool->mFormat);
+    GeometryDefragmentStats stats;
+    stats.mVertexFreeBlocks = (GLuint)pool->mVertexAllocator.mFreeBlocks.size();
+    stats.mIndexFreeBlocks = (GLuint)pool->mIndexAllocator.mFreeBlocks.size();
+
+    std::vector<GeometryHandle> live;
+    for (GeometryHandle handle = 0; handle < pool->mAllocations.size(); ++handle) {
+        if (pool->mAllocations[handle].mLive) {
+            live.push_back(handle);
+        }
+    }
+
+    // Copy every live range into fresh buffers, in their current order, without gaps.
+    // Copies can't overlap this way, which glCopyBufferSubData does not allow.
+    GLuint vertexBuffer = ReallocateBuffer(0, 0, pool->mVertexAllocator.mCapacity * stride);
+    GLuint indexBuffer = ReallocateBuffer(0, 0, pool->mIndexAllocator.mCapacity * sizeof(GLuint));
+
+    std::sort(live.begin(), live.end(), [pool](GeometryHandle a, GeometryHandle b) {
+        return pool->mAllocations[a].mBaseVertex < pool->mAllocations[b].mBaseVertex;
+    });
+    GLuint vertexCursor = 0;
+    for (GeometryHandle handle : live) {
+        GeometryAllocation& allocation = pool->mAllocations[handle];
+        BufferCopy(pool->mVertexBufferObject, vertexBuffer, allocation.mBaseVertex * stride,
+                   vertexCursor * stride, allocation.mVertexCount * stride);
+        allocation.mBaseVertex = vertexCursor;
+        vertexCursor += allocation.mVertexCount;
+    }
+
+    std::sort(live.begin(), live.end(), [pool](GeometryHandle a, GeometryHandle b) {
+        return pool->mAllocations[a].mFirstIndex < pool->mAllocations[b].mFirstIndex;
+    });
+    GLuint indexCursor = 0;
+    for (GeometryHandle handle : live) {
+        GeometryAllocation& allocation = pool->mAllocations[handle];
+        BufferCopy(pool->mIndexBufferObject, indexBuffer, allocation.mFirstIndex * sizeof(GLuint),
+                   indexCursor * sizeof(GLuint), allocation.mIndexCount * sizeof(GLuint));
+        allocation.mFirstIndex = indexCursor;
+        indexCursor += allocation.mIndexCount;
+    }
+
+    glDeleteBuffers(1, &pool->mVertexBufferObject);
+    glDeleteBuffers(1, &pool->mIndexBufferObject);
+    pool->mVertexBufferObject = vertexBuffer;
+    pool->mIndexBufferObject = indexBuffer;
+
+    // Everything past the packed data is one free block again
+    CreateRangeAllocator(&pool->mVertexAllocator, pool->mVertexAllocator.mCapacity);
+    CreateRangeAllocator(&pool->mIndexAllocator, pool->mIndexAllocator.mCapacity);
+    GLuint unused;
+    RangeAllocatorAllocate(&pool->mVertexAllocator, vertexCursor, &unused);
+    RangeAllocatorAllocate(&pool->mIndexAllocator, indexCursor, &unused);
+
+    GeometryPoolVertexSpecification(pool);
+
+    stats.mAllocations = (GLuint)live.size();
+    stats.mVertices = vertexCursor;
+    stats.mIndices = indexCursor;
+    return stats;
+}
+
+void GeometryPoolDraw(const GeometryPool& pool, GeometryHandle handle) {
+    const GeometryAllocation& allocation = pool.mAllocations[handle];
+    glDrawElementsBaseVertex(GL_TRIANGLES, allocation.mIndexCount, GL_UNSIGNED_INT,
+                             (GLvoid*)(allocation.mFirstIndex * sizeof(GLuint)),
+                             allocation.mBaseVertex);
+}
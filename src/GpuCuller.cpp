@@ -0,0 +1,271 @@
+#include "GpuCuller.hpp"
+#include "Culling.hpp"
+#include "CpuProfiler.hpp"
+#include "Graphics.hpp"
+
+#include <algorithm>
+
+bool GpuCullingSupported() {
+    GLint major = 0, minor = 0;
+    glGetIntegerv(GL_MAJOR_VERSION, &major);
+    glGetIntegerv(GL_MINOR_VERSION, &minor);
+    if (major < 4 || (major == 4 && minor < 3)) {
+        return false;
+    }
+    // glad is generated for 4.1, the 4.3 entry points are loaded through these
+    return GLAD_GL_ARB_compute_shader && GLAD_GL_ARB_shader_storage_buffer_object &&
+           GLAD_GL_ARB_shader_image_load_store && GLAD_GL_ARB_multi_draw_indirect &&
+           GLAD_GL_ARB_base_instance && GLAD_GL_ARB_texture_storage;
+}
+
+static Pipeline LoadComputeProgram(ShaderLibrary* shaderLibrary, const std::string& path) {
+    const PreprocessedShader& shader = ShaderLibraryGet(shaderLibrary, path, ShaderDefines());
+    return CreateComputeProgram(shader.mSource, path);
+}
+
+static GLint HiZLevelCount(int width, int height) {
+    GLint levels = 1;
+    for (int size = std::max(width / 2, height / 2); size > 1; size /= 2) {
+        levels++;
+    }
+    return levels;
+}
+
+void CreateGpuCuller(GpuCuller* culler, const GeometryPool* pool, const Pipeline* pipeline,
+                     ShaderLibrary* shaderLibrary, int width, int height) {
+    culler->mPool = pool;
+    culler->mPipeline = pipeline;
+    culler->mCullProgram = LoadComputeProgram(shaderLibrary, SHADER_DIRECTORY "/cull.comp.glsl");
+    culler->mHiZProgram = LoadComputeProgram(shaderLibrary, SHADER_DIRECTORY "/hiz.comp.glsl");
+    culler->mObjectCountUniform = PipelineGetUniform<GLint>(culler->mCullProgram, "u_ObjectCount");
+    culler->mPlanesLocation = FindUniformLocation(culler->mCullProgram, "u_Planes");
+    culler->mHiZLevelsUniform = PipelineGetUniform<GLint>(culler->mCullProgram, "u_HiZLevels");
+    culler->mHiZViewProjectionUniform = PipelineGetUniform<glm::mat4>(culler->mCullProgram, "u_HiZViewProjection");
+    culler->mScreenSizeUniform = PipelineGetUniform<glm::vec2>(culler->mCullProgram, "u_ScreenSize");
+    culler->mSourceLevelUniform = PipelineGetUniform<GLint>(culler->mHiZProgram, "u_SourceLevel");
+
+    // Level 0 of the pyramid is half the screen, levels round down
+    culler->mWidth = width;
+    culler->mHeight = height;
+    culler->mHiZLevels = HiZLevelCount(width, height);
+    glGenTextures(1, &culler->mDepthTexture);
+    glBindTexture(GL_TEXTURE_2D, culler->mDepthTexture);
+    glTexStorage2D(GL_TEXTURE_2D, 1, GL_DEPTH_COMPONENT24, width, height);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glGenTextures(1, &culler->mHiZTexture);
+    glBindTexture(GL_TEXTURE_2D, culler->mHiZTexture);
+    glTexStorage2D(GL_TEXTURE_2D, culler->mHiZLevels, GL_R32F, std::max(width / 2, 1), std::max(height / 2, 1));
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    culler->mReadbackBuffer = CreateStaticBuffer(GPU_CULL_READBACK_FRAMES * 2 * sizeof(GLuint), nullptr, false);
+    culler->mVertexArrayObject = CreateVertexArray();
+}
+
+void DestroyGpuCuller(GpuCuller* culler) {
+    GLuint buffers[] = { culler->mObjectBuffer, culler->mObjectDrawBuffer, culler->mDrawSphereBuffer,
+                         culler->mCommandBuffer, culler->mVisibleBuffer, culler->mCounterBuffer,
+                         culler->mReadbackBuffer };
+    glDeleteBuffers(sizeof(buffers) / sizeof(buffers[0]), buffers);
+    for (GLsync fence : culler->mReadbackFences) {
+        if (fence != nullptr) {
+            glDeleteSync(fence);
+        }
+    }
+    glDeleteTextures(1, &culler->mDepthTexture);
+    glDeleteTextures(1, &culler->mHiZTexture);
+    glDeleteVertexArrays(1, &culler->mVertexArrayObject);
+    glDeleteProgram(culler->mCullProgram.mProgram);
+    glDeleteProgram(culler->mHiZProgram.mProgram);
+    *culler = GpuCuller();
+}
+
+uint32_t GpuCullerAddDraw(GpuCuller* culler, GeometryHandle geometry, const glm::vec4& localSphere,
+                          const InstanceData* instances, uint32_t count) {
+    GpuCullDraw draw;
+    draw.mGeometry = geometry;
+    draw.mSphere = localSphere;
+    draw.mFirstObject = culler->mObjectCount;
+    draw.mObjectCount = count;
+    culler->mInitialObjects.insert(culler->mInitialObjects.end(), instances, instances + count);
+    culler->mInitialObjectDraws.insert(culler->mInitialObjectDraws.end(), count, (GLuint)culler->mDraws.size());
+    culler->mDraws.push_back(draw);
+    culler->mObjectCount += count;
+    return draw.mFirstObject;
+}
+
+void GpuCullerFinalize(GpuCuller* culler) {
+    if (culler->mObjectCount == 0) {
+        return;
+    }
+    std::vector<glm::vec4> spheres;
+    for (const GpuCullDraw& draw : culler->mDraws) {
+        spheres.push_back(draw.mSphere);
+    }
+    GLsizeiptr objectsSize = culler->mObjectCount * sizeof(InstanceData);
+    culler->mObjectBuffer = CreateStaticBuffer(objectsSize, culler->mInitialObjects.data(), true);
+    culler->mObjectDrawBuffer = CreateStaticBuffer(culler->mObjectCount * sizeof(GLuint),
+                                                   culler->mInitialObjectDraws.data(), false);
+    culler->mDrawSphereBuffer = CreateStaticBuffer(spheres.size() * sizeof(glm::vec4), spheres.data(), false);
+    culler->mCommandBuffer = CreateStaticBuffer(culler->mDraws.size() * sizeof(DrawElementsIndirectCommand),
+                                                nullptr, true);
+    culler->mVisibleBuffer = CreateStaticBuffer(objectsSize, nullptr, false);
+    culler->mCounterBuffer = CreateStaticBuffer(2 * sizeof(GLuint), nullptr, true);
+    culler->mCommands.resize(culler->mDraws.size());
+    culler->mStats.mObjects = culler->mObjectCount;
+
+    culler->mInitialObjects.clear();
+    culler->mInitialObjects.shrink_to_fit();
+    culler->mInitialObjectDraws.clear();
+    culler->mInitialObjectDraws.shrink_to_fit();
+
+    // The instance attributes never move, baseInstance picks each draw's range
+    GLuint attributeCount = 0;
+    const VertexAttribute* attributes = InstanceDataAttributes(&attributeCount);
+    VertexArrayVertexBuffer(culler->mVertexArrayObject, INSTANCE_BUFFER_BINDING, culler->mVisibleBuffer, 0,
+                            sizeof(InstanceData), 1, attributes, attributeCount);
+}
+
+void GpuCullerUpdate(GpuCuller* culler, uint32_t first, const InstanceData* instances, uint32_t count) {
+    if (count > 0) {
+        BufferUpload(culler->mObjectBuffer, first * sizeof(InstanceData), count * sizeof(InstanceData), instances);
+    }
+}
+
+// (Re)points the VAO at the pool's current buffers
+static void GpuCullerVertexSpecification(GpuCuller* culler) {
+    const GeometryPool* pool = culler->mPool;
+    GLuint attributeCount = 0;
+    const VertexAttribute* attributes = VertexFormatAttributes(pool->mFormat, &attributeCount);
+    VertexArrayVertexBuffer(culler->mVertexArrayObject, 0, pool->mVertexBufferObject, 0,
+                            VertexFormatStride(pool->mFormat), 0, attributes, attributeCount);
+    VertexArrayIndexBuffer(culler->mVertexArrayObject, pool->mIndexBufferObject);
+    culler->mSpecifiedVertexBuffer = pool->mVertexBufferObject;
+    culler->mSpecifiedIndexBuffer = pool->mIndexBufferObject;
+}
+
+// Picks up the counters of the frame that last used this slot if they have
+// arrived, then copies this frame's into it
+static void GpuCullerReadback(GpuCuller* culler) {
+    uint32_t slot = culler->mFrame % GPU_CULL_READBACK_FRAMES;
+    GLintptr offset = slot * 2 * sizeof(GLuint);
+    GLsync& fence = culler->mReadbackFences[slot];
+    if (fence != nullptr) {
+        if (glClientWaitSync(fence, 0, 0) != GL_TIMEOUT_EXPIRED) {
+            GLuint counters[2] = {};
+            glBindBuffer(GL_COPY_READ_BUFFER, culler->mReadbackBuffer);
+            glGetBufferSubData(GL_COPY_READ_BUFFER, offset, sizeof(counters), counters);
+            glBindBuffer(GL_COPY_READ_BUFFER, 0);
+            culler->mStats.mCulled = counters[0];
+            culler->mStats.mOccluded = counters[1];
+            culler->mStats.mVisible = culler->mObjectCount - counters[0] - counters[1];
+        }
+        glDeleteSync(fence);
+    }
+    BufferCopy(culler->mCounterBuffer, culler->mReadbackBuffer, 0, offset, 2 * sizeof(GLuint));
+    fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+static void GpuCullerBuildHiZ(GpuCuller* culler) {
+    PipelineBind(culler->mHiZProgram);
+    glActiveTexture(GL_TEXTURE0);
+    // Level 0 reduces the depth buffer, every other level the one above it
+    GLuint source = culler->mDepthTexture;
+    GLint sourceLevel = 0;
+    for (GLint level = 0; level < culler->mHiZLevels; ++level) {
+        GLint width = std::max(culler->mWidth >> (level + 1), 1);
+        GLint height = std::max(culler->mHeight >> (level + 1), 1);
+        glBindTexture(GL_TEXTURE_2D, source);
+        SetUniform(culler->mSourceLevelUniform, sourceLevel);
+        glBindImageTexture(0, culler->mHiZTexture, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+        glDispatchCompute((width + GPU_HIZ_GROUP_SIZE - 1) / GPU_HIZ_GROUP_SIZE,
+                          (height + GPU_HIZ_GROUP_SIZE - 1) / GPU_HIZ_GROUP_SIZE, 1);
+        glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+        source = culler->mHiZTexture;
+        sourceLevel = level;
+    }
+    glBindImageTexture(0, 0, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+}
+
+void GpuCullerDraw(GpuCuller* culler, const glm::mat4& viewProjection, RenderStats* stats) {
+    PROFILE_FUNCTION();
+    if (culler->mObjectCount == 0) {
+        return;
+    }
+
+    // One command per draw with no instances yet, the cull pass counts them up
+    for (size_t i = 0; i < culler->mDraws.size(); ++i) {
+        const GpuCullDraw& draw = culler->mDraws[i];
+        const GeometryAllocation& allocation = GeometryPoolGet(*culler->mPool, draw.mGeometry);
+        DrawElementsIndirectCommand& command = culler->mCommands[i];
+        command.mCount = allocation.mIndexCount;
+        command.mInstanceCount = 0;
+        command.mFirstIndex = allocation.mFirstIndex;
+        command.mBaseVertex = (GLint)allocation.mBaseVertex;
+        command.mBaseInstance = draw.mFirstObject;
+    }
+    BufferUpload(culler->mCommandBuffer, 0, culler->mCommands.size() * sizeof(DrawElementsIndirectCommand),
+                 culler->mCommands.data());
+    GLuint zeros[2] = {};
+    BufferUpload(culler->mCounterBuffer, 0, sizeof(zeros), zeros);
+
+    if (culler->mHiZValid) {
+        GpuCullerBuildHiZ(culler);
+    }
+
+    Frustum frustum = ExtractFrustum(viewProjection);
+    PipelineBind(culler->mCullProgram);
+    SetUniform(culler->mObjectCountUniform, (GLint)culler->mObjectCount);
+    glProgramUniform4fv(culler->mCullProgram.mProgram, culler->mPlanesLocation, 6, &frustum.mPlanes[0].x);
+    SetUniform(culler->mHiZLevelsUniform, culler->mHiZValid ? culler->mHiZLevels : 0);
+    SetUniform(culler->mHiZViewProjectionUniform, culler->mHiZViewProjection);
+    SetUniform(culler->mScreenSizeUniform, glm::vec2((float)culler->mWidth, (float)culler->mHeight));
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, culler->mHiZTexture);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, culler->mObjectBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, culler->mObjectDrawBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, culler->mDrawSphereBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, culler->mCommandBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, culler->mVisibleBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, culler->mCounterBuffer);
+    glDispatchCompute((culler->mObjectCount + GPU_CULL_GROUP_SIZE - 1) / GPU_CULL_GROUP_SIZE, 1, 1);
+    // The draw reads what the shader wrote as commands and attributes, the readback copies it
+    glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+    for (GLuint binding = 0; binding < 6; ++binding) {
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, binding, 0);
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+    GpuCullerReadback(culler);
+
+    if (culler->mSpecifiedVertexBuffer != culler->mPool->mVertexBufferObject ||
+        culler->mSpecifiedIndexBuffer != culler->mPool->mIndexBufferObject) {
+        GpuCullerVertexSpecification(culler);
+    }
+    PipelineBind(*culler->mPipeline);
+    glBindVertexArray(culler->mVertexArrayObject);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, culler->mCommandBuffer);
+    glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, nullptr, (GLsizei)culler->mCommands.size(), 0);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    glBindVertexArray(0);
+    glUseProgram(0);
+
+    // Triangles are only known on the GPU
+    if (stats != nullptr) {
+        stats->mDrawCalls++;
+        stats->mProgramBinds += culler->mHiZValid ? 3 : 2;
+        stats->mVertexArrayBinds++;
+    }
+    culler->mFrame++;
+}
+
+void GpuCullerEndFrame(GpuCuller* culler, const glm::mat4& viewProjection) {
+    PROFILE_FUNCTION();
+    // Straight from whatever framebuffer is bound for reading, the window's or the headless one
+    glBindTexture(GL_TEXTURE_2D, culler->mDepthTexture);
+    glCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 0, 0, culler->mWidth, culler->mHeight);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    culler->mHiZViewProjection = viewProjection;
+    culler->mHiZValid = true;
+}
@@ -0,0 +1,195 @@
+#include "GpuProfiler.hpp"
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+
+void CreateGpuProfiler(GpuProfiler* profiler, bool enabled) {
+    *profiler = GpuProfiler();
+    profiler->mEnabled = enabled;
+}
+
+static void ReleaseFrameQueries(GpuProfiler* profiler, const GpuProfilerFrame& frame) {
+    for (const GpuZoneQuery& query : frame.mQueries) {
+        profiler->mFreeQueries.push_back(query.mBegin);
+        if (query.mEnd != 0) {
+            profiler->mFreeQueries.push_back(query.mEnd);
+        }
+    }
+}
+
+void DestroyGpuProfiler(GpuProfiler* profiler) {
+    for (const GpuProfilerFrame& frame : profiler->mFrames) {
+        ReleaseFrameQueries(profiler, frame);
+    }
+    if (!profiler->mFreeQueries.empty()) {
+        glDeleteQueries((GLsizei)profiler->mFreeQueries.size(), profiler->mFreeQueries.data());
+    }
+    *profiler = GpuProfiler();
+}
+
+static GLuint AcquireQuery(GpuProfiler* profiler) {
+    if (profiler->mFreeQueries.empty()) {
+        // Grow in batches, zones are usually opened many times per frame
+        GLuint queries[32];
+        glGenQueries(32, queries);
+        profiler->mFreeQueries.insert(profiler->mFreeQueries.end(), queries, queries + 32);
+        profiler->mQueryCount += 32;
+    }
+    GLuint query = profiler->mFreeQueries.back();
+    profiler->mFreeQueries.pop_back();
+    return query;
+}
+
+// Timestamps complete in order, so the frame is done once the last one issued is
+static bool FrameAvailable(const GpuProfilerFrame& frame) {
+    if (frame.mLastQuery == 0) {
+        return true;
+    }
+    GLuint available = GL_FALSE;
+    glGetQueryObjectuiv(frame.mLastQuery, GL_QUERY_RESULT_AVAILABLE, &available);
+    return available == GL_TRUE;
+}
+
+static void AddSample(GpuZone* zone, uint32_t window, double milliseconds) {
+    if (zone->mSamples.size() < window) {
+        zone->mSamples.push_back(milliseconds);
+    } else {
+        zone->mSamples[zone->mNextSample] = milliseconds;
+    }
+    zone->mNextSample = (zone->mNextSample + 1) % window;
+}
+
+// Reads the frame's results (blocking if they are not there yet) and returns its queries to the pool
+static void ResolveFrame(GpuProfiler* profiler, const GpuProfilerFrame& frame) {
+    std::vector<double> totals(profiler->mZones.size(), -1.0);
+    for (const GpuZoneQuery& query : frame.mQueries) {
+        GLuint64 begin = 0, end = 0;
+        glGetQueryObjectui64v(query.mBegin, GL_QUERY_RESULT, &begin);
+        glGetQueryObjectui64v(query.mEnd, GL_QUERY_RESULT, &end);
+        double milliseconds = end > begin ? (end - begin) / 1.0e6 : 0.0;
+        totals[query.mZone] = std::max(totals[query.mZone], 0.0) + milliseconds;
+    }
+    for (size_t i = 0; i < totals.size(); ++i) {
+        if (totals[i] >= 0.0) {
+            AddSample(&profiler->mZones[i], profiler->mWindow, totals[i]);
+        }
+    }
+    ReleaseFrameQueries(profiler, frame);
+}
+
+static void CloseOpenZones(GpuProfiler* profiler) {
+    while (!profiler->mOpenZones.empty()) {
+        GpuProfilerEndZone(profiler);
+    }
+}
+
+void GpuProfilerBeginFrame(GpuProfiler* profiler) {
+    if (!profiler->mEnabled) {
+        return;
+    }
+    if (!profiler->mOpenZones.empty()) {
+        std::cout << "GPU profiler: " << profiler->mOpenZones.size() << " zones left open last frame" << std::endl;
+        CloseOpenZones(profiler);
+    }
+
+    while (!profiler->mFrames.empty() && FrameAvailable(profiler->mFrames.front())) {
+        ResolveFrame(profiler, profiler->mFrames.front());
+        profiler->mFrames.pop_front();
+    }
+    // The GPU is too far behind, lose those results rather than wait for them
+    while (profiler->mFrames.size() >= GPU_PROFILER_MAX_PENDING) {
+        ReleaseFrameQueries(profiler, profiler->mFrames.front());
+        profiler->mFrames.pop_front();
+        profiler->mDroppedFrames++;
+    }
+
+    profiler->mFrames.push_back(GpuProfilerFrame());
+}
+
+void GpuProfilerBeginZone(GpuProfiler* profiler, const char* name) {
+    if (!profiler->mEnabled || profiler->mFrames.empty()) {
+        return;
+    }
+
+    uint32_t zone = 0;
+    auto it = profiler->mZoneIds.find(name);
+    if (it == profiler->mZoneIds.end()) {
+        zone = (uint32_t)profiler->mZones.size();
+        GpuZone newZone;
+        newZone.mName = name;
+        newZone.mDepth = (uint32_t)profiler->mOpenZones.size();
+        profiler->mZones.push_back(newZone);
+        profiler->mZoneIds[name] = zone;
+    } else {
+        zone = it->second;
+    }
+
+    GpuProfilerFrame& frame = profiler->mFrames.back();
+    GpuZoneQuery query;
+    query.mZone = zone;
+    query.mBegin = AcquireQuery(profiler);
+    glQueryCounter(query.mBegin, GL_TIMESTAMP);
+    frame.mLastQuery = query.mBegin;
+    profiler->mOpenZones.push_back(frame.mQueries.size());
+    frame.mQueries.push_back(query);
+}
+
+void GpuProfilerEndZone(GpuProfiler* profiler) {
+    if (!profiler->mEnabled || profiler->mOpenZones.empty()) {
+        return;
+    }
+    GpuProfilerFrame& frame = profiler->mFrames.back();
+    GpuZoneQuery& query = frame.mQueries[profiler->mOpenZones.back()];
+    profiler->mOpenZones.pop_back();
+    query.mEnd = AcquireQuery(profiler);
+    glQueryCounter(query.mEnd, GL_TIMESTAMP);
+    frame.mLastQuery = query.mEnd;
+}
+
+void GpuProfilerFlush(GpuProfiler* profiler) {
+    CloseOpenZones(profiler);
+    for (const GpuProfilerFrame& frame : profiler->mFrames) {
+        ResolveFrame(profiler, frame);
+    }
+    profiler->mFrames.clear();
+}
+
+void GpuProfilerReset(GpuProfiler* profiler) {
+    for (GpuZone& zone : profiler->mZones) {
+        zone.mSamples.clear();
+        zone.mNextSample = 0;
+    }
+    profiler->mDroppedFrames = 0;
+}
+
+bool GpuProfilerGetStats(const GpuProfiler& profiler, const char* name, TimingStats* stats) {
+    auto it = profiler.mZoneIds.find(name);
+    if (it == profiler.mZoneIds.end() || profiler.mZones[it->second].mSamples.empty()) {
+        return false;
+    }
+    *stats = ComputeTimingStats(profiler.mZones[it->second].mSamples);
+    return true;
+}
+
+void GpuProfilerLog(const GpuProfiler& profiler) {
+    if (!profiler.mEnabled) {
+        return;
+    }
+    std::streamsize precision = std::cout.precision();
+    std::cout << "GPU zones in ms (mean / p95 / max):" << std::endl;
+    for (const GpuZone& zone : profiler.mZones) {
+        TimingStats stats;
+        if (!GpuProfilerGetStats(profiler, zone.mName.c_str(), &stats)) {
+            continue;
+        }
+        std::cout << "  " << std::string(zone.mDepth * 2, ' ') << std::left << std::setw(20 - (int)std::min(zone.mDepth * 2, 10u)) << zone.mName <<
+                     std::right << std::fixed << std::setprecision(3) <<
+                     stats.mMean << " / " << stats.mP95 << " / " << stats.mMax <<
+                     std::defaultfloat << "  (" << stats.mSamples << " frames)" << std::endl;
+    }
+    std::cout.precision(precision);
+    if (profiler.mDroppedFrames > 0) {
+        std::cout << "  " << profiler.mDroppedFrames << " frames dropped waiting for results" << std::endl;
+    }
+}
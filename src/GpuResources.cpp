@@ -0,0 +1,113 @@
+#include "GpuResources.hpp"
+
+bool GpuHasDirectStateAccess() {
+    return GLAD_GL_ARB_direct_state_access != 0;
+}
+
+GLuint CreateBuffer() {
+    GLuint buffer = 0;
+    if (GpuHasDirectStateAccess()) {
+        glCreateBuffers(1, &buffer);
+    } else {
+        glGenBuffers(1, &buffer);
+    }
+    return buffer;
+}
+
+GLuint CreateStaticBuffer(GLsizeiptr size, const void* data, bool dynamic) {
+    GLuint buffer = CreateBuffer();
+    if (GpuHasDirectStateAccess()) {
+        // Immutable storage, the driver knows it will never be reallocated
+        glNamedBufferStorage(buffer, size, data, dynamic ? GL_DYNAMIC_STORAGE_BIT : 0);
+    } else {
+        // The copy targets are not used for drawing, so binding to them disturbs nothing
+        glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+        glBufferData(GL_COPY_WRITE_BUFFER, size, data, GL_STATIC_DRAW);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    }
+    return buffer;
+}
+
+void BufferRespecify(GLuint buffer, GLsizeiptr size, const void* data, GLenum usage) {
+    if (GpuHasDirectStateAccess()) {
+        glNamedBufferData(buffer, size, data, usage);
+    } else {
+        glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+        glBufferData(GL_COPY_WRITE_BUFFER, size, data, usage);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    }
+}
+
+void BufferUpload(GLuint buffer, GLintptr offset, GLsizeiptr size, const void* data) {
+    if (GpuHasDirectStateAccess()) {
+        glNamedBufferSubData(buffer, offset, size, data);
+    } else {
+        glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, offset, size, data);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    }
+}
+
+void BufferCopy(GLuint source, GLuint destination, GLintptr sourceOffset, GLintptr destinationOffset,
+                GLsizeiptr size) {
+    if (GpuHasDirectStateAccess()) {
+        glCopyNamedBufferSubData(source, destination, sourceOffset, destinationOffset, size);
+    } else {
+        glBindBuffer(GL_COPY_READ_BUFFER, source);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, destination);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, sourceOffset, destinationOffset, size);
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    }
+}
+
+GLuint CreateVertexArray() {
+    GLuint vertexArray = 0;
+    if (GpuHasDirectStateAccess()) {
+        glCreateVertexArrays(1, &vertexArray);
+    } else {
+        glGenVertexArrays(1, &vertexArray);
+    }
+    return vertexArray;
+}
+
+void VertexArrayVertexBuffer(GLuint vertexArray, GLuint binding, GLuint buffer, GLintptr offset, GLsizei stride,
+                             GLuint divisor, const VertexAttribute* attributes, GLuint attributeCount) {
+    if (GpuHasDirectStateAccess()) {
+        glVertexArrayVertexBuffer(vertexArray, binding, buffer, offset, stride);
+        glVertexArrayBindingDivisor(vertexArray, binding, divisor);
+        for (GLuint i = 0; i < attributeCount; ++i) {
+            const VertexAttribute& attribute = attributes[i];
+            glVertexArrayAttribFormat(vertexArray, attribute.mLocation, attribute.mComponents, attribute.mType,
+                                      false, attribute.mOffset);
+            glVertexArrayAttribBinding(vertexArray, attribute.mLocation, binding);
+            glEnableVertexArrayAttrib(vertexArray, attribute.mLocation);
+        }
+        return;
+    }
+
+    glBindVertexArray(vertexArray);
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    for (GLuint i = 0; i < attributeCount; ++i) {
+        const VertexAttribute& attribute = attributes[i];
+        glEnableVertexAttribArray(attribute.mLocation);
+        glVertexAttribPointer(attribute.mLocation, attribute.mComponents, attribute.mType, false, stride,
+                              (GLvoid*)(offset + attribute.mOffset));
+        glVertexAttribDivisor(attribute.mLocation, divisor);
+    }
+    // Unbind the VAO first, the attributes above belong to it and stay enabled
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void VertexArrayIndexBuffer(GLuint vertexArray, GLuint buffer) {
+    if (GpuHasDirectStateAccess()) {
+        glVertexArrayElementBuffer(vertexArray, buffer);
+        return;
+    }
+
+    // The element buffer binding is part of the VAO, so it must not be unbound before the VAO is
+    glBindVertexArray(vertexArray);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffer);
+    glBindVertexArray(0);
+}
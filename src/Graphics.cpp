@@ -1,45 +1,230 @@
 #include "Graphics.hpp"
 #include "App.hpp"
+#include "CpuProfiler.hpp"
 
+#include <chrono>
 #include <glm/gtc/matrix_transform.hpp>
 #include <iostream>
 
+// Drawn while the real pipelines compile, flat grey so it is obvious
+static const char* FALLBACK_VERTEX_SOURCE = R"(#version 410 core
+layout(std140) uniform PerFrame {
+    mat4 u_ViewMatrix;
+    mat4 u_Perspective;
+    mat4 u_ViewProjection;
+    vec4 u_CameraPosition;
+    float u_Time;
+};
+layout(std140) uniform PerObject {
+    mat4 u_ModelMatrix;
+};
+layout(location=0) in vec3 position;
+void main() {
+    gl_Position = u_ViewProjection * u_ModelMatrix * vec4(position, 1.0f);
+}
+)";
+
+static const char* FALLBACK_INSTANCED_VERTEX_SOURCE = R"(#version 410 core
+layout(std140) uniform PerFrame {
+    mat4 u_ViewMatrix;
+    mat4 u_Perspective;
+    mat4 u_ViewProjection;
+    vec4 u_CameraPosition;
+    float u_Time;
+};
+layout(location=0) in vec3 position;
+layout(location=2) in mat4 instanceModelMatrix;
+void main() {
+    gl_Position = u_ViewProjection * instanceModelMatrix * vec4(position, 1.0f);
+}
+)";
+
+static const char* FALLBACK_FRAGMENT_SOURCE = R"(#version 410 core
+out vec4 color;
+void main() {
+    color = vec4(0.5f, 0.5f, 0.5f, 1.0f);
+}
+)";
+
+// Registers pipeline with the app's resources and makes target share it
+static void SetFallbackPipeline(App* app, Pipeline* fallback, Pipeline* target, const char* vertexSource) {
+    *fallback = CreateShaderProgram(vertexSource, FALLBACK_FRAGMENT_SOURCE);
+    fallback->mHandle = ResourceManagerRegister(&app->mResources, ResourceType::Program, fallback->mProgram);
+    *target = *fallback;
+    ResourceManagerAddRef(&app->mResources, target->mHandle);
+}
+
+// Builds the vert.glsl/frag.glsl permutation for defines and keeps it hot-reloadable
+static void SubmitShaderProgram(App* app, const std::string& name, const ShaderDefines& defines, Pipeline* target) {
+    const std::string vertexPath = SHADER_DIRECTORY "/vert.glsl";
+    const std::string fragmentPath = SHADER_DIRECTORY "/frag.glsl";
+    const PreprocessedShader& vertex = ShaderLibraryGet(&app->mShaderLibrary, vertexPath, defines);
+    const PreprocessedShader& fragment = ShaderLibraryGet(&app->mShaderLibrary, fragmentPath, defines);
+    if (vertex.mValid && fragment.mValid) {
+        PipelineBuilderSubmit(&app->mPipelineBuilder, name, vertex.mSource, fragment.mSource, target);
+    }
+    ShaderHotReloadWatch(&app->mShaderHotReload, name, vertexPath, defines, fragmentPath, defines, target);
+}
+
 void CreateGraphicsPipeline(App* app) {
-    std::string vertexShaderSource = LoadShaderAsString("./shaders/vert.glsl");
-    std::string fragmentShaderSource = LoadShaderAsString("./shaders/frag.glsl");
-    app->mGraphicsPipelineShaderProgram = CreateShaderProgram(vertexShaderSource, fragmentShaderSource);
+    PROFILE_FUNCTION();
+    LoadProgramCache(&app->mProgramCache, PROGRAM_CACHE_PATH);
+
+    // The fallbacks are tiny, compiling them synchronously costs next to nothing
+    SetFallbackPipeline(app, &app->mFallbackPipeline, &app->mGraphicsPipeline, FALLBACK_VERTEX_SOURCE);
+    SetFallbackPipeline(app, &app->mFallbackInstancedPipeline, &app->mInstancedPipeline,
+                        FALLBACK_INSTANCED_VERTEX_SOURCE);
+
+    CreatePipelineBuilder(&app->mPipelineBuilder, &app->mProgramCache, &app->mResources);
+    CreateProgramPipelineCache(&app->mProgramPipelines, &app->mResources);
+    if (app->mSeparableStages) {
+        app->mPipelineBuilder.mProgramPipelines = &app->mProgramPipelines;
+    }
+
+    // Both pipelines are permutations of the same files
+    SubmitShaderProgram(app, "graphics", PermutationDefines(false, VertexFormat::PositionColor),
+                        &app->mGraphicsPipeline);
+    SubmitShaderProgram(app, "instanced", PermutationDefines(true, VertexFormat::PositionColor),
+                        &app->mInstancedPipeline);
+
+    // Everything came from the cache
+    if (PipelineBuilderIdle(app->mPipelineBuilder)) {
+        ProgramCacheSave(&app->mProgramCache, false);
+    }
+}
+
+bool CheckShaderCompileStatus(GLuint shader, const std::string& label) {
+    GLint compiled = GL_FALSE;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &compiled);
+    if (compiled == GL_TRUE) {
+        return true;
+    }
+    GLint length = 0;
+    glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &length);
+    std::string log(length > 0 ? length : 1, '\0');
+    glGetShaderInfoLog(shader, (GLsizei)log.size(), nullptr, &log[0]);
+    std::cout << "Failed to compile " << label << ":\n" << log.c_str() << std::endl;
+    return false;
 }
 
-GLuint CreateShaderProgram(const std::string& vertexshadersource, const std::string& fragmentshadersource) {
+bool CheckProgramLinkStatus(GLuint program, const std::string& label) {
+    GLint linked = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &linked);
+    if (linked == GL_TRUE) {
+        return true;
+    }
+    GLint length = 0;
+    glGetProgramiv(program, GL_INFO_LOG_LENGTH, &length);
+    std::string log(length > 0 ? length : 1, '\0');
+    glGetProgramInfoLog(program, (GLsizei)log.size(), nullptr, &log[0]);
+    std::cout << "Failed to link " << label << ":\n" << log.c_str() << std::endl;
+    return false;
+}
+
+Pipeline CreatePipelineFromProgram(GLuint program) {
+    // Query every active uniform and attribute once, so drawing never has to
+    Pipeline pipeline;
+    pipeline.mProgram = program;
+    PipelineReflect(&pipeline);
+    PipelineBindUniformBlock(&pipeline, PER_FRAME_BLOCK_NAME, PER_FRAME_BINDING);
+    PipelineBindUniformBlock(&pipeline, PER_OBJECT_BLOCK_NAME, PER_OBJECT_BINDING);
+    return pipeline;
+}
+
+// Synchronous path, blocks until the program is linked
+Pipeline CreateShaderProgram(const std::string& vertexshadersource, const std::string& fragmentshadersource,
+                             ProgramCache* cache) {
     GLuint programObject = glCreateProgram();
 
-    GLuint myVertexShader = CompileShader(GL_VERTEX_SHADER, vertexshadersource);
-    GLuint myFragmentShader = CompileShader(GL_FRAGMENT_SHADER, fragmentshadersource);
+    // A cached binary skips compiling and linking entirely
+    uint64_t cacheKey = 0;
+    bool cached = false;
+    if (cache != nullptr) {
+        cacheKey = ProgramCacheKey(*cache, vertexshadersource, fragmentshadersource, "");
+        cached = ProgramCacheLoad(cache, cacheKey, programObject);
+    }
 
-    glAttachShader(programObject, myVertexShader);
-    glAttachShader(programObject, myFragmentShader);
-    glLinkProgram(programObject);
+    if (!cached) {
+        GLuint myVertexShader = CompileShader(GL_VERTEX_SHADER, vertexshadersource);
+        GLuint myFragmentShader = CompileShader(GL_FRAGMENT_SHADER, fragmentshadersource);
+        CheckShaderCompileStatus(myVertexShader, "vertex shader");
+        CheckShaderCompileStatus(myFragmentShader, "fragment shader");
+
+        glAttachShader(programObject, myVertexShader);
+        glAttachShader(programObject, myFragmentShader);
+        if (cache != nullptr) {
+            glProgramParameteri(programObject, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        }
+        glLinkProgram(programObject);
+
+        // Once our final program Object has been created, Detach and Delete the shaders.
+        glDetachShader(programObject, myVertexShader);
+        glDetachShader(programObject, myFragmentShader);
+
+        glDeleteShader(myVertexShader);
+        glDeleteShader(myFragmentShader);
+
+        if (CheckProgramLinkStatus(programObject, "program") && cache != nullptr) {
+            ProgramCacheStore(cache, cacheKey, programObject);
+        }
+    }
 
-    glValidateProgram(programObject);
-    
-    // Once our final program Object has been created, Detach and Delete the shaders.
-    glDetachShader(programObject, myVertexShader);
-    glDetachShader(programObject, myFragmentShader);
+    Pipeline pipeline = CreatePipelineFromProgram(programObject);
+    pipeline.mCacheKey = cacheKey;
+    return pipeline;
+}
 
-    glDeleteShader(myVertexShader);
-    glDeleteShader(myFragmentShader);
+// Synchronous and uncached, compute programs are few and small
+Pipeline CreateComputeProgram(const std::string& computeshadersource, const std::string& label) {
+    GLuint programObject = glCreateProgram();
+    GLuint computeShader = CompileShader(GL_COMPUTE_SHADER, computeshadersource);
+    CheckShaderCompileStatus(computeShader, label);
+    glAttachShader(programObject, computeShader);
+    glLinkProgram(programObject);
+    glDetachShader(programObject, computeShader);
+    glDeleteShader(computeShader);
+    CheckProgramLinkStatus(programObject, label);
+    return CreatePipelineFromProgram(programObject);
+}
 
-    return programObject;
+// Also synchronous and uncached, the varyings have to be set before linking
+Pipeline CreateFeedbackProgram(const std::string& vertexshadersource, const std::string& geometryshadersource,
+                               const char* const* varyings, GLsizei varyingCount, const std::string& label) {
+    GLuint programObject = glCreateProgram();
+    GLuint vertexShader = CompileShader(GL_VERTEX_SHADER, vertexshadersource);
+    CheckShaderCompileStatus(vertexShader, label + " (vertex)");
+    glAttachShader(programObject, vertexShader);
+    GLuint geometryShader = 0;
+    if (!geometryshadersource.empty()) {
+        geometryShader = CompileShader(GL_GEOMETRY_SHADER, geometryshadersource);
+        CheckShaderCompileStatus(geometryShader, label + " (geometry)");
+        glAttachShader(programObject, geometryShader);
+    }
+    glTransformFeedbackVaryings(programObject, varyingCount, varyings, GL_INTERLEAVED_ATTRIBS);
+    glLinkProgram(programObject);
+    glDetachShader(programObject, vertexShader);
+    glDeleteShader(vertexShader);
+    if (geometryShader != 0) {
+        glDetachShader(programObject, geometryShader);
+        glDeleteShader(geometryShader);
+    }
+    CheckProgramLinkStatus(programObject, label);
+    return CreatePipelineFromProgram(programObject);
 }
 
+// Only issues the compile, check the result with CheckShaderCompileStatus
 GLuint CompileShader(GLuint type, const std::string& source) {
-    GLuint shaderObject;
+    GLuint shaderObject = 0;
 
     // Making sure the type for debug
     if (type == GL_VERTEX_SHADER) {
         shaderObject = glCreateShader(GL_VERTEX_SHADER);
     } else if (type == GL_FRAGMENT_SHADER) {
         shaderObject = glCreateShader(GL_FRAGMENT_SHADER);
+    } else if (type == GL_GEOMETRY_SHADER) {
+        shaderObject = glCreateShader(GL_GEOMETRY_SHADER);
+    } else if (type == GL_COMPUTE_SHADER) {
+        shaderObject = glCreateShader(GL_COMPUTE_SHADER);
     }
 
     const char* src = source.c_str();
@@ -49,101 +234,65 @@ GLuint CompileShader(GLuint type, const std::string& source) {
     return shaderObject;
 }
 
-void MeshDataVertexSpecification(Mesh3D* mesh, const MeshData& meshData) {
-    
-    // Setting things up on the GPU
-    glGenVertexArrays(1, &mesh->mVertexArrayObject);
-    glBindVertexArray(mesh->mVertexArrayObject);
-
-    // Generating VBO 
-    glGenBuffers(1, &mesh->mVertexBufferObject);
-    glBindBuffer(GL_ARRAY_BUFFER, mesh->mVertexBufferObject);
-    glBufferData(GL_ARRAY_BUFFER,                   // Kind of buffer
-                meshData.vertices.size()*sizeof(Vertex),// Size of data in bytes
-                meshData.vertices.data(),                  // Raw array of data
-                GL_STATIC_DRAW);                    // Intend to use the data
-
-
-    // Setting up Index Buffer Object (IBO)
-    glGenBuffers(1, &mesh->mIndexBufferObject);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER,
-                 mesh->mIndexBufferObject);
-    // Populate the Index Buffer
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER,
-                 meshData.indices.size()*sizeof(GLuint),
-                 meshData.indices.data(),
-                 GL_STATIC_DRAW);
-
-
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0,        // Attribute 0 corresponds to the enabledVertexAttribArray
-                          3,        // The number of components
-                          GL_FLOAT, // Type
-                          false, // is the data normalized
-                          sizeof(Vertex),        // stride (gap between data)
-                          (GLvoid*)offsetof(Vertex, x));// offset
-
-    // Linking attribs in VBO
-    // Color information
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 
-                          3, // r,g,b (that's why 3) 
-                          GL_FLOAT, 
-                          false, 
-                          sizeof(GLfloat)*6, 
-                          (GLvoid*)(sizeof(GLfloat)*3));
-    
+void MeshDataVertexSpecification(Mesh3D* mesh, ResourceManager* resources, const MeshData& meshData) {
+    PROFILE_FUNCTION();
+    // Vertex and index data never change once loaded
+    mesh->mVertexBufferObject = CreateStaticBuffer(meshData.vertices.size() * sizeof(Vertex),
+                                                   meshData.vertices.data(), false);
+    mesh->mIndexBufferObject = CreateStaticBuffer(meshData.indices.size() * sizeof(GLuint),
+                                                  meshData.indices.data(), false);
+
+    // Linking attribs in VBO, position and color
+    GLuint attributeCount = 0;
+    const VertexAttribute* attributes = VertexFormatAttributes(VertexFormat::PositionColor, &attributeCount);
+    mesh->mVertexArrayObject = CreateVertexArray();
+    VertexArrayVertexBuffer(mesh->mVertexArrayObject, 0, mesh->mVertexBufferObject, 0,
+                            sizeof(Vertex), 0, attributes, attributeCount);
+    VertexArrayIndexBuffer(mesh->mVertexArrayObject, mesh->mIndexBufferObject);
+
     // Setting index count
     mesh->mIndexCount = static_cast<GLsizei>(meshData.indices.size());
+    mesh->mBoundingSphere = MeshDataBoundingSphere(meshData);
 
-    // Unbind current bound
-    glBindVertexArray(0);
-    // Disable any arttibutes as if deconstructor
-    glDisableVertexAttribArray(0);
-    glDisableVertexAttribArray(1);
+    mesh->mVertexArrayHandle = ResourceManagerRegister(resources, ResourceType::VertexArray, mesh->mVertexArrayObject);
+    mesh->mVertexBufferHandle = ResourceManagerRegister(resources, ResourceType::Buffer, mesh->mVertexBufferObject);
+    mesh->mIndexBufferHandle = ResourceManagerRegister(resources, ResourceType::Buffer, mesh->mIndexBufferObject);
 }
 
-void MeshSetPipeline(Mesh3D* mesh, GLuint pipeline) {
-    mesh->mPipeline = pipeline;
+void MeshRelease(Mesh3D* mesh, ResourceManager* resources) {
+    // Pool meshes hold invalid handles, releasing those does nothing
+    ResourceManagerRelease(resources, mesh->mVertexArrayHandle);
+    ResourceManagerRelease(resources, mesh->mVertexBufferHandle);
+    ResourceManagerRelease(resources, mesh->mIndexBufferHandle);
+    mesh->mVertexArrayObject = 0;
+    mesh->mVertexBufferObject = 0;
+    mesh->mIndexBufferObject = 0;
+    mesh->mVertexArrayHandle = ResourceHandle();
+    mesh->mVertexBufferHandle = ResourceHandle();
+    mesh->mIndexBufferHandle = ResourceHandle();
 }
 
-void MeshDraw(Mesh3D* mesh, App app) {
-    glUseProgram(mesh->mPipeline);
-
-    MeshRotateY(mesh, 0.5f, glm::vec3(0.0f, 1.0f, 0.0f));
-
-    GLint u_ModelMatrixLocation = FindUniformLocation(mesh->mPipeline, "u_ModelMatrix");
-    glUniformMatrix4fv(u_ModelMatrixLocation, 1, false, &mesh->mTransform.mModelMatrix[0][0]);
-
-    glm::mat4 view = app.mCamera.GetViewMatrix();
-
-    GLint u_ViewLocation = FindUniformLocation(mesh->mPipeline, "u_ViewMatrix");
-    glUniformMatrix4fv(u_ViewLocation, 1, false, &view[0][0]);
-
-    // Projection matrix (in perspective)
-    glm::mat4 perspective = app.mCamera.GetProjectionMatrix();
-
-    GLint u_ProjectionLocation = FindUniformLocation(mesh->mPipeline, "u_Perspective");
-    glUniformMatrix4fv(u_ProjectionLocation, 1, false, &perspective[0][0]);
+void MeshDataPoolSpecification(Mesh3D* mesh, GeometryPool* pool, const MeshData& meshData) {
+    PROFILE_FUNCTION();
+    mesh->mGeometryPool = pool;
+    mesh->mGeometry = GeometryPoolAllocate(pool, meshData);
+    mesh->mVertexArrayObject = pool->mVertexArrayObject;
+    mesh->mIndexCount = static_cast<GLsizei>(meshData.indices.size());
+    mesh->mBoundingSphere = MeshDataBoundingSphere(meshData);
+}
 
-    if (mesh == nullptr) {
-        return;
+// Issues the draw for a mesh whose VAO is already bound
+void MeshDrawElements(const Mesh3D* mesh) {
+    PROFILE_FUNCTION();
+    if (mesh->mGeometryPool != nullptr) {
+        GeometryPoolDraw(*mesh->mGeometryPool, mesh->mGeometry);
+    } else {
+        glDrawElements(GL_TRIANGLES, mesh->mIndexCount, GL_UNSIGNED_INT, 0);
     }
-
-    glBindVertexArray(mesh->mVertexArrayObject);
-    
-    glDrawElements(GL_TRIANGLES, mesh->mIndexCount, GL_UNSIGNED_INT, 0);
-
-    glUseProgram(0);
 }
 
-GLuint FindUniformLocation(GLuint pipeline, const GLchar* name) {
-    GLuint location = glGetUniformLocation(pipeline, name);
-    if (location < 0) {
-        std::cerr << "Could not find " << name << " maybe a misspelling" << std::endl;
-        exit(EXIT_FAILURE);
-    }
-    return location;
+void MeshSetPipeline(Mesh3D* mesh, const Pipeline* pipeline) {
+    mesh->mPipeline = pipeline;
 }
 
 void MeshTraslate(Mesh3D* mesh, float x, float y, float z) {
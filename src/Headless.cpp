@@ -0,0 +1,157 @@
+#include "Headless.hpp"
+
+#include <cstring>
+#include <iostream>
+
+#ifdef __linux__
+// Keeps eglplatform.h from pulling in Xlib
+#define EGL_NO_X11
+#define MESA_EGL_NO_X11_HEADERS
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+static bool HasExtension(const char* extensions, const char* name) {
+    if (extensions == nullptr) {
+        return false;
+    }
+    size_t length = strlen(name);
+    for (const char* found = strstr(extensions, name); found != nullptr; found = strstr(found + 1, name)) {
+        if ((found == extensions || found[-1] == ' ') && (found[length] == ' ' || found[length] == '\0')) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static EGLDisplay OpenDisplay() {
+    // Surfaceless needs no X11/Wayland and no DRM device, so it works anywhere Mesa does
+    const char* clientExtensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+    if (HasExtension(clientExtensions, "EGL_MESA_platform_surfaceless")) {
+        PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+            (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+        if (getPlatformDisplay != nullptr) {
+            EGLDisplay display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+            if (display != EGL_NO_DISPLAY) {
+                return display;
+            }
+        }
+    }
+    return eglGetDisplay(EGL_DEFAULT_DISPLAY);
+}
+
+static bool CreateFramebuffer(HeadlessContext* context, int width, int height) {
+    glGenRenderbuffers(1, &context->mColorRenderbuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, context->mColorRenderbuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+
+    glGenRenderbuffers(1, &context->mDepthRenderbuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, context->mDepthRenderbuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    glGenFramebuffers(1, &context->mFramebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, context->mFramebuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, context->mColorRenderbuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, context->mDepthRenderbuffer);
+
+    // Left bound, this is what the renderer draws into instead of a window
+    return glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+}
+
+bool CreateHeadlessContext(HeadlessContext* context, int width, int height) {
+    EGLDisplay display = OpenDisplay();
+    EGLint major = 0, minor = 0;
+    if (display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor)) {
+        std::cout << "EGL display could not be initialized" << std::endl;
+        return false;
+    }
+    context->mDisplay = display;
+
+    if (!eglBindAPI(EGL_OPENGL_API)) {
+        std::cout << "EGL does not support desktop OpenGL" << std::endl;
+        return false;
+    }
+
+    // The window system buffers are never drawn to, the config only has to be able to make a pbuffer
+    const EGLint configAttributes[] = {
+        EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+        EGL_NONE
+    };
+    EGLConfig config = nullptr;
+    EGLint configCount = 0;
+    if (!eglChooseConfig(display, configAttributes, &config, 1, &configCount) || configCount == 0) {
+        std::cout << "No EGL config for OpenGL" << std::endl;
+        return false;
+    }
+
+    // Same version and profile the windowed path asks SDL for
+    const EGLint contextAttributes[] = {
+        EGL_CONTEXT_MAJOR_VERSION, 4,
+        EGL_CONTEXT_MINOR_VERSION, 1,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+        EGL_NONE
+    };
+    EGLContext eglContext = eglCreateContext(display, config, EGL_NO_CONTEXT, contextAttributes);
+    if (eglContext == EGL_NO_CONTEXT) {
+        std::cout << "EGL could not create an OpenGL 4.1 core context" << std::endl;
+        return false;
+    }
+    context->mContext = eglContext;
+
+    EGLSurface surface = EGL_NO_SURFACE;
+    if (!HasExtension(eglQueryString(display, EGL_EXTENSIONS), "EGL_KHR_surfaceless_context")) {
+        const EGLint pbufferAttributes[] = { EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE };
+        surface = eglCreatePbufferSurface(display, config, pbufferAttributes);
+        context->mSurface = surface;
+    }
+    if (!eglMakeCurrent(display, surface, surface, eglContext)) {
+        std::cout << "EGL context could not be made current" << std::endl;
+        return false;
+    }
+
+    // Core functions through eglGetProcAddress need EGL_KHR_get_all_proc_addresses, Mesa has it
+    if (!gladLoadGLLoader((GLADloadproc)eglGetProcAddress)) {
+        std::cout << "glad was not initialized" << std::endl;
+        return false;
+    }
+
+    if (!CreateFramebuffer(context, width, height)) {
+        std::cout << "Headless framebuffer is incomplete" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void DestroyHeadlessContext(HeadlessContext* context) {
+    if (context->mFramebuffer != 0) {
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glDeleteFramebuffers(1, &context->mFramebuffer);
+        glDeleteRenderbuffers(1, &context->mColorRenderbuffer);
+        glDeleteRenderbuffers(1, &context->mDepthRenderbuffer);
+    }
+    if (context->mDisplay != nullptr) {
+        eglMakeCurrent(context->mDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        if (context->mSurface != nullptr) {
+            eglDestroySurface(context->mDisplay, context->mSurface);
+        }
+        if (context->mContext != nullptr) {
+            eglDestroyContext(context->mDisplay, context->mContext);
+        }
+        eglTerminate(context->mDisplay);
+    }
+    *context = HeadlessContext();
+}
+
+#else
+
+bool CreateHeadlessContext(HeadlessContext*, int, int) {
+    std::cout << "Headless rendering needs EGL, it is not available on this platform" << std::endl;
+    return false;
+}
+
+void DestroyHeadlessContext(HeadlessContext* context) {
+    *context = HeadlessContext();
+}
+
+#endif
@@ -0,0 +1,159 @@
+#include "IndirectRenderer.hpp"
+#include "CpuProfiler.hpp"
+
+#include <cstring>
+
+// Points the instance attributes at byteOffset into the instance ring
+static void IndirectInstanceSpecification(const IndirectRenderer* renderer, GLintptr byteOffset) {
+    GLuint attributeCount = 0;
+    const VertexAttribute* attributes = InstanceDataAttributes(&attributeCount);
+    VertexArrayVertexBuffer(renderer->mVertexArrayObject, INSTANCE_BUFFER_BINDING, renderer->mInstanceRing.mBuffer,
+                            byteOffset, sizeof(InstanceData), 1, attributes, attributeCount);
+}
+
+// (Re)builds the VAO around the pool's current buffers
+static void IndirectVertexSpecification(IndirectRenderer* renderer) {
+    const GeometryPool* pool = renderer->mPool;
+
+    GLuint attributeCount = 0;
+    const VertexAttribute* attributes = VertexFormatAttributes(pool->mFormat, &attributeCount);
+    VertexArrayVertexBuffer(renderer->mVertexArrayObject, 0, pool->mVertexBufferObject, 0,
+                            VertexFormatStride(pool->mFormat), 0, attributes, attributeCount);
+    VertexArrayIndexBuffer(renderer->mVertexArrayObject, pool->mIndexBufferObject);
+
+    renderer->mSpecifiedVertexBuffer = pool->mVertexBufferObject;
+    renderer->mSpecifiedIndexBuffer = pool->mIndexBufferObject;
+}
+
+void CreateIndirectRenderer(IndirectRenderer* renderer, const GeometryPool* pool, const Pipeline* pipeline) {
+    renderer->mPool = pool;
+    renderer->mPipeline = pipeline;
+
+    // baseInstance in indirect commands is only honoured together with ARB_base_instance
+    if (GLAD_GL_ARB_multi_draw_indirect && GLAD_GL_ARB_base_instance) {
+        renderer->mMode = IndirectSubmitMode::MultiDrawIndirect;
+    } else if (GLAD_GL_ARB_base_instance) {
+        renderer->mMode = IndirectSubmitMode::BaseInstanceLoop;
+    } else {
+        renderer->mMode = IndirectSubmitMode::AttributeRebaseLoop;
+    }
+
+    CreateRingBuffer(&renderer->mCommandRing, 1024 * sizeof(DrawElementsIndirectCommand));
+    CreateRingBuffer(&renderer->mInstanceRing, 1024 * sizeof(InstanceData));
+    renderer->mVertexArrayObject = CreateVertexArray();
+    IndirectVertexSpecification(renderer);
+}
+
+void DestroyIndirectRenderer(IndirectRenderer* renderer) {
+    DestroyRingBuffer(&renderer->mCommandRing);
+    DestroyRingBuffer(&renderer->mInstanceRing);
+    glDeleteVertexArrays(1, &renderer->mVertexArrayObject);
+    *renderer = IndirectRenderer();
+}
+
+void IndirectRendererBegin(IndirectRenderer* renderer) {
+    renderer->mCommands.clear();
+    renderer->mInstances.clear();
+}
+
+void IndirectRendererPush(IndirectRenderer* renderer, GeometryHandle geometry,
+                          const InstanceData* instances, GLuint instanceCount) {
+    if (instanceCount == 0) {
+        return;
+    }
+    const GeometryAllocation& allocation = GeometryPoolGet(*renderer->mPool, geometry);
+
+    DrawElementsIndirectCommand command;
+    command.mCount = allocation.mIndexCount;
+    command.mInstanceCount = instanceCount;
+    command.mFirstIndex = allocation.mFirstIndex;
+    command.mBaseVertex = (GLint)allocation.mBaseVertex;
+    // The draw's instances start here in the instance stream, this is the per-draw ID
+    command.mBaseInstance = (GLuint)renderer->mInstances.size();
+    renderer->mCommands.push_back(command);
+
+    renderer->mInstances.insert(renderer->mInstances.end(), instances, instances + instanceCount);
+}
+
+// Copies data into this frame's region of ring and returns its offset in the buffer
+static GLintptr StreamToRing(RingBuffer* ring, const void* data, GLsizeiptr size) {
+    RingBufferBeginFrame(ring);
+    RingAllocation allocation = RingBufferAllocate(ring, size, 16);
+    memcpy(allocation.mData, data, size);
+    RingBufferFinishWrites(ring);
+    return ring->mFrameOffset + allocation.mOffset;
+}
+
+void IndirectRendererSubmit(IndirectRenderer* renderer, RenderStats* stats) {
+    PROFILE_FUNCTION();
+    if (renderer->mCommands.empty() || renderer->mPipeline == nullptr) {
+        return;
+    }
+
+    GLsizei commandCount = (GLsizei)renderer->mCommands.size();
+    GLintptr instanceOffset = StreamToRing(&renderer->mInstanceRing, renderer->mInstances.data(),
+                                           renderer->mInstances.size() * sizeof(InstanceData));
+
+    if (renderer->mSpecifiedVertexBuffer != renderer->mPool->mVertexBufferObject ||
+        renderer->mSpecifiedIndexBuffer != renderer->mPool->mIndexBufferObject) {
+        IndirectVertexSpecification(renderer);
+    }
+    // The instance stream sits in a different ring region every frame
+    IndirectInstanceSpecification(renderer, instanceOffset);
+
+    PipelineBind(*renderer->mPipeline);
+    glBindVertexArray(renderer->mVertexArrayObject);
+
+    GLuint apiCalls = 0;
+
+    switch (renderer->mMode) {
+        case IndirectSubmitMode::MultiDrawIndirect: {
+            GLintptr commandOffset = StreamToRing(&renderer->mCommandRing, renderer->mCommands.data(),
+                                                  commandCount * sizeof(DrawElementsIndirectCommand));
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, renderer->mCommandRing.mBuffer);
+            glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (GLvoid*)commandOffset, commandCount, 0);
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+            RingBufferEndFrame(&renderer->mCommandRing);
+            apiCalls = 1;
+            break;
+        }
+
+        case IndirectSubmitMode::BaseInstanceLoop:
+            for (const DrawElementsIndirectCommand& command : renderer->mCommands) {
+                glDrawElementsInstancedBaseVertexBaseInstance(GL_TRIANGLES, command.mCount, GL_UNSIGNED_INT,
+                                                              (GLvoid*)(command.mFirstIndex * sizeof(GLuint)),
+                                                              command.mInstanceCount, command.mBaseVertex,
+                                                              command.mBaseInstance);
+            }
+            apiCalls = commandCount;
+            break;
+
+        case IndirectSubmitMode::AttributeRebaseLoop:
+            for (const DrawElementsIndirectCommand& command : renderer->mCommands) {
+                IndirectInstanceSpecification(renderer, instanceOffset + command.mBaseInstance * sizeof(InstanceData));
+                if (!GpuHasDirectStateAccess()) {
+                    // The bind path leaves no VAO bound
+                    glBindVertexArray(renderer->mVertexArrayObject);
+                }
+                glDrawElementsInstancedBaseVertex(GL_TRIANGLES, command.mCount, GL_UNSIGNED_INT,
+                                                  (GLvoid*)(command.mFirstIndex * sizeof(GLuint)),
+                                                  command.mInstanceCount, command.mBaseVertex);
+            }
+            apiCalls = commandCount;
+            break;
+    }
+
+    glBindVertexArray(0);
+    glUseProgram(0);
+    RingBufferEndFrame(&renderer->mInstanceRing);
+
+    if (stats != nullptr) {
+        for (const DrawElementsIndirectCommand& command : renderer->mCommands) {
+            stats->mTriangles += (uint64_t)(command.mCount / 3) * command.mInstanceCount;
+        }
+        stats->mFenceWait += renderer->mInstanceRing.mLastFenceWait + renderer->mCommandRing.mLastFenceWait;
+        stats->mDrawCalls += apiCalls;
+        stats->mProgramBinds++;
+        stats->mVertexArrayBinds++;
+    }
+}
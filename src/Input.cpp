@@ -1,8 +1,10 @@
 #include "Input.hpp"
+#include "CpuProfiler.hpp"
 #include <SDL2/SDL.h>
 #include <iostream>
 
 void Input(App* app) {
+    PROFILE_FUNCTION();
         SDL_Event e;
 
     static int mouseX = app->mScreenWidth/2;
@@ -15,6 +17,8 @@ void Input(App* app) {
             mouseX += e.motion.xrel;
             mouseY += e.motion.yrel;
             app->mCamera.MouseLook(mouseX, mouseY);
+        } else if (e.type == SDL_MOUSEBUTTONDOWN && e.button.button == SDL_BUTTON_LEFT) {
+            app->mPickRequested = true;
         }
     }
 
@@ -24,6 +28,19 @@ void Input(App* app) {
         app->mQuit = true;
     }
 
+    // Once per press, not once per frame the key is held
+    static bool traceKeyDown = false;
+    if (state[SDL_SCANCODE_P] && !traceKeyDown) {
+        app->mTraceRequested = true;
+    }
+    traceKeyDown = state[SDL_SCANCODE_P] != 0;
+
+    static bool defragmentKeyDown = false;
+    if (state[SDL_SCANCODE_G] && !defragmentKeyDown) {
+        app->mDefragmentRequested = true;
+    }
+    defragmentKeyDown = state[SDL_SCANCODE_G] != 0;
+
     if (state[SDL_SCANCODE_W]) {
         app->mCamera.MoveForward(0.05f);
     }
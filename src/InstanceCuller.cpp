@@ -0,0 +1,260 @@
+#include "InstanceCuller.hpp"
+#include "Culling.hpp"
+#include "CpuProfiler.hpp"
+#include "GeometryPool.hpp"
+#include "GpuResources.hpp"
+#include "Graphics.hpp"
+
+#include <glm/gtc/matrix_transform.hpp>
+#include <cstddef>
+
+// InstanceData again, but sourced per vertex at the cull shader's locations
+static const VertexAttribute CULL_ATTRIBUTES[] = {
+    { INSTANCE_CULL_MODEL_MATRIX_LOCATION + 0, 4, GL_FLOAT, offsetof(InstanceData, mModelMatrix) + sizeof(glm::vec4) * 0 },
+    { INSTANCE_CULL_MODEL_MATRIX_LOCATION + 1, 4, GL_FLOAT, offsetof(InstanceData, mModelMatrix) + sizeof(glm::vec4) * 1 },
+    { INSTANCE_CULL_MODEL_MATRIX_LOCATION + 2, 4, GL_FLOAT, offsetof(InstanceData, mModelMatrix) + sizeof(glm::vec4) * 2 },
+    { INSTANCE_CULL_MODEL_MATRIX_LOCATION + 3, 4, GL_FLOAT, offsetof(InstanceData, mModelMatrix) + sizeof(glm::vec4) * 3 },
+    { INSTANCE_CULL_COLOR_LOCATION, 4, GL_FLOAT, offsetof(InstanceData, mColor) }
+};
+
+static const char* const CULL_VARYINGS[] = { "g_Index" };
+// Captured in this order, the same bytes as an InstanceData
+static const char* const GATHER_VARYINGS[] = { "g_ModelMatrix", "g_Color" };
+
+// Texture units of the gather pass
+const GLint GATHER_INDEX_UNIT = 0;
+const GLint GATHER_INSTANCE_UNIT = 1;
+
+void CreateInstanceCuller(InstanceCuller* culler, ShaderLibrary* shaderLibrary) {
+    const PreprocessedShader& vertexShader =
+        ShaderLibraryGet(shaderLibrary, SHADER_DIRECTORY "/instancecull.vert.glsl", ShaderDefines());
+    const PreprocessedShader& geometryShader =
+        ShaderLibraryGet(shaderLibrary, SHADER_DIRECTORY "/instancecull.geom.glsl", ShaderDefines());
+    culler->mProgram = CreateFeedbackProgram(vertexShader.mSource, geometryShader.mSource, CULL_VARYINGS,
+                                             sizeof(CULL_VARYINGS) / sizeof(CULL_VARYINGS[0]), "instance culling");
+    culler->mSphereUniform = PipelineGetUniform<glm::vec4>(culler->mProgram, "u_Sphere");
+    culler->mPlanesLocation = FindUniformLocation(culler->mProgram, "u_Planes");
+
+    const PreprocessedShader& gatherShader =
+        ShaderLibraryGet(shaderLibrary, SHADER_DIRECTORY "/instancegather.vert.glsl", ShaderDefines());
+    culler->mGatherProgram = CreateFeedbackProgram(gatherShader.mSource, "", GATHER_VARYINGS,
+                                                   sizeof(GATHER_VARYINGS) / sizeof(GATHER_VARYINGS[0]),
+                                                   "instance gathering");
+    glProgramUniform1i(culler->mGatherProgram.mProgram, FindUniformLocation(culler->mGatherProgram, "u_Indices"),
+                       GATHER_INDEX_UNIT);
+    glProgramUniform1i(culler->mGatherProgram.mProgram, FindUniformLocation(culler->mGatherProgram, "u_Instances"),
+                       GATHER_INSTANCE_UNIT);
+    culler->mGatherVertexArray = CreateVertexArray();
+
+    GLint texels = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &texels);
+    culler->mMaxInstances = (uint32_t)texels / (sizeof(InstanceData) / sizeof(glm::vec4));
+}
+
+void DestroyInstanceCuller(InstanceCuller* culler) {
+    for (InstanceCullGroup& group : culler->mGroups) {
+        glDeleteVertexArrays(1, &group.mCullVertexArray);
+        glDeleteTextures(1, &group.mInstanceTexture);
+        glDeleteTextures(INSTANCE_CULL_SLOTS, group.mIndexTextures);
+        glDeleteBuffers(INSTANCE_CULL_SLOTS, group.mIndexBuffers);
+        glDeleteQueries(INSTANCE_CULL_SLOTS, group.mQueries);
+        glDeleteBuffers(1, &group.mVisibleBuffer);
+        glDeleteVertexArrays(1, &group.mDrawVertexArray);
+    }
+    glDeleteVertexArrays(1, &culler->mGatherVertexArray);
+    glDeleteProgram(culler->mGatherProgram.mProgram);
+    glDeleteProgram(culler->mProgram.mProgram);
+    *culler = InstanceCuller();
+}
+
+static GLuint CreateBufferTexture(GLenum format, GLuint buffer) {
+    GLuint texture = 0;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_BUFFER, texture);
+    glTexBuffer(GL_TEXTURE_BUFFER, format, buffer);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+    return texture;
+}
+
+static void InstanceCullGroupSpecification(InstanceCullGroup* cullGroup, const InstanceGroup& group) {
+    cullGroup->mSphere = MeshDataBoundingSphere(*group.mMeshData);
+    glGenQueries(INSTANCE_CULL_SLOTS, cullGroup->mQueries);
+
+    GLuint attributeCount = sizeof(CULL_ATTRIBUTES) / sizeof(CULL_ATTRIBUTES[0]);
+    cullGroup->mCullVertexArray = CreateVertexArray();
+    VertexArrayVertexBuffer(cullGroup->mCullVertexArray, 0, group.mInstanceBuffer, 0, sizeof(InstanceData), 0,
+                            CULL_ATTRIBUTES, attributeCount);
+
+    // Buffer textures follow their buffer through BufferRespecify, so these are made once
+    cullGroup->mInstanceTexture = CreateBufferTexture(GL_RGBA32F, group.mInstanceBuffer);
+    for (uint32_t slot = 0; slot < INSTANCE_CULL_SLOTS; ++slot) {
+        cullGroup->mIndexBuffers[slot] = CreateBuffer();
+        cullGroup->mIndexTextures[slot] = CreateBufferTexture(GL_R32I, cullGroup->mIndexBuffers[slot]);
+    }
+
+    // The group's own VAO, with the survivors in place of all the instances
+    cullGroup->mVisibleBuffer = CreateBuffer();
+    const VertexAttribute* attributes = VertexFormatAttributes(VertexFormat::PositionColor, &attributeCount);
+    cullGroup->mDrawVertexArray = CreateVertexArray();
+    VertexArrayVertexBuffer(cullGroup->mDrawVertexArray, 0, group.mMesh.mVertexBufferObject, 0,
+                            VertexFormatStride(VertexFormat::PositionColor), 0, attributes, attributeCount);
+    VertexArrayIndexBuffer(cullGroup->mDrawVertexArray, group.mMesh.mIndexBufferObject);
+    attributes = InstanceDataAttributes(&attributeCount);
+    VertexArrayVertexBuffer(cullGroup->mDrawVertexArray, INSTANCE_BUFFER_BINDING, cullGroup->mVisibleBuffer, 0,
+                            sizeof(InstanceData), 1, attributes, attributeCount);
+}
+
+// Takes the survivor count of the slot culled last frame, unless the GPU isn't done with it
+static void InstanceCullGroupCollect(InstanceCullGroup* cullGroup, uint32_t slot) {
+    cullGroup->mReady = false;
+    cullGroup->mVisibleCount = 0;
+    if (cullGroup->mCulledCount[slot] == 0) {
+        return;
+    }
+    GLuint available = GL_FALSE;
+    glGetQueryObjectuiv(cullGroup->mQueries[slot], GL_QUERY_RESULT_AVAILABLE, &available);
+    if (available == GL_TRUE) {
+        glGetQueryObjectuiv(cullGroup->mQueries[slot], GL_QUERY_RESULT, &cullGroup->mVisibleCount);
+        cullGroup->mReady = true;
+    }
+}
+
+// Copies the current InstanceData of every survivor of slot into the visible buffer
+static void GatherSurvivors(InstanceCuller* culler, const InstancedRenderer& renderer, uint32_t slot) {
+    PipelineBind(culler->mGatherProgram);
+    glBindVertexArray(culler->mGatherVertexArray);
+    for (size_t i = 0; i < renderer.mGroups.size(); ++i) {
+        const InstanceGroup& group = renderer.mGroups[i];
+        InstanceCullGroup& cullGroup = culler->mGroups[i];
+        if (!cullGroup.mReady || cullGroup.mVisibleCount == 0 || group.mInstances.empty()) {
+            continue;
+        }
+
+        GLsizeiptr size = cullGroup.mVisibleCount * sizeof(InstanceData);
+        if (size > cullGroup.mVisibleCapacity) {
+            cullGroup.mVisibleCapacity = group.mInstanceCapacity;
+            BufferRespecify(cullGroup.mVisibleBuffer, cullGroup.mVisibleCapacity, nullptr, GL_STREAM_COPY);
+        }
+
+        glActiveTexture(GL_TEXTURE0 + GATHER_INDEX_UNIT);
+        glBindTexture(GL_TEXTURE_BUFFER, cullGroup.mIndexTextures[slot]);
+        glActiveTexture(GL_TEXTURE0 + GATHER_INSTANCE_UNIT);
+        glBindTexture(GL_TEXTURE_BUFFER, cullGroup.mInstanceTexture);
+        glBindBufferRange(GL_TRANSFORM_FEEDBACK_BUFFER, 0, cullGroup.mVisibleBuffer, 0, size);
+        glBeginTransformFeedback(GL_POINTS);
+        glDrawArrays(GL_POINTS, 0, (GLsizei)cullGroup.mVisibleCount);
+        glEndTransformFeedback();
+    }
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+    glActiveTexture(GL_TEXTURE0 + GATHER_INDEX_UNIT);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+}
+
+void InstanceCullerRun(InstanceCuller* culler, const InstancedRenderer& renderer, const glm::mat4& viewProjection) {
+    PROFILE_FUNCTION();
+    culler->mStats = InstanceCullStats();
+    // Groups are only ever added
+    while (culler->mGroups.size() < renderer.mGroups.size()) {
+        culler->mGroups.emplace_back();
+        InstanceCullGroupSpecification(&culler->mGroups.back(), renderer.mGroups[culler->mGroups.size() - 1]);
+    }
+
+    uint32_t previous = culler->mSlot;
+    culler->mSlot = (culler->mSlot + 1) % INSTANCE_CULL_SLOTS;
+    for (size_t i = 0; i < renderer.mGroups.size(); ++i) {
+        const InstanceGroup& group = renderer.mGroups[i];
+        InstanceCullGroup& cullGroup = culler->mGroups[i];
+        InstanceCullGroupCollect(&cullGroup, previous);
+        if (group.mInstances.empty()) {
+            continue;
+        }
+        // Drawn unculled until the count comes in
+        if (cullGroup.mReady) {
+            culler->mStats.mInstances += cullGroup.mCulledCount[previous];
+            culler->mStats.mVisible += cullGroup.mVisibleCount;
+        } else {
+            culler->mStats.mInstances += (uint32_t)group.mInstances.size();
+            culler->mStats.mVisible += (uint32_t)group.mInstances.size();
+        }
+    }
+
+    glEnable(GL_RASTERIZER_DISCARD);
+    // An instance removed since fetches out of range, zeros, and is drawn degenerate
+    GatherSurvivors(culler, renderer, previous);
+
+    // Scaling clip x and y down widens the side planes extracted from it
+    glm::vec3 padding(1.0f / INSTANCE_CULL_FRUSTUM_PADDING, 1.0f / INSTANCE_CULL_FRUSTUM_PADDING, 1.0f);
+    Frustum frustum = ExtractFrustum(glm::scale(glm::mat4(1.0f), padding) * viewProjection);
+    PipelineBind(culler->mProgram);
+    glProgramUniform4fv(culler->mProgram.mProgram, culler->mPlanesLocation, 6, &frustum.mPlanes[0].x);
+    for (size_t i = 0; i < renderer.mGroups.size(); ++i) {
+        const InstanceGroup& group = renderer.mGroups[i];
+        InstanceCullGroup& cullGroup = culler->mGroups[i];
+        uint32_t slot = culler->mSlot;
+        cullGroup.mCulledCount[slot] = (GLuint)group.mInstances.size();
+        // Too many for the gather pass to fetch, left unculled
+        if (group.mInstances.size() > culler->mMaxInstances) {
+            cullGroup.mCulledCount[slot] = 0;
+        }
+        if (cullGroup.mCulledCount[slot] == 0) {
+            continue;
+        }
+
+        // Room for every index, in case they all survive
+        GLsizeiptr size = group.mInstances.size() * sizeof(GLint);
+        if (size > cullGroup.mIndexCapacity[slot]) {
+            cullGroup.mIndexCapacity[slot] = group.mInstanceCapacity / sizeof(InstanceData) * sizeof(GLint);
+            BufferRespecify(cullGroup.mIndexBuffers[slot], cullGroup.mIndexCapacity[slot], nullptr, GL_STREAM_COPY);
+        }
+
+        SetUniform(culler->mSphereUniform, cullGroup.mSphere);
+        glBindVertexArray(cullGroup.mCullVertexArray);
+        glBindBufferRange(GL_TRANSFORM_FEEDBACK_BUFFER, 0, cullGroup.mIndexBuffers[slot], 0, size);
+        glBeginQuery(GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN, cullGroup.mQueries[slot]);
+        glBeginTransformFeedback(GL_POINTS);
+        glDrawArrays(GL_POINTS, 0, (GLsizei)group.mInstances.size());
+        glEndTransformFeedback();
+        glEndQuery(GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN);
+    }
+    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+    glBindVertexArray(0);
+    glDisable(GL_RASTERIZER_DISCARD);
+}
+
+void InstanceCullerDraw(const InstanceCuller& culler, const InstancedRenderer& renderer, RenderStats* stats) {
+    PROFILE_FUNCTION();
+    if (renderer.mPipeline == nullptr || culler.mGroups.empty()) {
+        return;
+    }
+
+    PipelineBind(*renderer.mPipeline);
+    if (stats != nullptr) {
+        stats->mProgramBinds++;
+    }
+    for (size_t i = 0; i < culler.mGroups.size(); ++i) {
+        const InstanceCullGroup& cullGroup = culler.mGroups[i];
+        const InstanceGroup& group = renderer.mGroups[i];
+        if (group.mInstances.empty()) {
+            continue;
+        }
+
+        GLuint vertexArray = group.mMesh.mVertexArrayObject;
+        GLuint count = (GLuint)group.mInstances.size();
+        if (cullGroup.mReady) {
+            vertexArray = cullGroup.mDrawVertexArray;
+            count = cullGroup.mVisibleCount;
+        }
+        if (count == 0) {
+            continue;
+        }
+        glBindVertexArray(vertexArray);
+        glDrawElementsInstanced(GL_TRIANGLES, group.mMesh.mIndexCount, GL_UNSIGNED_INT, 0, (GLsizei)count);
+        if (stats != nullptr) {
+            stats->mDrawCalls++;
+            stats->mTriangles += (uint64_t)(group.mMesh.mIndexCount / 3) * count;
+            stats->mVertexArrayBinds++;
+        }
+    }
+    glBindVertexArray(0);
+    glUseProgram(0);
+}
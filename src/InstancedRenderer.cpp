@@ -0,0 +1,123 @@
+#include "InstancedRenderer.hpp"
+#include "CpuProfiler.hpp"
+
+#include <cstddef>
+
+// Model matrix, one vec4 column per attribute location, then the color
+static const VertexAttribute INSTANCE_ATTRIBUTES[] = {
+    { INSTANCE_MODEL_MATRIX_LOCATION + 0, 4, GL_FLOAT, offsetof(InstanceData, mModelMatrix) + sizeof(glm::vec4) * 0 },
+    { INSTANCE_MODEL_MATRIX_LOCATION + 1, 4, GL_FLOAT, offsetof(InstanceData, mModelMatrix) + sizeof(glm::vec4) * 1 },
+    { INSTANCE_MODEL_MATRIX_LOCATION + 2, 4, GL_FLOAT, offsetof(InstanceData, mModelMatrix) + sizeof(glm::vec4) * 2 },
+    { INSTANCE_MODEL_MATRIX_LOCATION + 3, 4, GL_FLOAT, offsetof(InstanceData, mModelMatrix) + sizeof(glm::vec4) * 3 },
+    { INSTANCE_COLOR_LOCATION, 4, GL_FLOAT, offsetof(InstanceData, mColor) }
+};
+
+const VertexAttribute* InstanceDataAttributes(GLuint* count) {
+    *count = sizeof(INSTANCE_ATTRIBUTES) / sizeof(VertexAttribute);
+    return INSTANCE_ATTRIBUTES;
+}
+
+static void InstanceGroupVertexSpecification(InstanceGroup* group, ResourceManager* resources) {
+    // Geometry (attributes 0 and 1) comes from the regular mesh setup
+    MeshDataVertexSpecification(&group->mMesh, resources, *group->mMeshData);
+
+    // Storage is (re)allocated on upload, it grows with the instance count
+    group->mInstanceBuffer = CreateBuffer();
+    group->mInstanceBufferHandle = ResourceManagerRegister(resources, ResourceType::Buffer, group->mInstanceBuffer);
+
+    GLuint attributeCount = 0;
+    const VertexAttribute* attributes = InstanceDataAttributes(&attributeCount);
+    VertexArrayVertexBuffer(group->mMesh.mVertexArrayObject, INSTANCE_BUFFER_BINDING, group->mInstanceBuffer, 0,
+                            sizeof(InstanceData), 1, attributes, attributeCount);
+}
+
+void CreateInstancedRenderer(InstancedRenderer* renderer, const Pipeline* pipeline, ResourceManager* resources) {
+    renderer->mPipeline = pipeline;
+    renderer->mResources = resources;
+}
+
+void DestroyInstancedRenderer(InstancedRenderer* renderer) {
+    for (InstanceGroup& group : renderer->mGroups) {
+        ResourceManagerRelease(renderer->mResources, group.mInstanceBufferHandle);
+        MeshRelease(&group.mMesh, renderer->mResources);
+    }
+    renderer->mGroups.clear();
+    renderer->mGroupIndex.clear();
+}
+
+InstanceId InstancedRendererAdd(InstancedRenderer* renderer, const MeshData& meshData,
+                                const glm::mat4& modelMatrix, const glm::vec4& color) {
+    auto it = renderer->mGroupIndex.find(&meshData);
+    if (it == renderer->mGroupIndex.end()) {
+        renderer->mGroups.emplace_back();
+        InstanceGroup& group = renderer->mGroups.back();
+        group.mMeshData = &meshData;
+        InstanceGroupVertexSpecification(&group, renderer->mResources);
+        MeshSetPipeline(&group.mMesh, renderer->mPipeline);
+
+        it = renderer->mGroupIndex.emplace(&meshData, (GLuint)renderer->mGroups.size() - 1).first;
+    }
+
+    InstanceGroup& group = renderer->mGroups[it->second];
+    InstanceData instance;
+    instance.mModelMatrix = modelMatrix;
+    instance.mColor = color;
+    group.mInstances.push_back(instance);
+    group.mDirty = true;
+
+    InstanceId id;
+    id.mGroup = it->second;
+    id.mIndex = (GLuint)group.mInstances.size() - 1;
+    return id;
+}
+
+InstanceData* InstancedRendererGet(InstancedRenderer* renderer, InstanceId id) {
+    InstanceGroup& group = renderer->mGroups[id.mGroup];
+    // Callers get write access, so assume they change it
+    group.mDirty = true;
+    return &group.mInstances[id.mIndex];
+}
+
+void InstancedRendererUpload(InstancedRenderer* renderer) {
+    for (InstanceGroup& group : renderer->mGroups) {
+        if (!group.mDirty) {
+            continue;
+        }
+
+        GLsizeiptr size = group.mInstances.size() * sizeof(InstanceData);
+        if (size > group.mInstanceCapacity) {
+            group.mInstanceCapacity = size * 2;
+        }
+        // Orphan last frame's storage, then fill the fresh one
+        BufferRespecify(group.mInstanceBuffer, group.mInstanceCapacity, nullptr, GL_STREAM_DRAW);
+        BufferUpload(group.mInstanceBuffer, 0, size, group.mInstances.data());
+        group.mDirty = false;
+    }
+}
+
+void InstancedRendererDraw(const InstancedRenderer& renderer, RenderStats* stats) {
+    PROFILE_FUNCTION();
+    if (renderer.mPipeline == nullptr || renderer.mGroups.empty()) {
+        return;
+    }
+
+    PipelineBind(*renderer.mPipeline);
+    if (stats != nullptr) {
+        stats->mProgramBinds++;
+    }
+    for (const InstanceGroup& group : renderer.mGroups) {
+        if (group.mInstances.empty()) {
+            continue;
+        }
+        glBindVertexArray(group.mMesh.mVertexArrayObject);
+        glDrawElementsInstanced(GL_TRIANGLES, group.mMesh.mIndexCount, GL_UNSIGNED_INT, 0,
+                                (GLsizei)group.mInstances.size());
+        if (stats != nullptr) {
+            stats->mDrawCalls++;
+            stats->mTriangles += (uint64_t)(group.mMesh.mIndexCount / 3) * group.mInstances.size();
+            stats->mVertexArrayBinds++;
+        }
+    }
+    glBindVertexArray(0);
+    glUseProgram(0);
+}
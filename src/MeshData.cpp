@@ -1,8 +1,11 @@
 #include "MeshData.hpp"
+#include "CpuProfiler.hpp"
 
+#include <algorithm>
 #include <map>
 
 const MeshData GenerateSphere(unsigned int subdivisions) {
+    PROFILE_FUNCTION();
     MeshData sphere;
 
     // Starts with a Tetrahedron
@@ -68,4 +71,71 @@ const MeshData GenerateSphere(unsigned int subdivisions) {
     sphere.vertices = vertices;
     sphere.indices = indices;
     return sphere;
-}
\ No newline at end of file
+}
+
+glm::vec4 MeshDataBoundingSphere(const MeshData& meshData) {
+    if (meshData.vertices.empty()) {
+        return glm::vec4(0.0f);
+    }
+    glm::vec3 low(meshData.vertices[0].x, meshData.vertices[0].y, meshData.vertices[0].z);
+    glm::vec3 high = low;
+    for (const Vertex& vertex : meshData.vertices) {
+        low = glm::min(low, glm::vec3(vertex.x, vertex.y, vertex.z));
+        high = glm::max(high, glm::vec3(vertex.x, vertex.y, vertex.z));
+    }
+
+    glm::vec3 center = (low + high) * 0.5f;
+    float radius = 0.0f;
+    for (const Vertex& vertex : meshData.vertices) {
+        radius = std::max(radius, glm::length(glm::vec3(vertex.x, vertex.y, vertex.z) - center));
+    }
+    return glm::vec4(center, radius);
+}
+
+namespace MeshTemplates {
+    const MeshData Square = {
+        {
+            //  x      y     z  |   r     g     b
+            { -0.5f, -0.5f, 0.0f, 1.0f, 0.0f, 0.0f }, // Vertex 1
+            {  0.5f, -0.5f, 0.0f, 0.0f, 1.0f, 0.0f }, // Vertex 2
+            { -0.5f,  0.5f, 0.0f, 0.0f, 0.0f, 1.0f }, // Vertex 3
+            {  0.5f,  0.5f, 0.0f, 1.0f, 0.0f, 0.0f }  // Vertex 4
+        },
+        { 2, 0, 1, 3, 2, 1 } // Indices
+    };
+
+    const MeshData Cube = {
+        {
+            {-0.5f, -0.5f, -0.5f, 1.0f, 0.0f, 0.0f},
+            { 0.5f, -0.5f, -0.5f, 0.0f, 1.0f, 0.0f},
+            { 0.5f,  0.5f, -0.5f, 0.0f, 0.0f, 1.0f},
+            {-0.5f,  0.5f, -0.5f, 1.0f, 1.0f, 0.0f},
+            {-0.5f, -0.5f,  0.5f, 1.0f, 0.0f, 1.0f},
+            { 0.5f, -0.5f,  0.5f, 0.0f, 1.0f, 1.0f},
+            { 0.5f,  0.5f,  0.5f, 1.0f, 1.0f, 1.0f},
+            {-0.5f,  0.5f,  0.5f, 0.5f, 0.5f, 0.5f}
+        },
+        { 0, 1, 2, 2, 3, 0,  // Front face
+        1, 5, 6, 6, 2, 1,  // Right face
+        5, 4, 7, 7, 6, 5,  // Back face
+        4, 0, 3, 3, 7, 4,  // Left face
+        3, 2, 6, 6, 7, 3,  // Top face
+        4, 5, 1, 1, 0, 4 } // Bottom face
+    };
+
+    const MeshData Tetrahedron = {
+        {
+            {  0.0f, 0.5f,   0.5f,  1.0f, 0.0f, 0.0f }, // Vertex 0 - Top
+            {  0.5f, 0.5f,   0.0f,  0.0f, 1.0f, 0.0f }, // Vertex 1 - Front Left
+            {  0.0f, 0.0f,  0.0f,  0.0f, 0.0f, 1.0f }, // Vertex 2 - Front Right
+            {  0.5f, 0.0f,  0.5f,  1.0f, 1.0f, 0.0f }  // Vertex 3 - Back
+        },
+        {0, 1, 2, // Front Face
+        0, 2, 3, // Right Face
+        0, 3, 1, // Left Face
+        1, 2, 3}  // Bottom Face
+    };
+    
+    const MeshData Sphere = GenerateSphere(9);
+    const MeshData SphereLowPoly = GenerateSphere(3);
+}
@@ -0,0 +1,537 @@
+#include "OcclusionCuller.hpp"
+#include "CpuProfiler.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__x86_64__) || defined(_M_X64) || (defined(__i386__) && defined(__SSE2__))
+#define OCCLUSION_SSE 1
+#include <immintrin.h>
+#endif
+
+// Triangles reaching further off screen than this are dropped, float edge
+// functions lose too much precision out there
+static const float OCCLUSION_GUARD_BAND = 16384.0f;
+// Bounds tested between looks at the clock
+static const uint32_t OCCLUSION_TEST_BATCH = 64;
+
+static double MillisecondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Setup stops at a quarter of the budget and rasterizing what it binned at
+// half, so there's always time left to test
+static bool OverBudget(const OcclusionCuller& culler, double share) {
+    return MillisecondsSince(culler.mStart) > culler.mTimeBudget * share;
+}
+
+// Clip space to pixels and NDC depth, y going up like GL window coordinates
+static glm::vec3 ToScreen(const glm::vec4& clip) {
+    float inverseW = 1.0f / clip.w;
+    return glm::vec3((clip.x * inverseW * 0.5f + 0.5f) * OCCLUSION_WIDTH,
+                     (clip.y * inverseW * 0.5f + 0.5f) * OCCLUSION_HEIGHT,
+                     clip.z * inverseW);
+}
+
+// Screen position and depth in xyz, w is 0 when the vertex can't be used:
+// behind the near plane or outside the guard band
+static glm::vec4 ProjectVertex(const glm::vec4& clip) {
+    if (clip.w <= 0.0f || clip.z < -clip.w) {
+        return glm::vec4(0.0f);
+    }
+    glm::vec3 screen = ToScreen(clip);
+    if (std::abs(screen.x) > OCCLUSION_GUARD_BAND || std::abs(screen.y) > OCCLUSION_GUARD_BAND) {
+        return glm::vec4(0.0f);
+    }
+    return glm::vec4(screen, 1.0f);
+}
+
+static bool SetupTriangle(const glm::vec4& projected0, const glm::vec4& projected1, const glm::vec4& projected2,
+                          OcclusionTriangle* triangle) {
+    // Triangles crossing the near plane are dropped, fewer occluders only hide less
+    if (projected0.w == 0.0f || projected1.w == 0.0f || projected2.w == 0.0f) {
+        return false;
+    }
+    glm::vec3 v0(projected0);
+    glm::vec3 v1(projected1);
+    glm::vec3 v2(projected2);
+
+    // Both sides are drawn, so wind every triangle counter-clockwise
+    float area = (v1.x - v0.x) * (v2.y - v0.y) - (v2.x - v0.x) * (v1.y - v0.y);
+    if (area < 0.0f) {
+        std::swap(v1, v2);
+        area = -area;
+    }
+    if (area <= 0.0f) {
+        return false;
+    }
+
+    // Pixels whose center is in the bounding box
+    float minX = std::min(v0.x, std::min(v1.x, v2.x));
+    float maxX = std::max(v0.x, std::max(v1.x, v2.x));
+    float minY = std::min(v0.y, std::min(v1.y, v2.y));
+    float maxY = std::max(v0.y, std::max(v1.y, v2.y));
+    triangle->mMinX = std::max(0, (int)std::ceil(minX - 0.5f));
+    triangle->mMaxX = std::min((int)OCCLUSION_WIDTH - 1, (int)std::floor(maxX - 0.5f));
+    triangle->mMinY = std::max(0, (int)std::ceil(minY - 0.5f));
+    triangle->mMaxY = std::min((int)OCCLUSION_HEIGHT - 1, (int)std::floor(maxY - 0.5f));
+    if (triangle->mMinX > triangle->mMaxX || triangle->mMinY > triangle->mMaxY) {
+        return false;
+    }
+
+    const glm::vec3* vertices[3] = { &v0, &v1, &v2 };
+    for (int i = 0; i < 3; ++i) {
+        const glm::vec3& a = *vertices[i];
+        const glm::vec3& b = *vertices[(i + 1) % 3];
+        triangle->mEdgeA[i] = a.y - b.y;
+        triangle->mEdgeB[i] = b.x - a.x;
+        triangle->mEdgeC[i] = -(triangle->mEdgeA[i] * a.x + triangle->mEdgeB[i] * a.y);
+    }
+
+    // Depth is linear in screen space after the divide. The plane is moved
+    // back to the farthest depth it reaches inside a pixel, so a pixel never
+    // claims to be nearer than all of what it covers.
+    float depthA = ((v1.z - v0.z) * (v2.y - v0.y) - (v2.z - v0.z) * (v1.y - v0.y)) / area;
+    float depthB = ((v1.x - v0.x) * (v2.z - v0.z) - (v2.x - v0.x) * (v1.z - v0.z)) / area;
+    triangle->mDepthA = depthA;
+    triangle->mDepthB = depthB;
+    triangle->mDepthC = v0.z - depthA * v0.x - depthB * v0.y + 0.5f * (std::abs(depthA) + std::abs(depthB));
+    return true;
+}
+
+static void SetupOccluders(OcclusionCuller* culler, uint32_t worker) {
+    PROFILE_ZONE("Occluder setup");
+    std::vector<glm::vec4>& projected = culler->mProjectedVertices[worker];
+    std::vector<OcclusionTriangle>& triangles = culler->mTriangles[worker];
+    std::vector<std::vector<uint32_t>>& bins = culler->mBins[worker];
+    triangles.clear();
+    for (std::vector<uint32_t>& bin : bins) {
+        bin.clear();
+    }
+
+    // Occluders come largest first, taking every n-th spreads them over the threads
+    for (size_t i = worker; i < culler->mOccluders.size(); i += culler->mWorkerCount) {
+        if (OverBudget(*culler, 0.25)) {
+            break;
+        }
+        const OcclusionOccluder& occluder = culler->mOccluders[i];
+        const MeshData& meshData = *occluder.mMeshData;
+        glm::mat4 modelViewProjection = culler->mViewProjection * occluder.mModelMatrix;
+        projected.resize(meshData.vertices.size());
+        for (size_t v = 0; v < meshData.vertices.size(); ++v) {
+            const Vertex& vertex = meshData.vertices[v];
+            projected[v] = ProjectVertex(modelViewProjection * glm::vec4(vertex.x, vertex.y, vertex.z, 1.0f));
+        }
+
+        for (size_t index = 0; index + 2 < meshData.indices.size(); index += 3) {
+            OcclusionTriangle triangle;
+            if (!SetupTriangle(projected[meshData.indices[index]], projected[meshData.indices[index + 1]],
+                               projected[meshData.indices[index + 2]], &triangle)) {
+                continue;
+            }
+            uint32_t triangleIndex = (uint32_t)triangles.size();
+            triangles.push_back(triangle);
+            for (int ty = triangle.mMinY / (int)OCCLUSION_TILE_HEIGHT; ty <= triangle.mMaxY / (int)OCCLUSION_TILE_HEIGHT; ++ty) {
+                for (int tx = triangle.mMinX / (int)OCCLUSION_TILE_WIDTH; tx <= triangle.mMaxX / (int)OCCLUSION_TILE_WIDTH; ++tx) {
+                    bins[ty * OCCLUSION_TILES_X + tx].push_back(triangleIndex);
+                }
+            }
+        }
+    }
+}
+
+// Keeps the nearer depth of every pixel center the triangle covers in the tile
+static void RasterizeTriangle(const OcclusionTriangle& triangle, int tileX, int tileY, float* depth) {
+    int x0 = std::max(triangle.mMinX, tileX) - tileX;
+    int x1 = std::min(triangle.mMaxX, tileX + (int)OCCLUSION_TILE_WIDTH - 1) - tileX;
+    int y0 = std::max(triangle.mMinY, tileY) - tileY;
+    int y1 = std::min(triangle.mMaxY, tileY + (int)OCCLUSION_TILE_HEIGHT - 1) - tileY;
+
+#ifdef OCCLUSION_SSE
+    // Four pixels at a time from an aligned column, the tile width is a
+    // multiple of four so they never leave the tile
+    x0 &= ~3;
+    __m128 laneOffset = _mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f);
+    __m128 edgeA[3], edgeB[3], edgeC[3];
+    for (int i = 0; i < 3; ++i) {
+        edgeA[i] = _mm_set1_ps(triangle.mEdgeA[i]);
+        edgeB[i] = _mm_set1_ps(triangle.mEdgeB[i]);
+        edgeC[i] = _mm_set1_ps(triangle.mEdgeC[i]);
+    }
+    __m128 depthA = _mm_set1_ps(triangle.mDepthA);
+    __m128 depthB = _mm_set1_ps(triangle.mDepthB);
+    __m128 depthC = _mm_set1_ps(triangle.mDepthC);
+    __m128 zero = _mm_setzero_ps();
+    for (int y = y0; y <= y1; ++y) {
+        __m128 py = _mm_set1_ps(tileY + y + 0.5f);
+        __m128 rowEdge[3];
+        for (int i = 0; i < 3; ++i) {
+            rowEdge[i] = _mm_add_ps(_mm_mul_ps(edgeB[i], py), edgeC[i]);
+        }
+        __m128 rowDepth = _mm_add_ps(_mm_mul_ps(depthB, py), depthC);
+        float* row = depth + y * OCCLUSION_TILE_WIDTH;
+        for (int x = x0; x <= x1; x += 4) {
+            __m128 px = _mm_add_ps(_mm_set1_ps((float)(tileX + x)), laneOffset);
+            __m128 inside = _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(edgeA[0], px), rowEdge[0]), zero);
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(edgeA[1], px), rowEdge[1]), zero));
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(edgeA[2], px), rowEdge[2]), zero));
+            if (_mm_movemask_ps(inside) == 0) {
+                continue;
+            }
+            __m128 z = _mm_add_ps(_mm_mul_ps(depthA, px), rowDepth);
+            __m128 old = _mm_loadu_ps(row + x);
+            __m128 nearer = _mm_min_ps(old, z);
+            _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearer), _mm_andnot_ps(inside, old)));
+        }
+    }
+#else
+    for (int y = y0; y <= y1; ++y) {
+        float py = tileY + y + 0.5f;
+        float* row = depth + y * OCCLUSION_TILE_WIDTH;
+        for (int x = x0; x <= x1; ++x) {
+            float px = tileX + x + 0.5f;
+            bool inside = true;
+            for (int i = 0; i < 3; ++i) {
+                inside = inside && triangle.mEdgeA[i] * px + triangle.mEdgeB[i] * py + triangle.mEdgeC[i] >= 0.0f;
+            }
+            if (inside) {
+                row[x] = std::min(row[x], triangle.mDepthA * px + triangle.mDepthB * py + triangle.mDepthC);
+            }
+        }
+    }
+#endif
+}
+
+static void RasterizeTiles(OcclusionCuller* culler) {
+    PROFILE_ZONE("Occluder raster");
+    const uint32_t tiles = OCCLUSION_TILES_X * OCCLUSION_TILES_Y;
+    for (uint32_t tile = culler->mNextTile++; tile < tiles; tile = culler->mNextTile++) {
+        int tileX = (int)(tile % OCCLUSION_TILES_X * OCCLUSION_TILE_WIDTH);
+        int tileY = (int)(tile / OCCLUSION_TILES_X * OCCLUSION_TILE_HEIGHT);
+        float* depth = culler->mDepth.data() + tile * OCCLUSION_TILE_PIXELS;
+        std::fill(depth, depth + OCCLUSION_TILE_PIXELS, 1.0f);
+
+        // Out of time the tile stays as far as it got, which hides less but never too much
+        bool stop = OverBudget(*culler, 0.5);
+        for (uint32_t worker = 0; worker < culler->mWorkerCount && !stop; ++worker) {
+            const std::vector<OcclusionTriangle>& triangles = culler->mTriangles[worker];
+            for (uint32_t triangle : culler->mBins[worker][tile]) {
+                RasterizeTriangle(triangles[triangle], tileX, tileY, depth);
+            }
+        }
+
+        auto range = std::minmax_element(depth, depth + OCCLUSION_TILE_PIXELS);
+        culler->mTileMinDepth[tile] = *range.first;
+        culler->mTileMaxDepth[tile] = *range.second;
+    }
+}
+
+// Whether anything in the pixel rectangle of the tile is at least as far as depth
+static bool TileHasFartherPixel(const float* tileDepth, int x0, int x1, int y0, int y1, float depth) {
+#ifdef OCCLUSION_SSE
+    __m128 reference = _mm_set1_ps(depth);
+    __m128i first = _mm_set1_epi32(x0 - 1);
+    __m128i last = _mm_set1_epi32(x1 + 1);
+    for (int y = y0; y <= y1; ++y) {
+        const float* row = tileDepth + y * OCCLUSION_TILE_WIDTH;
+        for (int x = x0 & ~3; x <= x1; x += 4) {
+            __m128i lanes = _mm_add_epi32(_mm_set1_epi32(x), _mm_set_epi32(3, 2, 1, 0));
+            __m128 inRange = _mm_castsi128_ps(_mm_and_si128(_mm_cmpgt_epi32(lanes, first), _mm_cmplt_epi32(lanes, last)));
+            __m128 farther = _mm_cmpge_ps(_mm_loadu_ps(row + x), reference);
+            if (_mm_movemask_ps(_mm_and_ps(inRange, farther)) != 0) {
+                return true;
+            }
+        }
+    }
+    return false;
+#else
+    for (int y = y0; y <= y1; ++y) {
+        const float* row = tileDepth + y * OCCLUSION_TILE_WIDTH;
+        for (int x = x0; x <= x1; ++x) {
+            if (row[x] >= depth) {
+                return true;
+            }
+        }
+    }
+    return false;
+#endif
+}
+
+#ifdef OCCLUSION_SSE
+static float HorizontalMin(__m128 v) {
+    v = _mm_min_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1)));
+    v = _mm_min_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 0, 3, 2)));
+    return _mm_cvtss_f32(v);
+}
+
+static float HorizontalMax(__m128 v) {
+    v = _mm_max_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1)));
+    v = _mm_max_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 0, 3, 2)));
+    return _mm_cvtss_f32(v);
+}
+#endif
+
+// Screen rectangle and nearest depth of the box around a sphere. False when
+// the box reaches through the near plane, then nothing is in front to hide it.
+static bool ProjectSphereBox(const glm::mat4& m, const glm::vec3& center, float radius,
+                             glm::vec3* minimum, glm::vec3* maximum) {
+    glm::vec4 base = m * glm::vec4(center, 1.0f);
+    glm::vec4 axes[3] = { m[0] * radius, m[1] * radius, m[2] * radius };
+#ifdef OCCLUSION_SSE
+    // x, y, z and w of the four corners on the near and the far side of the
+    // box's local z, one corner per lane
+    __m128 signX = _mm_set_ps(1.0f, -1.0f, 1.0f, -1.0f);
+    __m128 signY = _mm_set_ps(1.0f, 1.0f, -1.0f, -1.0f);
+    __m128 low[4], high[4];
+    for (int i = 0; i < 4; ++i) {
+        __m128 side = _mm_add_ps(_mm_set1_ps(base[i]), _mm_add_ps(_mm_mul_ps(signX, _mm_set1_ps(axes[0][i])),
+                                                                 _mm_mul_ps(signY, _mm_set1_ps(axes[1][i]))));
+        low[i] = _mm_sub_ps(side, _mm_set1_ps(axes[2][i]));
+        high[i] = _mm_add_ps(side, _mm_set1_ps(axes[2][i]));
+    }
+    __m128 zero = _mm_setzero_ps();
+    __m128 behind = _mm_or_ps(_mm_cmple_ps(low[3], zero), _mm_cmplt_ps(low[2], _mm_sub_ps(zero, low[3])));
+    behind = _mm_or_ps(behind, _mm_or_ps(_mm_cmple_ps(high[3], zero), _mm_cmplt_ps(high[2], _mm_sub_ps(zero, high[3]))));
+    if (_mm_movemask_ps(behind) != 0) {
+        return false;
+    }
+    __m128 one = _mm_set1_ps(1.0f);
+    __m128 inverseLow = _mm_div_ps(one, low[3]);
+    __m128 inverseHigh = _mm_div_ps(one, high[3]);
+    glm::vec3 ndcMin, ndcMax;
+    for (int i = 0; i < 3; ++i) {
+        __m128 projectedLow = _mm_mul_ps(low[i], inverseLow);
+        __m128 projectedHigh = _mm_mul_ps(high[i], inverseHigh);
+        ndcMin[i] = HorizontalMin(_mm_min_ps(projectedLow, projectedHigh));
+        ndcMax[i] = HorizontalMax(_mm_max_ps(projectedLow, projectedHigh));
+    }
+    *minimum = ToScreen(glm::vec4(ndcMin, 1.0f));
+    *maximum = ToScreen(glm::vec4(ndcMax, 1.0f));
+#else
+    *minimum = glm::vec3(1e30f);
+    *maximum = glm::vec3(-1e30f);
+    for (int corner = 0; corner < 8; ++corner) {
+        glm::vec4 clip = base;
+        for (int axis = 0; axis < 3; ++axis) {
+            clip += (corner & (1 << axis)) ? axes[axis] : -axes[axis];
+        }
+        if (clip.w <= 0.0f || clip.z < -clip.w) {
+            return false;
+        }
+        glm::vec3 screen = ToScreen(clip);
+        *minimum = glm::min(*minimum, screen);
+        *maximum = glm::max(*maximum, screen);
+    }
+#endif
+    return true;
+}
+
+static bool OccludeeVisible(const OcclusionCuller& culler, const glm::vec3& center, float radius) {
+    glm::vec3 minimum, maximum;
+    if (!ProjectSphereBox(culler.mViewProjection, center, radius, &minimum, &maximum)) {
+        return true;
+    }
+
+    // Every pixel the box touches, plus one around it for what the centers of
+    // the occluder pixels missed
+    int x0 = std::max(0, (int)std::floor(minimum.x) - 1);
+    int x1 = std::min((int)OCCLUSION_WIDTH - 1, (int)std::floor(maximum.x) + 1);
+    int y0 = std::max(0, (int)std::floor(minimum.y) - 1);
+    int y1 = std::min((int)OCCLUSION_HEIGHT - 1, (int)std::floor(maximum.y) + 1);
+    if (x0 > x1 || y0 > y1) {
+        // Off screen, nothing to draw
+        return false;
+    }
+
+    for (int ty = y0 / (int)OCCLUSION_TILE_HEIGHT; ty <= y1 / (int)OCCLUSION_TILE_HEIGHT; ++ty) {
+        for (int tx = x0 / (int)OCCLUSION_TILE_WIDTH; tx <= x1 / (int)OCCLUSION_TILE_WIDTH; ++tx) {
+            uint32_t tile = ty * OCCLUSION_TILES_X + tx;
+            if (minimum.z > culler.mTileMaxDepth[tile]) {
+                continue;
+            }
+            if (minimum.z <= culler.mTileMinDepth[tile]) {
+                return true;
+            }
+            int tileX = tx * (int)OCCLUSION_TILE_WIDTH;
+            int tileY = ty * (int)OCCLUSION_TILE_HEIGHT;
+            if (TileHasFartherPixel(culler.mDepth.data() + tile * OCCLUSION_TILE_PIXELS,
+                                    std::max(x0, tileX) - tileX, std::min(x1, tileX + (int)OCCLUSION_TILE_WIDTH - 1) - tileX,
+                                    std::max(y0, tileY) - tileY, std::min(y1, tileY + (int)OCCLUSION_TILE_HEIGHT - 1) - tileY,
+                                    minimum.z)) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+static uint32_t RangeBegin(const OcclusionCuller& culler, uint32_t range) {
+    return (uint32_t)((uint64_t)culler.mVisible->size() * range / culler.mWorkerCount);
+}
+
+// Compacts the visible bounds of the range to its front
+static void TestRange(OcclusionCuller* culler, uint32_t range) {
+    PROFILE_ZONE("Occludee tests");
+    const CullingBounds& bounds = *culler->mBounds;
+    uint32_t* visible = culler->mVisible->data();
+    uint32_t begin = RangeBegin(*culler, range);
+    uint32_t end = RangeBegin(*culler, range + 1);
+
+    uint32_t count = begin;
+    uint32_t i = begin;
+    for (; i < end; ++i) {
+        if ((i - begin) % OCCLUSION_TEST_BATCH == 0 && OverBudget(*culler, 1.0)) {
+            break;
+        }
+        uint32_t index = visible[i];
+        glm::vec3 center(bounds.mCenterX[index], bounds.mCenterY[index], bounds.mCenterZ[index]);
+        if (OccludeeVisible(*culler, center, bounds.mRadius[index])) {
+            visible[count++] = index;
+        }
+    }
+    // Whatever the budget left untested stays visible
+    culler->mRangeUntested[range] = end - i;
+    for (; i < end; ++i) {
+        visible[count++] = visible[i];
+    }
+    culler->mRangeVisible[range] = count - begin;
+}
+
+static void RunPhase(OcclusionCuller* culler, uint32_t worker) {
+    switch (culler->mPhase) {
+        case OcclusionPhase::Setup:  SetupOccluders(culler, worker); break;
+        case OcclusionPhase::Raster: RasterizeTiles(culler); break;
+        case OcclusionPhase::Test:   TestRange(culler, worker); break;
+    }
+}
+
+static void WorkerThread(OcclusionCuller* culler, uint32_t worker) {
+    PROFILE_THREAD_NAME("Occlusion worker");
+    uint64_t generation = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(culler->mMutex);
+            culler->mWake.wait(lock, [&] { return culler->mQuit || culler->mGeneration != generation; });
+            if (culler->mQuit) {
+                return;
+            }
+            generation = culler->mGeneration;
+        }
+
+        RunPhase(culler, worker);
+
+        std::lock_guard<std::mutex> lock(culler->mMutex);
+        if (--culler->mPending == 0) {
+            culler->mDone.notify_one();
+        }
+    }
+}
+
+// Runs a phase on every thread and waits for all of them
+static void RunParallel(OcclusionCuller* culler, OcclusionPhase phase) {
+    culler->mPhase = phase;
+    culler->mNextTile = 0;
+    if (!culler->mThreads.empty()) {
+        {
+            std::lock_guard<std::mutex> lock(culler->mMutex);
+            culler->mGeneration++;
+            culler->mPending = (uint32_t)culler->mThreads.size();
+        }
+        culler->mWake.notify_all();
+    }
+    RunPhase(culler, 0);
+    if (!culler->mThreads.empty()) {
+        std::unique_lock<std::mutex> lock(culler->mMutex);
+        culler->mDone.wait(lock, [&] { return culler->mPending == 0; });
+    }
+}
+
+void CreateOcclusionCuller(OcclusionCuller* culler, uint32_t threadCount) {
+    if (threadCount == 0) {
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
+    }
+    threadCount = std::min(threadCount, CULLING_MAX_THREADS);
+
+    culler->mDepth.assign(OCCLUSION_WIDTH * OCCLUSION_HEIGHT, 1.0f);
+    culler->mTileMaxDepth.assign(OCCLUSION_TILES_X * OCCLUSION_TILES_Y, 1.0f);
+    culler->mTileMinDepth.assign(OCCLUSION_TILES_X * OCCLUSION_TILES_Y, 1.0f);
+    culler->mWorkerCount = threadCount;
+    culler->mProjectedVertices.resize(threadCount);
+    culler->mTriangles.resize(threadCount);
+    culler->mBins.assign(threadCount, std::vector<std::vector<uint32_t>>(OCCLUSION_TILES_X * OCCLUSION_TILES_Y));
+    culler->mRangeVisible.resize(threadCount);
+    culler->mRangeUntested.resize(threadCount);
+    for (uint32_t worker = 1; worker < threadCount; ++worker) {
+        culler->mThreads.emplace_back(WorkerThread, culler, worker);
+    }
+}
+
+void DestroyOcclusionCuller(OcclusionCuller* culler) {
+    {
+        std::lock_guard<std::mutex> lock(culler->mMutex);
+        culler->mQuit = true;
+    }
+    culler->mWake.notify_all();
+    for (std::thread& thread : culler->mThreads) {
+        thread.join();
+    }
+    culler->mThreads.clear();
+}
+
+void OcclusionCullerBegin(OcclusionCuller* culler, const glm::mat4& viewProjection) {
+    culler->mViewProjection = viewProjection;
+    culler->mOccluders.clear();
+    culler->mBudgetTriangles = 0;
+}
+
+bool OcclusionCullerAddOccluder(OcclusionCuller* culler, const MeshData* meshData, const glm::mat4& modelMatrix) {
+    uint32_t triangles = (uint32_t)(meshData->indices.size() / 3);
+    if (culler->mBudgetTriangles + triangles > culler->mTriangleBudget) {
+        return false;
+    }
+    culler->mBudgetTriangles += triangles;
+    OcclusionOccluder occluder;
+    occluder.mMeshData = meshData;
+    occluder.mModelMatrix = modelMatrix;
+    culler->mOccluders.push_back(occluder);
+    return true;
+}
+
+void OcclusionCullerRun(OcclusionCuller* culler, const CullingBounds& bounds, std::vector<uint32_t>* visible) {
+    PROFILE_FUNCTION();
+    culler->mStats = OcclusionStats();
+    culler->mStats.mThreads = culler->mWorkerCount;
+    if (culler->mOccluders.empty() || visible->empty()) {
+        return;
+    }
+    culler->mStart = std::chrono::steady_clock::now();
+
+    RunParallel(culler, OcclusionPhase::Setup);
+    RunParallel(culler, OcclusionPhase::Raster);
+    culler->mStats.mRasterTime = MillisecondsSince(culler->mStart);
+
+    auto testStart = std::chrono::steady_clock::now();
+    culler->mBounds = &bounds;
+    culler->mVisible = visible;
+    RunParallel(culler, OcclusionPhase::Test);
+    culler->mStats.mTestTime = MillisecondsSince(testStart);
+
+    // Ranges are in order, so moving them together keeps the order
+    uint32_t count = culler->mRangeVisible[0];
+    uint32_t untested = culler->mRangeUntested[0];
+    for (uint32_t range = 1; range < culler->mWorkerCount; ++range) {
+        uint32_t* begin = visible->data() + RangeBegin(*culler, range);
+        std::copy(begin, begin + culler->mRangeVisible[range], visible->data() + count);
+        count += culler->mRangeVisible[range];
+        untested += culler->mRangeUntested[range];
+    }
+
+    culler->mStats.mOccluders = (uint32_t)culler->mOccluders.size();
+    for (const std::vector<OcclusionTriangle>& triangles : culler->mTriangles) {
+        culler->mStats.mTriangles += (uint32_t)triangles.size();
+    }
+    culler->mStats.mTested = (uint32_t)visible->size() - untested;
+    culler->mStats.mOccluded = (uint32_t)visible->size() - count;
+    culler->mStats.mUntested = untested;
+    visible->resize(count);
+}
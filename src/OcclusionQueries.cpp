@@ -0,0 +1,69 @@
+#include "OcclusionQueries.hpp"
+#include "CpuProfiler.hpp"
+
+void CreateOcclusionQueries(OcclusionQueries* queries, uint32_t objectCount) {
+    // Core since 4.3, lets the GPU answer from coarse depth without touching every sample
+    queries->mTarget = GLAD_GL_ARB_ES3_compatibility ? GL_ANY_SAMPLES_PASSED_CONSERVATIVE : GL_ANY_SAMPLES_PASSED;
+    queries->mFrame = 0;
+    queries->mObjects.assign(objectCount, OcclusionQueryObject());
+    queries->mPendingObjects.clear();
+    queries->mStats = OcclusionQueryStats();
+}
+
+void DestroyOcclusionQueries(OcclusionQueries* queries) {
+    for (OcclusionQueryObject& object : queries->mObjects) {
+        if (object.mQuery != 0) {
+            glDeleteQueries(1, &object.mQuery);
+        }
+    }
+    queries->mObjects.clear();
+    queries->mPendingObjects.clear();
+}
+
+void OcclusionQueriesBeginFrame(OcclusionQueries* queries) {
+    PROFILE_FUNCTION();
+    queries->mFrame++;
+    queries->mStats = OcclusionQueryStats();
+
+    // Whatever is not available yet stays pending for the next frame
+    size_t kept = 0;
+    for (uint32_t index : queries->mPendingObjects) {
+        OcclusionQueryObject& object = queries->mObjects[index];
+        GLuint available = GL_FALSE;
+        glGetQueryObjectuiv(object.mQuery, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (available == GL_FALSE) {
+            queries->mPendingObjects[kept++] = index;
+            continue;
+        }
+        GLuint samples = 0;
+        glGetQueryObjectuiv(object.mQuery, GL_QUERY_RESULT, &samples);
+        object.mVisible = samples != 0;
+        object.mPending = false;
+        queries->mStats.mResultsRead++;
+    }
+    queries->mPendingObjects.resize(kept);
+}
+
+GLuint OcclusionQueriesIssue(OcclusionQueries* queries, uint32_t object) {
+    OcclusionQueryObject& state = queries->mObjects[object];
+    if (state.mVisible) {
+        // A result still on its way will tell soon enough, and the others wait
+        // their turn. The object index spreads the turns over the frames.
+        if (state.mPending || (queries->mFrame + object) % queries->mInterval != 0) {
+            return 0;
+        }
+    } else {
+        queries->mStats.mHidden++;
+    }
+
+    if (state.mQuery == 0) {
+        glGenQueries(1, &state.mQuery);
+    }
+    // Reissuing a pending query replaces its result, it is only read once
+    if (!state.mPending) {
+        state.mPending = true;
+        queries->mPendingObjects.push_back(object);
+    }
+    queries->mStats.mIssued++;
+    return state.mQuery;
+}
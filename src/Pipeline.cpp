@@ -0,0 +1,133 @@
+#include "Pipeline.hpp"
+
+#include <cstdlib>
+#include <vector>
+
+// Array uniforms and attributes are reported as "name[0]", we store them as "name"
+static std::string StripArraySuffix(const GLchar* name, GLsizei length) {
+    std::string result(name, length);
+    size_t bracket = result.find('[');
+    if (bracket != std::string::npos) {
+        result.erase(bracket);
+    }
+    return result;
+}
+
+void PipelineReflect(Pipeline* pipeline) {
+    pipeline->mUniforms.clear();
+    pipeline->mAttributes.clear();
+    pipeline->mUniformBlocks.clear();
+
+    GLint uniformCount = 0, uniformMaxLength = 0;
+    glGetProgramiv(pipeline->mProgram, GL_ACTIVE_UNIFORMS, &uniformCount);
+    glGetProgramiv(pipeline->mProgram, GL_ACTIVE_UNIFORM_MAX_LENGTH, &uniformMaxLength);
+
+    std::vector<GLchar> name(uniformMaxLength > 0 ? uniformMaxLength : 1);
+    for (GLint i = 0; i < uniformCount; ++i) {
+        ShaderVariable variable;
+        GLsizei length = 0;
+        glGetActiveUniform(pipeline->mProgram, i, (GLsizei)name.size(), &length,
+                           &variable.mSize, &variable.mType, name.data());
+        // Members of uniform blocks have no location of their own
+        variable.mLocation = glGetUniformLocation(pipeline->mProgram, name.data());
+        variable.mProgram = pipeline->mProgram;
+        if (variable.mLocation < 0) {
+            continue;
+        }
+        pipeline->mUniforms[StripArraySuffix(name.data(), length)] = variable;
+    }
+
+    GLint attributeCount = 0, attributeMaxLength = 0;
+    glGetProgramiv(pipeline->mProgram, GL_ACTIVE_ATTRIBUTES, &attributeCount);
+    glGetProgramiv(pipeline->mProgram, GL_ACTIVE_ATTRIBUTE_MAX_LENGTH, &attributeMaxLength);
+
+    name.resize(attributeMaxLength > 0 ? attributeMaxLength : 1);
+    for (GLint i = 0; i < attributeCount; ++i) {
+        ShaderVariable variable;
+        GLsizei length = 0;
+        glGetActiveAttrib(pipeline->mProgram, i, (GLsizei)name.size(), &length,
+                          &variable.mSize, &variable.mType, name.data());
+        // Built-ins such as gl_VertexID are reported with location -1
+        variable.mLocation = glGetAttribLocation(pipeline->mProgram, name.data());
+        variable.mProgram = pipeline->mProgram;
+        if (variable.mLocation < 0) {
+            continue;
+        }
+        pipeline->mAttributes[StripArraySuffix(name.data(), length)] = variable;
+    }
+
+    GLint blockCount = 0, blockMaxLength = 0;
+    glGetProgramiv(pipeline->mProgram, GL_ACTIVE_UNIFORM_BLOCKS, &blockCount);
+    glGetProgramiv(pipeline->mProgram, GL_ACTIVE_UNIFORM_BLOCK_MAX_NAME_LENGTH, &blockMaxLength);
+
+    name.resize(blockMaxLength > 0 ? blockMaxLength : 1);
+    for (GLint i = 0; i < blockCount; ++i) {
+        GLsizei length = 0;
+        glGetActiveUniformBlockName(pipeline->mProgram, i, (GLsizei)name.size(), &length, name.data());
+        pipeline->mUniformBlocks[std::string(name.data(), length)] = i;
+    }
+}
+
+void PipelineBind(const Pipeline& pipeline) {
+    if (pipeline.mProgramPipeline != 0) {
+        // A current program takes precedence over the bound program pipeline
+        glUseProgram(0);
+        glBindProgramPipeline(pipeline.mProgramPipeline);
+    } else {
+        glUseProgram(pipeline.mProgram);
+    }
+}
+
+uint64_t PipelineBindingId(const Pipeline& pipeline) {
+    // Program and program pipeline names are separate namespaces, so the kind
+    // sits above the 32 bit name instead of being mixed into it
+    if (pipeline.mProgramPipeline != 0) {
+        return PIPELINE_BINDING_SEPARABLE | pipeline.mProgramPipeline;
+    }
+    return pipeline.mProgram;
+}
+
+void PipelineBindUniformBlock(Pipeline* pipeline, const GLchar* name, GLuint binding) {
+    // GLSL 4.10 has no layout(binding = N), so blocks are routed to their binding point here
+    auto it = pipeline->mUniformBlocks.find(name);
+    if (it != pipeline->mUniformBlocks.end()) {
+        glUniformBlockBinding(pipeline->mProgram, it->second, binding);
+    }
+}
+
+GLint FindUniformLocation(const Pipeline& pipeline, const GLchar* name) {
+    auto it = pipeline.mUniforms.find(name);
+    if (it == pipeline.mUniforms.end()) {
+        std::cerr << "Could not find " << name << " maybe a misspelling" << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    return it->second.mLocation;
+}
+
+void SetUniform(const Uniform<GLfloat>& uniform, GLfloat value) {
+    glProgramUniform1f(uniform.mProgram, uniform.mLocation, value);
+}
+
+void SetUniform(const Uniform<GLint>& uniform, GLint value) {
+    glProgramUniform1i(uniform.mProgram, uniform.mLocation, value);
+}
+
+void SetUniform(const Uniform<glm::vec2>& uniform, const glm::vec2& value) {
+    glProgramUniform2fv(uniform.mProgram, uniform.mLocation, 1, &value[0]);
+}
+
+void SetUniform(const Uniform<glm::vec3>& uniform, const glm::vec3& value) {
+    glProgramUniform3fv(uniform.mProgram, uniform.mLocation, 1, &value[0]);
+}
+
+void SetUniform(const Uniform<glm::vec4>& uniform, const glm::vec4& value) {
+    glProgramUniform4fv(uniform.mProgram, uniform.mLocation, 1, &value[0]);
+}
+
+void SetUniform(const Uniform<glm::mat3>& uniform, const glm::mat3& value) {
+    glProgramUniformMatrix3fv(uniform.mProgram, uniform.mLocation, 1, false, &value[0][0]);
+}
+
+void SetUniform(const Uniform<glm::mat4>& uniform, const glm::mat4& value) {
+    glProgramUniformMatrix4fv(uniform.mProgram, uniform.mLocation, 1, false, &value[0][0]);
+}
@@ -0,0 +1,227 @@
+#include "PipelineBuilder.hpp"
+#include "Graphics.hpp"
+#include "CpuProfiler.hpp"
+
+#include <iostream>
+
+void CreatePipelineBuilder(PipelineBuilder* builder, ProgramCache* cache, ResourceManager* resources) {
+    builder->mCache = cache;
+    builder->mResources = resources;
+
+    // 0xFFFFFFFF lets the driver pick how many threads to use
+    if (GLAD_GL_KHR_parallel_shader_compile) {
+        glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+        builder->mParallel = true;
+    } else if (GLAD_GL_ARB_parallel_shader_compile) {
+        glMaxShaderCompilerThreadsARB(0xFFFFFFFF);
+        builder->mParallel = true;
+    }
+}
+
+static void DeleteBuildObjects(PipelineBuild* build) {
+    if (build->mVertexShader != 0) {
+        glDeleteShader(build->mVertexShader);
+    }
+    if (build->mFragmentShader != 0) {
+        glDeleteShader(build->mFragmentShader);
+    }
+    build->mVertexShader = 0;
+    build->mFragmentShader = 0;
+}
+
+void DestroyPipelineBuilder(PipelineBuilder* builder) {
+    for (PipelineBuild& build : builder->mBuilds) {
+        DeleteBuildObjects(&build);
+        if (build.mProgram != 0) {
+            glDeleteProgram(build.mProgram);
+        }
+    }
+    *builder = PipelineBuilder();
+}
+
+// Hands pipeline's reference to target, the old one goes through the resource manager
+static void ReplaceTarget(PipelineBuilder* builder, Pipeline* target, const Pipeline& pipeline) {
+    ResourceManagerRelease(builder->mResources, target->mHandle);
+    // A rebuilt program leaves its old binary behind
+    if (builder->mCache != nullptr && target->mCacheKey != 0 && target->mCacheKey != pipeline.mCacheKey) {
+        ProgramCacheRelease(builder->mCache, target->mCacheKey);
+    }
+    *target = pipeline;
+}
+
+static void LogReady(const std::string& name, std::chrono::steady_clock::time_point requestTime) {
+    auto now = std::chrono::steady_clock::now();
+    std::cout << "Pipeline " << name << " ready after " <<
+                 std::chrono::duration<double, std::milli>(now - requestTime).count() << " ms" << std::endl;
+}
+
+// Swaps the finished program into the targets
+static void CompleteBuild(PipelineBuilder* builder, PipelineBuild* build) {
+    Pipeline pipeline = CreatePipelineFromProgram(build->mProgram);
+    pipeline.mHandle = ResourceManagerRegister(builder->mResources, ResourceType::Program, build->mProgram);
+    pipeline.mCacheKey = builder->mCache != nullptr ? build->mCacheKey : 0;
+    build->mProgram = 0;
+
+    for (size_t i = 0; i < build->mTargets.size(); ++i) {
+        if (i > 0) {
+            ResourceManagerAddRef(builder->mResources, pipeline.mHandle);
+        }
+        ReplaceTarget(builder, build->mTargets[i], pipeline);
+    }
+
+    LogReady(build->mName, build->mRequestTime);
+    build->mState = PipelineBuildState::Done;
+}
+
+static void FailBuild(PipelineBuilder* builder, PipelineBuild* build) {
+    std::cout << "Pipeline " << build->mName << " failed, keeping the current one" << std::endl;
+    DeleteBuildObjects(build);
+    glDeleteProgram(build->mProgram);
+    build->mProgram = 0;
+    build->mState = PipelineBuildState::Done;
+    builder->mFailed++;
+}
+
+void PipelineBuilderSubmit(PipelineBuilder* builder, const std::string& name, const std::string& vertexSource,
+                           const std::string& fragmentSource, Pipeline* target,
+                           std::chrono::steady_clock::time_point requestTime) {
+    PROFILE_FUNCTION();
+    // Separable stages are shared between pipelines, so only new stages cost a compile
+    if (builder->mProgramPipelines != nullptr) {
+        Pipeline pipeline;
+        if (ProgramPipelineCacheGet(builder->mProgramPipelines, vertexSource, fragmentSource, &pipeline)) {
+            ReplaceTarget(builder, target, pipeline);
+            // The pipeline target held before may have been the last user of its stages
+            ProgramPipelineCachePrune(builder->mProgramPipelines);
+            LogReady(name, requestTime);
+        } else {
+            std::cout << "Pipeline " << name << " failed, keeping the current one" << std::endl;
+            builder->mFailed++;
+        }
+        return;
+    }
+
+    uint64_t key = builder->mCache != nullptr ? ProgramCacheKey(*builder->mCache, vertexSource, fragmentSource, "")
+                                              : HashString(fragmentSource, HashString(vertexSource));
+    for (PipelineBuild& pending : builder->mBuilds) {
+        if (pending.mCacheKey == key && pending.mState != PipelineBuildState::Done) {
+            pending.mTargets.push_back(target);
+            return;
+        }
+    }
+
+    PipelineBuild build;
+    build.mName = name;
+    build.mTargets.push_back(target);
+    build.mRequestTime = requestTime;
+    build.mCacheKey = key;
+    build.mProgram = glCreateProgram();
+
+    if (builder->mCache != nullptr) {
+        if (ProgramCacheLoad(builder->mCache, build.mCacheKey, build.mProgram)) {
+            CompleteBuild(builder, &build);
+            return;
+        }
+    }
+
+    // Kick off both compiles now, nothing here waits for them
+    build.mVertexShader = CompileShader(GL_VERTEX_SHADER, vertexSource);
+    build.mFragmentShader = CompileShader(GL_FRAGMENT_SHADER, fragmentSource);
+    builder->mBuilds.push_back(build);
+}
+
+static bool ObjectCompleted(const PipelineBuilder& builder, GLuint object, bool program) {
+    if (!builder.mParallel) {
+        return true;
+    }
+    GLint completed = GL_FALSE;
+    if (program) {
+        glGetProgramiv(object, GL_COMPLETION_STATUS_KHR, &completed);
+    } else {
+        glGetShaderiv(object, GL_COMPLETION_STATUS_KHR, &completed);
+    }
+    return completed == GL_TRUE;
+}
+
+// Moves build forward as far as it can go without waiting, returns true once it is done
+static bool AdvanceBuild(PipelineBuilder* builder, PipelineBuild* build) {
+    if (build->mState == PipelineBuildState::Compiling) {
+        if (!ObjectCompleted(*builder, build->mVertexShader, false) ||
+            !ObjectCompleted(*builder, build->mFragmentShader, false)) {
+            return false;
+        }
+        bool compiled = CheckShaderCompileStatus(build->mVertexShader, build->mName + " vertex shader");
+        compiled = CheckShaderCompileStatus(build->mFragmentShader, build->mName + " fragment shader") && compiled;
+        if (!compiled) {
+            FailBuild(builder, build);
+            return true;
+        }
+
+        glAttachShader(build->mProgram, build->mVertexShader);
+        glAttachShader(build->mProgram, build->mFragmentShader);
+        if (builder->mCache != nullptr) {
+            glProgramParameteri(build->mProgram, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        }
+        glLinkProgram(build->mProgram);
+        build->mState = PipelineBuildState::Linking;
+        // Without the extension the link status query below would block anyway, leave it for the next poll
+        if (!builder->mParallel) {
+            return false;
+        }
+    }
+
+    if (build->mState == PipelineBuildState::Linking) {
+        if (!ObjectCompleted(*builder, build->mProgram, true)) {
+            return false;
+        }
+        glDetachShader(build->mProgram, build->mVertexShader);
+        glDetachShader(build->mProgram, build->mFragmentShader);
+        if (!CheckProgramLinkStatus(build->mProgram, build->mName)) {
+            FailBuild(builder, build);
+            return true;
+        }
+        DeleteBuildObjects(build);
+        if (builder->mCache != nullptr) {
+            ProgramCacheStore(builder->mCache, build->mCacheKey, build->mProgram);
+        }
+        CompleteBuild(builder, build);
+    }
+    return true;
+}
+
+uint32_t PipelineBuilderPoll(PipelineBuilder* builder) {
+    PROFILE_FUNCTION();
+    uint32_t finished = 0;
+    for (PipelineBuild& build : builder->mBuilds) {
+        if (AdvanceBuild(builder, &build)) {
+            finished++;
+        }
+        if (!builder->mParallel) {
+            // Only one blocking step per poll
+            break;
+        }
+    }
+
+    for (size_t i = 0; i < builder->mBuilds.size();) {
+        if (builder->mBuilds[i].mState == PipelineBuildState::Done) {
+            builder->mBuilds.erase(builder->mBuilds.begin() + i);
+        } else {
+            ++i;
+        }
+    }
+    return finished;
+}
+
+void PipelineBuilderFinish(PipelineBuilder* builder) {
+    bool parallel = builder->mParallel;
+    // Blocking is fine here, so let every status query wait
+    builder->mParallel = false;
+    while (!builder->mBuilds.empty()) {
+        PipelineBuilderPoll(builder);
+    }
+    builder->mParallel = parallel;
+}
+
+bool PipelineBuilderIdle(const PipelineBuilder& builder) {
+    return builder.mBuilds.empty();
+}
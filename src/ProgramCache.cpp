@@ -0,0 +1,243 @@
+#include "ProgramCache.hpp"
+#include "CpuProfiler.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// FNV-1a
+uint64_t HashString(const std::string& string, uint64_t seed) {
+    uint64_t hash = seed;
+    for (unsigned char c : string) {
+        hash ^= c;
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+static std::string GetGLString(GLenum name) {
+    const GLubyte* string = glGetString(name);
+    return string != nullptr ? std::string((const char*)string) : std::string();
+}
+
+// Maps the whole file read-only, or reads it into memory where mmap isn't available
+static bool MapCacheFile(ProgramCache* cache) {
+#ifndef _WIN32
+    int file = open(cache->mPath.c_str(), O_RDONLY);
+    if (file < 0) {
+        return false;
+    }
+    struct stat info;
+    if (fstat(file, &info) != 0 || info.st_size < (off_t)sizeof(ProgramCacheHeader)) {
+        close(file);
+        return false;
+    }
+    void* mapped = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+    close(file);
+    if (mapped == MAP_FAILED) {
+        return false;
+    }
+    cache->mMapped = mapped;
+    cache->mMappedSize = info.st_size;
+    return true;
+#else
+    std::ifstream file(cache->mPath, std::ios::binary | std::ios::ate);
+    if (!file) {
+        return false;
+    }
+    size_t size = (size_t)file.tellg();
+    if (size < sizeof(ProgramCacheHeader)) {
+        return false;
+    }
+    unsigned char* data = new unsigned char[size];
+    file.seekg(0);
+    file.read((char*)data, size);
+    cache->mMapped = data;
+    cache->mMappedSize = size;
+    return true;
+#endif
+}
+
+static void UnmapCacheFile(ProgramCache* cache) {
+    if (cache->mMapped == nullptr) {
+        return;
+    }
+#ifndef _WIN32
+    munmap(cache->mMapped, cache->mMappedSize);
+#else
+    delete[] (unsigned char*)cache->mMapped;
+#endif
+    cache->mMapped = nullptr;
+    cache->mMappedSize = 0;
+}
+
+void LoadProgramCache(ProgramCache* cache, const std::string& path) {
+    PROFILE_FUNCTION();
+    cache->mPath = path;
+    cache->mDriver = GetGLString(GL_VENDOR) + "|" + GetGLString(GL_RENDERER) + "|" + GetGLString(GL_VERSION);
+
+    GLint formatCount = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formatCount);
+    cache->mSupported = formatCount > 0;
+    if (!cache->mSupported || !MapCacheFile(cache)) {
+        return;
+    }
+
+    const unsigned char* base = (const unsigned char*)cache->mMapped;
+    ProgramCacheHeader header;
+    memcpy(&header, base, sizeof(header));
+    size_t recordsEnd = sizeof(header) + (size_t)header.mEntryCount * sizeof(ProgramCacheRecord);
+    if (header.mMagic != PROGRAM_CACHE_MAGIC || header.mVersion != PROGRAM_CACHE_VERSION ||
+        recordsEnd > cache->mMappedSize) {
+        std::cout << "Ignoring invalid program cache " << path << std::endl;
+        UnmapCacheFile(cache);
+        return;
+    }
+
+    for (uint32_t i = 0; i < header.mEntryCount; ++i) {
+        ProgramCacheRecord record;
+        memcpy(&record, base + sizeof(header) + i * sizeof(ProgramCacheRecord), sizeof(record));
+        if ((size_t)record.mOffset + record.mSize > cache->mMappedSize) {
+            continue;
+        }
+        ProgramCacheEntry& entry = cache->mEntries[record.mKey];
+        entry.mFormat = record.mFormat;
+        entry.mData = base + record.mOffset;
+        entry.mSize = (GLsizei)record.mSize;
+    }
+}
+
+void CloseProgramCache(ProgramCache* cache) {
+    // Entries may point into the mapping
+    cache->mEntries.clear();
+    UnmapCacheFile(cache);
+    *cache = ProgramCache();
+}
+
+uint64_t ProgramCacheKey(const ProgramCache& cache, const std::string& vertexSource,
+                         const std::string& fragmentSource, const std::string& defines) {
+    uint64_t hash = HashString(cache.mDriver);
+    hash = HashString(defines, hash);
+    hash = HashString(vertexSource, hash);
+    // Separator, so moving text from one stage to the other changes the key
+    hash = HashString("\x1f", hash);
+    return HashString(fragmentSource, hash);
+}
+
+bool ProgramCacheLoad(ProgramCache* cache, uint64_t key, GLuint program) {
+    auto it = cache->mEntries.find(key);
+    if (!cache->mSupported || it == cache->mEntries.end()) {
+        cache->mMisses++;
+        return false;
+    }
+
+    ProgramCacheEntry& entry = it->second;
+    glProgramBinary(program, entry.mFormat, entry.mData, entry.mSize);
+    GLint linked = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &linked);
+    if (linked != GL_TRUE) {
+        // Driver changed in a way the version string didn't show, rebuild it
+        cache->mEntries.erase(it);
+        cache->mDirty = true;
+        cache->mMisses++;
+        return false;
+    }
+
+    entry.mUsed = true;
+    cache->mHits++;
+    return true;
+}
+
+void ProgramCacheStore(ProgramCache* cache, uint64_t key, GLuint program) {
+    if (!cache->mSupported) {
+        return;
+    }
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0) {
+        return;
+    }
+
+    ProgramCacheEntry& entry = cache->mEntries[key];
+    entry.mOwned.resize(length);
+    GLsizei written = 0;
+    glGetProgramBinary(program, length, &written, &entry.mFormat, entry.mOwned.data());
+    entry.mOwned.resize(written);
+    entry.mData = entry.mOwned.data();
+    entry.mSize = written;
+    entry.mUsed = true;
+    cache->mDirty = true;
+}
+
+void ProgramCacheRelease(ProgramCache* cache, uint64_t key) {
+    auto it = cache->mEntries.find(key);
+    if (it != cache->mEntries.end()) {
+        it->second.mUsed = false;
+    }
+}
+
+void ProgramCacheSave(ProgramCache* cache, bool prune) {
+    PROFILE_FUNCTION();
+    if (!cache->mSupported) {
+        return;
+    }
+    // Dropping stale entries also counts as a change
+    if (prune) {
+        for (auto it = cache->mEntries.begin(); it != cache->mEntries.end();) {
+            if (it->second.mUsed) {
+                ++it;
+                continue;
+            }
+            it = cache->mEntries.erase(it);
+            cache->mDirty = true;
+        }
+    }
+    if (!cache->mDirty) {
+        return;
+    }
+
+    ProgramCacheHeader header;
+    std::vector<ProgramCacheRecord> records;
+    for (const auto& it : cache->mEntries) {
+        ProgramCacheRecord record;
+        record.mKey = it.first;
+        record.mFormat = it.second.mFormat;
+        record.mSize = (uint32_t)it.second.mSize;
+        records.push_back(record);
+    }
+    header.mEntryCount = (uint32_t)records.size();
+
+    uint32_t offset = (uint32_t)(sizeof(header) + records.size() * sizeof(ProgramCacheRecord));
+    for (ProgramCacheRecord& record : records) {
+        record.mOffset = offset;
+        offset += record.mSize;
+    }
+
+    // Write to the side and rename over, the old file may still be mapped
+    std::string temporaryPath = cache->mPath + ".tmp";
+    std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+    if (!file) {
+        std::cout << "Could not write program cache " << temporaryPath << std::endl;
+        return;
+    }
+    file.write((const char*)&header, sizeof(header));
+    file.write((const char*)records.data(), records.size() * sizeof(ProgramCacheRecord));
+    for (const ProgramCacheRecord& record : records) {
+        const ProgramCacheEntry& entry = cache->mEntries[record.mKey];
+        file.write((const char*)entry.mData, entry.mSize);
+    }
+    file.close();
+    if (!file || std::rename(temporaryPath.c_str(), cache->mPath.c_str()) != 0) {
+        std::cout << "Could not write program cache " << cache->mPath << std::endl;
+        return;
+    }
+    cache->mDirty = false;
+}
@@ -0,0 +1,122 @@
+#include "ProgramPipelines.hpp"
+#include "Graphics.hpp"
+#include "ProgramCache.hpp"
+
+#include <unordered_set>
+
+void CreateProgramPipelineCache(ProgramPipelineCache* cache, ResourceManager* resources) {
+    *cache = ProgramPipelineCache();
+    cache->mResources = resources;
+}
+
+void DestroyProgramPipelineCache(ProgramPipelineCache* cache) {
+    for (auto& it : cache->mPipelines) {
+        ResourceManagerRelease(cache->mResources, it.second.mPipeline.mHandle);
+    }
+    for (auto& it : cache->mStages) {
+        ResourceManagerRelease(cache->mResources, it.second.mHandle);
+    }
+    *cache = ProgramPipelineCache();
+}
+
+// Returns the key of the stage, compiling it first if it is new
+static uint64_t GetStage(ProgramPipelineCache* cache, GLenum type, const std::string& source) {
+    uint64_t key = HashString(source, type);
+    if (cache->mStages.count(key) > 0) {
+        cache->mStageHits++;
+        return key;
+    }
+
+    // Compiles, links with GL_PROGRAM_SEPARABLE set and drops the shader object in one call
+    const char* src = source.c_str();
+    GLuint program = glCreateShaderProgramv(type, 1, &src);
+    cache->mStageCompiles++;
+
+    Pipeline stage;
+    const char* label = type == GL_VERTEX_SHADER ? "separable vertex stage" : "separable fragment stage";
+    if (program != 0 && CheckProgramLinkStatus(program, label)) {
+        // Blocks are bound per stage program, the pipeline object has no block state of its own
+        stage = CreatePipelineFromProgram(program);
+        stage.mHandle = ResourceManagerRegister(cache->mResources, ResourceType::Program, program);
+    } else if (program != 0) {
+        glDeleteProgram(program);
+    }
+    cache->mStages[key] = stage;
+    return key;
+}
+
+static uint64_t StagePairKey(uint64_t vertexKey, uint64_t fragmentKey) {
+    uint64_t keys[2] = {vertexKey, fragmentKey};
+    return HashString(std::string(reinterpret_cast<const char*>(keys), sizeof(keys)));
+}
+
+static Pipeline CreateProgramPipeline(ProgramPipelineCache* cache, const Pipeline& vertex, const Pipeline& fragment) {
+    GLuint programPipeline = 0;
+    glGenProgramPipelines(1, &programPipeline);
+    glUseProgramStages(programPipeline, GL_VERTEX_SHADER_BIT, vertex.mProgram);
+    glUseProgramStages(programPipeline, GL_FRAGMENT_SHADER_BIT, fragment.mProgram);
+    // Both stages passed their link status check. glValidateProgramPipeline would
+    // also judge the GL state bound right now, so it is not a creation time check.
+
+    // Uniforms keep the program they came from, mProgram is only the default for missing ones
+    Pipeline pipeline;
+    pipeline.mProgram = vertex.mProgram;
+    pipeline.mProgramPipeline = programPipeline;
+    pipeline.mHandle = ResourceManagerRegister(cache->mResources, ResourceType::ProgramPipeline, programPipeline);
+    pipeline.mUniforms = vertex.mUniforms;
+    pipeline.mUniforms.insert(fragment.mUniforms.begin(), fragment.mUniforms.end());
+    pipeline.mAttributes = vertex.mAttributes;
+    pipeline.mUniformBlocks = vertex.mUniformBlocks;
+    pipeline.mUniformBlocks.insert(fragment.mUniformBlocks.begin(), fragment.mUniformBlocks.end());
+    return pipeline;
+}
+
+bool ProgramPipelineCacheGet(ProgramPipelineCache* cache, const std::string& vertexSource,
+                             const std::string& fragmentSource, Pipeline* out) {
+    uint64_t vertexKey = GetStage(cache, GL_VERTEX_SHADER, vertexSource);
+    uint64_t fragmentKey = GetStage(cache, GL_FRAGMENT_SHADER, fragmentSource);
+    const Pipeline& vertex = cache->mStages[vertexKey];
+    const Pipeline& fragment = cache->mStages[fragmentKey];
+    if (vertex.mProgram == 0 || fragment.mProgram == 0) {
+        return false;
+    }
+
+    uint64_t pairKey = StagePairKey(vertexKey, fragmentKey);
+    auto it = cache->mPipelines.find(pairKey);
+    if (it == cache->mPipelines.end()) {
+        ProgramPipelineEntry entry;
+        entry.mPipeline = CreateProgramPipeline(cache, vertex, fragment);
+        entry.mVertexKey = vertexKey;
+        entry.mFragmentKey = fragmentKey;
+        it = cache->mPipelines.emplace(pairKey, entry).first;
+    }
+
+    *out = it->second.mPipeline;
+    ResourceManagerAddRef(cache->mResources, out->mHandle);
+    return true;
+}
+
+void ProgramPipelineCachePrune(ProgramPipelineCache* cache) {
+    std::unordered_set<uint64_t> usedStages;
+    for (auto it = cache->mPipelines.begin(); it != cache->mPipelines.end();) {
+        const ProgramPipelineEntry& entry = it->second;
+        if (ResourceManagerRefCount(*cache->mResources, entry.mPipeline.mHandle) > 1) {
+            usedStages.insert(entry.mVertexKey);
+            usedStages.insert(entry.mFragmentKey);
+            ++it;
+            continue;
+        }
+        ResourceManagerRelease(cache->mResources, entry.mPipeline.mHandle);
+        it = cache->mPipelines.erase(it);
+    }
+
+    // Failed stages hold no program, they stay so a broken source isn't compiled twice
+    for (auto it = cache->mStages.begin(); it != cache->mStages.end();) {
+        if (it->second.mProgram == 0 || usedStages.count(it->first) > 0) {
+            ++it;
+            continue;
+        }
+        ResourceManagerRelease(cache->mResources, it->second.mHandle);
+        it = cache->mStages.erase(it);
+    }
+}
@@ -0,0 +1,201 @@
+#include "RenderQueue.hpp"
+#include "CpuProfiler.hpp"
+
+#include <cstring>
+
+// Positive IEEE floats compare like unsigned integers, so the top 24 bits
+// of the bit pattern give a monotonic depth without knowing the depth range
+static uint64_t QuantizeDepth(float viewDepth) {
+    if (!(viewDepth > 0.0f)) {
+        viewDepth = 0.0f;
+    }
+    uint32_t bits;
+    memcpy(&bits, &viewDepth, sizeof(bits));
+    return bits >> 8;
+}
+
+uint64_t EncodeSortKey(RenderPass pass, uint64_t pipeline, GLuint vertexArray, float viewDepth) {
+    uint64_t passBits = static_cast<uint64_t>(pass) & 0x3;
+    uint64_t kindBits = (pipeline & PIPELINE_BINDING_SEPARABLE) != 0 ? 1 : 0;
+    uint64_t pipelineBits = pipeline & 0xFFFF;
+    uint64_t vertexArrayBits = vertexArray & 0xFFFF;
+    uint64_t depthBits = QuantizeDepth(viewDepth);
+
+    if (pass == RenderPass::Transparent) {
+        // Blending needs far objects first, so depth outranks state here
+        depthBits = (~depthBits) & 0xFFFFFF;
+        return (passBits << 62) | (depthBits << 38) | (kindBits << 37) | (pipelineBits << 21) | (vertexArrayBits << 5);
+    }
+    return (passBits << 62) | (kindBits << 61) | (pipelineBits << 45) | (vertexArrayBits << 29) | (depthBits << 5);
+}
+
+void RenderQueueClear(RenderQueue* queue) {
+    queue->mPackets.clear();
+}
+
+void RenderQueuePush(RenderQueue* queue, const Mesh3D* mesh, const glm::mat4& viewMatrix) {
+    if (mesh == nullptr || mesh->mPipeline == nullptr) {
+        return;
+    }
+
+    // Distance in front of the camera of the mesh origin
+    glm::vec4 viewPosition = viewMatrix * mesh->mTransform.mModelMatrix[3];
+
+    DrawPacket packet;
+    packet.mSortKey = EncodeSortKey(mesh->mRenderPass, PipelineBindingId(*mesh->mPipeline),
+                                    mesh->mVertexArrayObject, -viewPosition.z);
+    packet.mMesh = mesh;
+    queue->mPackets.push_back(packet);
+}
+
+void RenderQueuePushQueried(RenderQueue* queue, const Mesh3D* mesh, const glm::mat4& viewMatrix,
+                            GLuint query, GLuint proxyObject) {
+    size_t count = queue->mPackets.size();
+    RenderQueuePush(queue, mesh, viewMatrix);
+    if (queue->mPackets.size() > count) {
+        queue->mPackets.back().mQuery = query;
+        queue->mPackets.back().mProxyObject = proxyObject;
+    }
+}
+
+void RenderQueueSort(RenderQueue* queue) {
+    PROFILE_FUNCTION();
+    std::vector<DrawPacket>& packets = queue->mPackets;
+    std::vector<DrawPacket>& scratch = queue->mScratch;
+    size_t count = packets.size();
+    scratch.resize(count);
+
+    // LSD radix sort, one byte per pass. It is stable, so equal keys keep submission order
+    for (unsigned int shift = 0; shift < 64; shift += 8) {
+        size_t histogram[256] = {};
+        for (const DrawPacket& packet : packets) {
+            histogram[(packet.mSortKey >> shift) & 0xFF]++;
+        }
+
+        // All keys share this byte, nothing would move
+        if (histogram[(packets.empty() ? 0 : (packets[0].mSortKey >> shift) & 0xFF)] == count) {
+            continue;
+        }
+
+        size_t offset = 0;
+        for (size_t& bucket : histogram) {
+            size_t bucketCount = bucket;
+            bucket = offset;
+            offset += bucketCount;
+        }
+        for (const DrawPacket& packet : packets) {
+            scratch[histogram[(packet.mSortKey >> shift) & 0xFF]++] = packet;
+        }
+        packets.swap(scratch);
+    }
+}
+
+static void BeginRenderPass(RenderPass pass) {
+    if (pass == RenderPass::Transparent) {
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        glDepthMask(GL_FALSE);
+    } else {
+        glDisable(GL_BLEND);
+        glDepthMask(GL_TRUE);
+    }
+}
+
+void RenderQueueSubmit(RenderQueue* queue, const App& app) {
+    PROFILE_FUNCTION();
+    RenderStats stats;
+
+    uint64_t boundPipeline = 0;
+    GLuint boundVertexArray = 0;
+    // Force the first packet to set up its pass
+    int currentPass = -1;
+    bool drawZones = queue->mProfiler != nullptr && queue->mProfiler->mDrawZones;
+
+    // All the queries go first, so they have had time to finish by the time
+    // their meshes come up. Only depth testing matters for them.
+    if (queue->mProxy != nullptr) {
+        bool masked = false;
+        for (const DrawPacket& packet : queue->mPackets) {
+            if (packet.mQuery == 0) {
+                continue;
+            }
+            if (!masked) {
+                glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+                glDepthMask(GL_FALSE);
+                masked = true;
+            }
+            if (PipelineBindingId(*packet.mMesh->mPipeline) != boundPipeline) {
+                boundPipeline = PipelineBindingId(*packet.mMesh->mPipeline);
+                PipelineBind(*packet.mMesh->mPipeline);
+                stats.mProgramBinds++;
+            }
+            if (queue->mProxy->mVertexArrayObject != boundVertexArray) {
+                boundVertexArray = queue->mProxy->mVertexArrayObject;
+                glBindVertexArray(boundVertexArray);
+                stats.mVertexArrayBinds++;
+            }
+            FrameUniformsBindObject(app.mFrameUniforms, packet.mProxyObject);
+            glBeginQuery(queue->mQueryTarget, packet.mQuery);
+            MeshDrawElements(queue->mProxy);
+            glEndQuery(queue->mQueryTarget);
+            stats.mQueries++;
+        }
+        if (masked) {
+            glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+            glDepthMask(GL_TRUE);
+        }
+    }
+
+    for (const DrawPacket& packet : queue->mPackets) {
+        const Mesh3D* mesh = packet.mMesh;
+
+        if (static_cast<int>(mesh->mRenderPass) != currentPass) {
+            currentPass = static_cast<int>(mesh->mRenderPass);
+            BeginRenderPass(mesh->mRenderPass);
+            stats.mPassChanges++;
+        }
+
+        if (PipelineBindingId(*mesh->mPipeline) != boundPipeline) {
+            boundPipeline = PipelineBindingId(*mesh->mPipeline);
+            PipelineBind(*mesh->mPipeline);
+            stats.mProgramBinds++;
+        } else {
+            stats.mStateChangesAvoided++;
+        }
+
+        if (mesh->mVertexArrayObject != boundVertexArray) {
+            boundVertexArray = mesh->mVertexArrayObject;
+            glBindVertexArray(boundVertexArray);
+            stats.mVertexArrayBinds++;
+        } else {
+            stats.mStateChangesAvoided++;
+        }
+
+        FrameUniformsBindObject(app.mFrameUniforms, mesh->mObjectIndex);
+        if (drawZones) {
+            GpuProfilerBeginZone(queue->mProfiler, "Draw");
+        }
+        // Without waiting the mesh is drawn anyway when the query hasn't finished
+        if (packet.mQuery != 0) {
+            glBeginConditionalRender(packet.mQuery, GL_QUERY_NO_WAIT);
+            MeshDrawElements(mesh);
+            glEndConditionalRender();
+        } else {
+            MeshDrawElements(mesh);
+        }
+        if (drawZones) {
+            GpuProfilerEndZone(queue->mProfiler);
+        }
+        stats.mDrawCalls++;
+        stats.mTriangles += mesh->mIndexCount / 3;
+    }
+
+    // Leave the default state behind, once per frame instead of once per draw
+    if (currentPass != static_cast<int>(RenderPass::Opaque)) {
+        BeginRenderPass(RenderPass::Opaque);
+    }
+    glBindVertexArray(0);
+    glUseProgram(0);
+
+    queue->mStats = stats;
+}
@@ -0,0 +1,143 @@
+#include "ResourceManager.hpp"
+
+#include <algorithm>
+#include <iostream>
+
+static void DeleteObject(ResourceType type, GLuint name) {
+    switch (type) {
+        case ResourceType::Buffer:
+            glDeleteBuffers(1, &name);
+            break;
+        case ResourceType::VertexArray:
+            glDeleteVertexArrays(1, &name);
+            break;
+        case ResourceType::Program:
+            glDeleteProgram(name);
+            break;
+        case ResourceType::ProgramPipeline:
+            glDeleteProgramPipelines(1, &name);
+            break;
+    }
+}
+
+void CreateResourceManager(ResourceManager* manager) {
+    *manager = ResourceManager();
+}
+
+void DestroyResourceManager(ResourceManager* manager) {
+    glFinish();
+
+    for (const FrameFence& frameFence : manager->mFrameFences) {
+        glDeleteSync(frameFence.mFence);
+    }
+    for (const PendingDeletion& pending : manager->mPendingDeletions) {
+        DeleteObject(pending.mType, pending.mName);
+    }
+
+    if (manager->mLiveCount > 0) {
+        std::cout << "ResourceManager: " << manager->mLiveCount << " resources were never released" << std::endl;
+    }
+    for (const ResourceSlot& slot : manager->mSlots) {
+        if (slot.mRefCount > 0) {
+            DeleteObject(slot.mType, slot.mName);
+        }
+    }
+    *manager = ResourceManager();
+}
+
+ResourceHandle ResourceManagerRegister(ResourceManager* manager, ResourceType type, GLuint name) {
+    uint32_t index;
+    if (!manager->mFreeSlots.empty()) {
+        index = manager->mFreeSlots.back();
+        manager->mFreeSlots.pop_back();
+    } else {
+        index = (uint32_t)manager->mSlots.size();
+        manager->mSlots.emplace_back();
+    }
+
+    ResourceSlot& slot = manager->mSlots[index];
+    slot.mType = type;
+    slot.mName = name;
+    slot.mRefCount = 1;
+    manager->mLiveCount++;
+
+    ResourceHandle handle;
+    handle.mIndex = index;
+    handle.mGeneration = slot.mGeneration;
+    return handle;
+}
+
+bool ResourceManagerIsValid(const ResourceManager& manager, ResourceHandle handle) {
+    return handle.mIndex < manager.mSlots.size() &&
+           manager.mSlots[handle.mIndex].mGeneration == handle.mGeneration &&
+           manager.mSlots[handle.mIndex].mRefCount > 0;
+}
+
+uint32_t ResourceManagerRefCount(const ResourceManager& manager, ResourceHandle handle) {
+    if (!ResourceManagerIsValid(manager, handle)) {
+        return 0;
+    }
+    return manager.mSlots[handle.mIndex].mRefCount;
+}
+
+void ResourceManagerAddRef(ResourceManager* manager, ResourceHandle handle) {
+    if (!ResourceManagerIsValid(*manager, handle)) {
+        return;
+    }
+    manager->mSlots[handle.mIndex].mRefCount++;
+}
+
+void ResourceManagerRelease(ResourceManager* manager, ResourceHandle handle) {
+    if (!ResourceManagerIsValid(*manager, handle)) {
+        return;
+    }
+    ResourceSlot& slot = manager->mSlots[handle.mIndex];
+    if (--slot.mRefCount > 0) {
+        return;
+    }
+
+    // Draws recorded this frame may still use it, so it goes once this frame's fence passes
+    PendingDeletion pending;
+    pending.mType = slot.mType;
+    pending.mName = slot.mName;
+    pending.mFrame = manager->mFrame;
+    manager->mPendingDeletions.push_back(pending);
+
+    slot.mName = 0;
+    slot.mGeneration++;
+    if (slot.mGeneration == 0) {
+        slot.mGeneration = 1;
+    }
+    manager->mFreeSlots.push_back(handle.mIndex);
+    manager->mLiveCount--;
+}
+
+void ResourceManagerEndFrame(ResourceManager* manager) {
+    FrameFence frameFence;
+    frameFence.mFrame = manager->mFrame;
+    frameFence.mFence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    manager->mFrameFences.push_back(frameFence);
+    manager->mFrame++;
+
+    // Fences signal in order, stop at the first one that hasn't, without waiting
+    while (!manager->mFrameFences.empty()) {
+        const FrameFence& oldest = manager->mFrameFences.front();
+        GLenum result = glClientWaitSync(oldest.mFence, 0, 0);
+        if (result != GL_ALREADY_SIGNALED && result != GL_CONDITION_SATISFIED) {
+            break;
+        }
+        manager->mCompletedFrame = oldest.mFrame + 1;
+        glDeleteSync(oldest.mFence);
+        manager->mFrameFences.pop_front();
+    }
+
+    std::vector<PendingDeletion>& pending = manager->mPendingDeletions;
+    auto finished = std::partition(pending.begin(), pending.end(), [manager](const PendingDeletion& deletion) {
+        return deletion.mFrame >= manager->mCompletedFrame;
+    });
+    for (auto it = finished; it != pending.end(); ++it) {
+        DeleteObject(it->mType, it->mName);
+        manager->mDeletedCount++;
+    }
+    pending.erase(finished, pending.end());
+}
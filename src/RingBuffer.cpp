@@ -0,0 +1,165 @@
+#include "RingBuffer.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <vector>
+
+// All buffer management goes through GL_COPY_WRITE_BUFFER, so it can't
+// disturb VAO or uniform buffer bindings
+static void RingBufferCreateStorage(RingBuffer* ring) {
+    GLsizeiptr size = ring->mFrameCapacity * RING_BUFFER_FRAMES;
+
+    glGenBuffers(1, &ring->mBuffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, ring->mBuffer);
+    if (ring->mPersistent) {
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(GL_COPY_WRITE_BUFFER, size, nullptr, flags);
+        ring->mMapped = static_cast<unsigned char*>(glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, size, flags));
+    } else {
+        glBufferData(GL_COPY_WRITE_BUFFER, size, nullptr, GL_STREAM_DRAW);
+    }
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    ring->mFrameOffset = ring->mFrameIndex * ring->mFrameCapacity;
+}
+
+static void RingBufferDeleteStorage(RingBuffer* ring) {
+    for (GLsync& fence : ring->mFences) {
+        if (fence != nullptr) {
+            glDeleteSync(fence);
+            fence = nullptr;
+        }
+    }
+    if (ring->mMapped != nullptr) {
+        glBindBuffer(GL_COPY_WRITE_BUFFER, ring->mBuffer);
+        glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        ring->mMapped = nullptr;
+    }
+    // The driver keeps the storage alive until queued draws are done with it
+    glDeleteBuffers(1, &ring->mBuffer);
+    ring->mBuffer = 0;
+}
+
+// Without persistent mapping only the current region is mapped, and only while writing
+static void RingBufferMapRegion(RingBuffer* ring) {
+    glBindBuffer(GL_COPY_WRITE_BUFFER, ring->mBuffer);
+    ring->mMapped = static_cast<unsigned char*>(glMapBufferRange(
+        GL_COPY_WRITE_BUFFER, ring->mFrameOffset, ring->mFrameCapacity,
+        GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT));
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+static unsigned char* RingBufferRegionData(const RingBuffer* ring) {
+    if (ring->mMapped == nullptr) {
+        return nullptr;
+    }
+    return ring->mPersistent ? ring->mMapped + ring->mFrameOffset : ring->mMapped;
+}
+
+void CreateRingBuffer(RingBuffer* ring, GLsizeiptr frameCapacity) {
+    ring->mPersistent = GLAD_GL_ARB_buffer_storage != 0;
+    ring->mFrameCapacity = std::max<GLsizeiptr>(frameCapacity, 256);
+    ring->mFrameIndex = 0;
+    ring->mHead = 0;
+    RingBufferCreateStorage(ring);
+}
+
+void DestroyRingBuffer(RingBuffer* ring) {
+    RingBufferDeleteStorage(ring);
+    *ring = RingBuffer();
+}
+
+void RingBufferBeginFrame(RingBuffer* ring) {
+    ring->mHead = 0;
+    ring->mFrameOffset = ring->mFrameIndex * ring->mFrameCapacity;
+    ring->mLastFenceWait = 0.0;
+
+    if (!ring->mPersistent) {
+        // Orphaning on wrap-around hands us fresh storage, so the regions of a
+        // storage generation are never reused and writes need no fence
+        if (ring->mFrameIndex == 0) {
+            glBindBuffer(GL_COPY_WRITE_BUFFER, ring->mBuffer);
+            glBufferData(GL_COPY_WRITE_BUFFER, ring->mFrameCapacity * RING_BUFFER_FRAMES, nullptr, GL_STREAM_DRAW);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        }
+        RingBufferMapRegion(ring);
+        return;
+    }
+
+    GLsync& fence = ring->mFences[ring->mFrameIndex];
+    if (fence == nullptr) {
+        return;
+    }
+
+    // Only a fence that is not signaled yet counts as a stall
+    if (glClientWaitSync(fence, 0, 0) == GL_TIMEOUT_EXPIRED) {
+        auto start = std::chrono::steady_clock::now();
+        GLenum result;
+        do {
+            result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000ull);
+        } while (result == GL_TIMEOUT_EXPIRED);
+        auto end = std::chrono::steady_clock::now();
+
+        ring->mLastFenceWait = std::chrono::duration<double, std::milli>(end - start).count();
+        ring->mTotalFenceWait += ring->mLastFenceWait;
+    }
+    glDeleteSync(fence);
+    fence = nullptr;
+}
+
+// Replaces the buffer with a larger one, keeping what this frame already wrote
+static void RingBufferGrow(RingBuffer* ring, GLsizeiptr required) {
+    std::vector<unsigned char> written(ring->mHead);
+    if (ring->mHead > 0) {
+        memcpy(written.data(), RingBufferRegionData(ring), ring->mHead);
+    }
+
+    RingBufferDeleteStorage(ring);
+    ring->mFrameCapacity = std::max(ring->mFrameCapacity * 2, required);
+    RingBufferCreateStorage(ring);
+    if (!ring->mPersistent) {
+        RingBufferMapRegion(ring);
+    }
+
+    if (!written.empty()) {
+        memcpy(RingBufferRegionData(ring), written.data(), written.size());
+    }
+}
+
+RingAllocation RingBufferAllocate(RingBuffer* ring, GLsizeiptr size, GLsizeiptr alignment) {
+    if (alignment < 1) {
+        alignment = 1;
+    }
+    GLsizeiptr offset = ((ring->mHead + alignment - 1) / alignment) * alignment;
+    if (offset + size > ring->mFrameCapacity) {
+        RingBufferGrow(ring, offset + size);
+    }
+    ring->mHead = offset + size;
+
+    RingAllocation allocation;
+    allocation.mData = RingBufferRegionData(ring) + offset;
+    allocation.mOffset = offset;
+    return allocation;
+}
+
+void RingBufferFinishWrites(RingBuffer* ring) {
+    // Coherent persistent mappings are visible to the GPU without unmapping
+    if (ring->mPersistent || ring->mMapped == nullptr) {
+        return;
+    }
+    glBindBuffer(GL_COPY_WRITE_BUFFER, ring->mBuffer);
+    glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    ring->mMapped = nullptr;
+}
+
+void RingBufferEndFrame(RingBuffer* ring) {
+    RingBufferFinishWrites(ring);
+    if (ring->mPersistent) {
+        ring->mFences[ring->mFrameIndex] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+    ring->mFrameIndex = (ring->mFrameIndex + 1) % RING_BUFFER_FRAMES;
+    ring->mFrameCount++;
+}
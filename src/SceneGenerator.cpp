@@ -0,0 +1,202 @@
+#include "SceneGenerator.hpp"
+#include "CpuProfiler.hpp"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <random>
+
+// Everything is placed in this box, in front of the camera and inside its far plane
+static const glm::vec3 SCENE_MIN(-3.0f, -3.0f, -8.5f);
+static const glm::vec3 SCENE_MAX( 3.0f,  3.0f, -1.5f);
+
+// Footprint of a city block in columns per side, and the street between blocks
+static const int CITY_BLOCK_COLUMNS = 4;
+static const int CITY_STREET_WIDTH = 1;
+static const int CITY_OBJECTS_PER_BLOCK = 64;
+static const int CITY_MAX_STACK = 8;
+
+bool ParseSceneLayout(const std::string& name, SceneLayout* layout) {
+    if (name == "grid") {
+        *layout = SceneLayout::Grid;
+    } else if (name == "cloud") {
+        *layout = SceneLayout::Cloud;
+    } else if (name == "city") {
+        *layout = SceneLayout::City;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// Templates come in different sizes, objects are scaled by this to a common one
+static float MeshBoundingRadius(const MeshData& meshData) {
+    float radius = 0.0f;
+    for (const Vertex& vertex : meshData.vertices) {
+        radius = std::max(radius, std::sqrt(vertex.x * vertex.x + vertex.y * vertex.y + vertex.z * vertex.z));
+    }
+    return radius > 0.0f ? radius : 1.0f;
+}
+
+// Color from the position in the scene box, neighbours look alike
+static glm::vec4 PositionColor(const glm::vec3& position) {
+    glm::vec3 t = glm::clamp((position - SCENE_MIN) / (SCENE_MAX - SCENE_MIN), 0.0f, 1.0f);
+    return glm::vec4(t.x, t.y, 1.0f - t.z, 1.0f);
+}
+
+struct SceneBuilder {
+    GeneratedScene* mScene;
+    std::mt19937 mRandom;
+    std::vector<float> mRadii;
+};
+
+static float RandomFloat(SceneBuilder* builder, float low, float high) {
+    return std::uniform_real_distribution<float>(low, high)(builder->mRandom);
+}
+
+// Places a random mesh at position, fitting inside a sphere of the given diameter
+static void AddObject(SceneBuilder* builder, const glm::vec3& position, float size, float angle) {
+    SceneObject object;
+    object.mMesh = std::uniform_int_distribution<uint32_t>(0, (uint32_t)builder->mRadii.size() - 1)(builder->mRandom);
+    float scale = size * 0.5f / builder->mRadii[object.mMesh];
+
+    object.mModelMatrix = glm::translate(glm::mat4(1.0f), position);
+    object.mModelMatrix = glm::rotate(object.mModelMatrix, angle, glm::vec3(0.0f, 1.0f, 0.0f));
+    object.mModelMatrix = glm::scale(object.mModelMatrix, glm::vec3(scale));
+    object.mColor = PositionColor(position);
+    builder->mScene->mObjects.push_back(object);
+}
+
+static void GenerateGrid(SceneBuilder* builder, uint32_t count) {
+    int side = (int)std::ceil(std::cbrt((double)count));
+    glm::vec3 spacing = (SCENE_MAX - SCENE_MIN) / (float)side;
+    float size = std::min(spacing.x, std::min(spacing.y, spacing.z)) * 0.7f;
+
+    for (uint32_t i = 0; i < count; ++i) {
+        int x = i % side;
+        int y = (i / side) % side;
+        int z = i / (side * side);
+        glm::vec3 position = SCENE_MIN + glm::vec3(x + 0.5f, y + 0.5f, z + 0.5f) * spacing;
+        AddObject(builder, position, size, 0.0f);
+    }
+}
+
+static void GenerateCloud(SceneBuilder* builder, uint32_t count) {
+    // Average size such that the objects fill about a third of the box
+    glm::vec3 extent = SCENE_MAX - SCENE_MIN;
+    float size = std::cbrt(extent.x * extent.y * extent.z / count) * 0.7f;
+
+    for (uint32_t i = 0; i < count; ++i) {
+        glm::vec3 position(RandomFloat(builder, SCENE_MIN.x, SCENE_MAX.x),
+                           RandomFloat(builder, SCENE_MIN.y, SCENE_MAX.y),
+                           RandomFloat(builder, SCENE_MIN.z, SCENE_MAX.z));
+        AddObject(builder, position, size * RandomFloat(builder, 0.5f, 1.5f), RandomFloat(builder, 0.0f, 6.2832f));
+    }
+}
+
+static void GenerateCity(SceneBuilder* builder, uint32_t count) {
+    int blocks = (int)((count + CITY_OBJECTS_PER_BLOCK - 1) / CITY_OBJECTS_PER_BLOCK);
+    int blocksX = (int)std::ceil(std::sqrt((double)blocks));
+    int blocksZ = (blocks + blocksX - 1) / blocksX;
+
+    // Square cells, as many as fit both ways
+    int cellsPerBlock = CITY_BLOCK_COLUMNS + CITY_STREET_WIDTH;
+    glm::vec3 extent = SCENE_MAX - SCENE_MIN;
+    float cell = std::min(extent.x / (blocksX * cellsPerBlock), extent.z / (blocksZ * cellsPerBlock));
+
+    const int columns = CITY_BLOCK_COLUMNS * CITY_BLOCK_COLUMNS;
+    uint32_t placed = 0;
+    for (int block = 0; block < blocks; ++block) {
+        float blockX = SCENE_MIN.x + (block % blocksX) * cellsPerBlock * cell;
+        float blockZ = SCENE_MIN.z + (block / blocksX) * cellsPerBlock * cell;
+        uint32_t quota = std::min<uint32_t>(CITY_OBJECTS_PER_BLOCK, count - placed);
+
+        // Every column gets a building of random height, and the block quota
+        // is spread over them until it runs out
+        int heights[columns] = {};
+        int targets[columns];
+        for (int column = 0; column < columns; ++column) {
+            targets[column] = std::uniform_int_distribution<int>(1, CITY_MAX_STACK)(builder->mRandom);
+        }
+        for (int column = 0; quota > 0; column = (column + 1) % columns) {
+            if (heights[column] >= targets[column]) {
+                // Buildings are full, grow them all
+                bool full = true;
+                for (int i = 0; i < columns; ++i) {
+                    full = full && heights[i] >= targets[i];
+                }
+                if (full) {
+                    for (int i = 0; i < columns; ++i) {
+                        targets[i] += CITY_MAX_STACK;
+                    }
+                }
+                continue;
+            }
+            glm::vec3 position(blockX + (column % CITY_BLOCK_COLUMNS + 0.5f) * cell,
+                               SCENE_MIN.y + (heights[column] + 0.5f) * cell,
+                               blockZ + (column / CITY_BLOCK_COLUMNS + 0.5f) * cell);
+            AddObject(builder, position, cell * 0.9f, 0.0f);
+            heights[column]++;
+            quota--;
+            placed++;
+        }
+    }
+}
+
+void GenerateScene(GeneratedScene* scene, const SceneGeneratorOptions& options) {
+    PROFILE_FUNCTION();
+    *scene = GeneratedScene();
+
+    uint32_t minSubdivision = std::min(options.mMinSubdivision, SCENE_MAX_SUBDIVISION);
+    uint32_t maxSubdivision = std::min(std::max(options.mMaxSubdivision, minSubdivision), SCENE_MAX_SUBDIVISION);
+    if (options.mMaxSubdivision > SCENE_MAX_SUBDIVISION) {
+        std::cout << "Sphere subdivision is limited to " << SCENE_MAX_SUBDIVISION << std::endl;
+    }
+
+    // Every mesh is in place before anyone takes its address
+    scene->mMeshes.reserve(2 + maxSubdivision - minSubdivision + 1);
+    scene->mMeshes.push_back(MeshTemplates::Cube);
+    scene->mMeshes.push_back(MeshTemplates::Tetrahedron);
+    for (uint32_t level = minSubdivision; level <= maxSubdivision; ++level) {
+        scene->mMeshes.push_back(GenerateSphere(level));
+    }
+
+    SceneBuilder builder;
+    builder.mScene = scene;
+    builder.mRandom.seed(options.mSeed);
+    for (const MeshData& meshData : scene->mMeshes) {
+        builder.mRadii.push_back(MeshBoundingRadius(meshData));
+    }
+
+    scene->mObjects.reserve(options.mObjectCount);
+    if (options.mObjectCount == 0) {
+        return;
+    }
+    switch (options.mLayout) {
+        case SceneLayout::Grid:  GenerateGrid(&builder, options.mObjectCount); break;
+        case SceneLayout::Cloud: GenerateCloud(&builder, options.mObjectCount); break;
+        case SceneLayout::City:  GenerateCity(&builder, options.mObjectCount); break;
+    }
+
+    // Animated objects are spread evenly through the layout, then moved to the front
+    float fraction = std::min(std::max(options.mAnimatedFraction, 0.0f), 1.0f);
+    std::vector<bool> animated(scene->mObjects.size());
+    for (size_t i = 0; i < animated.size(); ++i) {
+        animated[i] = std::floor((i + 1) * (double)fraction) > std::floor(i * (double)fraction);
+    }
+    std::vector<SceneObject> objects;
+    objects.reserve(scene->mObjects.size());
+    for (int pass = 0; pass < 2; ++pass) {
+        for (size_t i = 0; i < animated.size(); ++i) {
+            if (animated[i] == (pass == 0)) {
+                objects.push_back(scene->mObjects[i]);
+            }
+        }
+        if (pass == 0) {
+            scene->mAnimatedCount = (uint32_t)objects.size();
+        }
+    }
+    scene->mObjects = std::move(objects);
+}
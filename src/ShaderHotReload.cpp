@@ -0,0 +1,149 @@
+#include "ShaderHotReload.hpp"
+#include "CpuProfiler.hpp"
+
+#include <algorithm>
+#include <iostream>
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+void ShaderHotReloadWatch(ShaderHotReload* reload, const std::string& name,
+                          const std::string& vertexPath, const ShaderDefines& vertexDefines,
+                          const std::string& fragmentPath, const ShaderDefines& fragmentDefines, Pipeline* target) {
+    WatchedProgram program;
+    program.mName = name;
+    program.mVertexPath = vertexPath;
+    program.mVertexDefines = vertexDefines;
+    program.mFragmentPath = fragmentPath;
+    program.mFragmentDefines = fragmentDefines;
+    program.mTarget = target;
+    reload->mPrograms.push_back(program);
+}
+
+#ifdef __linux__
+static void WatchThread(ShaderHotReload* reload) {
+    PROFILE_THREAD_NAME("Shader watcher");
+    // Large enough for a burst of events with file names
+    alignas(inotify_event) char buffer[16 * 1024];
+    pollfd descriptor = { reload->mInotify, POLLIN, 0 };
+
+    while (reload->mRunning) {
+        // Wake up regularly to notice StopShaderHotReload
+        if (poll(&descriptor, 1, 100) <= 0) {
+            continue;
+        }
+        ssize_t length = read(reload->mInotify, buffer, sizeof(buffer));
+        if (length <= 0) {
+            continue;
+        }
+        auto now = std::chrono::steady_clock::now();
+
+        PROFILE_ZONE("Queue shader changes");
+        std::lock_guard<std::mutex> lock(reload->mMutex);
+        for (ssize_t offset = 0; offset < length;) {
+            const inotify_event* event = (const inotify_event*)(buffer + offset);
+            if (event->len > 0) {
+                // Keep the first time a change was seen, that's where the latency starts
+                reload->mChanged.emplace(reload->mDirectory + "/" + event->name, now);
+            }
+            offset += sizeof(inotify_event) + event->len;
+        }
+    }
+}
+#endif
+
+void StartShaderHotReload(ShaderHotReload* reload, const std::string& directory) {
+    reload->mDirectory = directory;
+#ifdef __linux__
+    reload->mInotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    // Editors either rewrite the file in place or move a new one over it
+    if (reload->mInotify < 0 ||
+        inotify_add_watch(reload->mInotify, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+        std::cout << "Could not watch " << directory << ", shader hot reload disabled" << std::endl;
+        if (reload->mInotify >= 0) {
+            close(reload->mInotify);
+            reload->mInotify = -1;
+        }
+        return;
+    }
+    reload->mRunning = true;
+    reload->mThread = std::thread(WatchThread, reload);
+#else
+    std::cout << "Shader hot reload needs inotify, it is disabled on this platform" << std::endl;
+#endif
+}
+
+void StopShaderHotReload(ShaderHotReload* reload) {
+    reload->mRunning = false;
+    if (reload->mThread.joinable()) {
+        reload->mThread.join();
+    }
+#ifdef __linux__
+    if (reload->mInotify >= 0) {
+        close(reload->mInotify);
+        reload->mInotify = -1;
+    }
+#endif
+}
+
+// Earliest change time of any file in files, false if none of them changed
+static bool FindChange(const std::unordered_map<std::string, std::chrono::steady_clock::time_point>& changed,
+                       const std::vector<std::string>& files, std::chrono::steady_clock::time_point* changeTime) {
+    bool found = false;
+    for (const std::string& file : files) {
+        auto it = changed.find(file);
+        if (it != changed.end() && (!found || it->second < *changeTime)) {
+            *changeTime = it->second;
+            found = true;
+        }
+    }
+    return found;
+}
+
+void ShaderHotReloadUpdate(ShaderHotReload* reload, ShaderLibrary* library, PipelineBuilder* builder) {
+    PROFILE_FUNCTION();
+    std::unordered_map<std::string, std::chrono::steady_clock::time_point> changed;
+    {
+        std::lock_guard<std::mutex> lock(reload->mMutex);
+        if (reload->mChanged.empty()) {
+            return;
+        }
+        changed.swap(reload->mChanged);
+    }
+
+    // Find the affected programs while the library still knows what each one included
+    std::vector<std::pair<const WatchedProgram*, std::chrono::steady_clock::time_point>> affected;
+    for (const WatchedProgram& program : reload->mPrograms) {
+        std::chrono::steady_clock::time_point vertexTime, fragmentTime;
+        bool vertexChanged = FindChange(changed, ShaderLibraryGet(library, program.mVertexPath,
+                                                                  program.mVertexDefines).mFiles, &vertexTime);
+        bool fragmentChanged = FindChange(changed, ShaderLibraryGet(library, program.mFragmentPath,
+                                                                    program.mFragmentDefines).mFiles, &fragmentTime);
+        if (vertexChanged || fragmentChanged) {
+            std::chrono::steady_clock::time_point changeTime = vertexChanged ? vertexTime : fragmentTime;
+            if (vertexChanged && fragmentChanged) {
+                changeTime = std::min(vertexTime, fragmentTime);
+            }
+            affected.push_back({ &program, changeTime });
+        }
+    }
+
+    for (const auto& it : changed) {
+        ShaderLibraryInvalidate(library, it.first);
+    }
+
+    for (const auto& it : affected) {
+        const WatchedProgram& program = *it.first;
+        const PreprocessedShader& vertex = ShaderLibraryGet(library, program.mVertexPath, program.mVertexDefines);
+        const PreprocessedShader& fragment = ShaderLibraryGet(library, program.mFragmentPath,
+                                                              program.mFragmentDefines);
+        if (!vertex.mValid || !fragment.mValid) {
+            continue;
+        }
+        std::cout << "Reloading pipeline " << program.mName << std::endl;
+        PipelineBuilderSubmit(builder, program.mName, vertex.mSource, fragment.mSource, program.mTarget, it.second);
+    }
+}
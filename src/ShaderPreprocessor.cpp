@@ -0,0 +1,170 @@
+#include "ShaderPreprocessor.hpp"
+#include "CpuProfiler.hpp"
+#include "ProgramCache.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <iostream>
+#include <unordered_set>
+
+ShaderDefines PermutationDefines(bool instancing, VertexFormat format) {
+    ShaderDefines defines;
+    defines["INSTANCING"] = instancing ? "1" : "0";
+    defines["VERTEX_FORMAT"] = std::to_string((GLuint)format);
+    return defines;
+}
+
+static std::string DirectoryOf(const std::string& path) {
+    size_t slash = path.find_last_of('/');
+    return slash == std::string::npos ? std::string(".") : path.substr(0, slash);
+}
+
+// Returns the file name of an #include "name" line, or an empty string
+static std::string ParseInclude(const std::string& line) {
+    size_t start = line.find_first_not_of(" \t");
+    if (start == std::string::npos || line.compare(start, 8, "#include") != 0) {
+        return std::string();
+    }
+    size_t open = line.find('"', start + 8);
+    size_t close = open == std::string::npos ? open : line.find('"', open + 1);
+    if (close == std::string::npos) {
+        return std::string();
+    }
+    return line.substr(open + 1, close - open - 1);
+}
+
+static bool ExpandFile(const std::string& path, std::vector<std::string>* stack, PreprocessedShader* shader,
+                       std::string* out) {
+    // Recorded even if it can't be opened, so creating it later triggers a reload
+    int sourceIndex = (int)shader->mFiles.size();
+    shader->mFiles.push_back(path);
+    std::ifstream file(path.c_str());
+    if (!file.is_open()) {
+        std::cout << "Could not open shader " << path << std::endl;
+        return false;
+    }
+    stack->push_back(path);
+
+    std::string line;
+    int lineNumber = 0;
+    while (std::getline(file, line)) {
+        lineNumber++;
+        std::string include = ParseInclude(line);
+        if (include.empty()) {
+            *out += line + "\n";
+            continue;
+        }
+
+        std::string includePath = DirectoryOf(path) + "/" + include;
+        if (std::find(stack->begin(), stack->end(), includePath) != stack->end()) {
+            std::cout << path << ":" << lineNumber << ": circular include of " << includePath << std::endl;
+            return false;
+        }
+        // Every file is pasted once, so shared headers need no include guards
+        if (std::find(shader->mFiles.begin(), shader->mFiles.end(), includePath) == shader->mFiles.end()) {
+            int includedIndex = (int)shader->mFiles.size();
+            *out += "#line 1 " + std::to_string(includedIndex) + "\n";
+            if (!ExpandFile(includePath, stack, shader, out)) {
+                return false;
+            }
+        }
+        *out += "#line " + std::to_string(lineNumber + 1) + " " + std::to_string(sourceIndex) + "\n";
+    }
+
+    stack->pop_back();
+    return true;
+}
+
+// Every identifier in source, so unreferenced defines can be left out
+static std::unordered_set<std::string> CollectIdentifiers(const std::string& source) {
+    std::unordered_set<std::string> identifiers;
+    size_t i = 0;
+    while (i < source.size()) {
+        if (std::isalpha((unsigned char)source[i]) || source[i] == '_') {
+            size_t start = i;
+            while (i < source.size() && (std::isalnum((unsigned char)source[i]) || source[i] == '_')) {
+                ++i;
+            }
+            identifiers.insert(source.substr(start, i - start));
+        } else {
+            ++i;
+        }
+    }
+    return identifiers;
+}
+
+PreprocessedShader PreprocessShader(const std::string& path, const ShaderDefines& defines) {
+    PROFILE_FUNCTION();
+    PreprocessedShader shader;
+    std::vector<std::string> stack;
+    std::string expanded;
+    if (!ExpandFile(path, &stack, &shader, &expanded)) {
+        return shader;
+    }
+
+    std::unordered_set<std::string> identifiers = CollectIdentifiers(expanded);
+    std::string defineBlock;
+    for (const auto& define : defines) {
+        if (identifiers.count(define.first) > 0) {
+            defineBlock += "#define " + define.first + " " + define.second + "\n";
+        }
+    }
+
+    // #version has to stay the first line, the defines go right after it
+    size_t version = expanded.find("#version");
+    size_t insertAt = version == std::string::npos ? 0 : expanded.find('\n', version);
+    insertAt = insertAt == std::string::npos ? expanded.size() : insertAt + 1;
+    if (!defineBlock.empty()) {
+        int versionLine = (int)std::count(expanded.begin(), expanded.begin() + insertAt, '\n');
+        defineBlock += "#line " + std::to_string(versionLine + 1) + " 0\n";
+        expanded.insert(insertAt, defineBlock);
+    }
+
+    shader.mSource = expanded;
+    shader.mHash = HashString(expanded);
+    shader.mValid = true;
+    return shader;
+}
+
+static uint64_t PermutationKey(const std::string& path, const ShaderDefines& defines) {
+    uint64_t hash = HashString(path);
+    for (const auto& define : defines) {
+        hash = HashString(define.first, hash);
+        hash = HashString("=", hash);
+        hash = HashString(define.second, hash);
+        hash = HashString(";", hash);
+    }
+    return hash;
+}
+
+const PreprocessedShader& ShaderLibraryGet(ShaderLibrary* library, const std::string& path,
+                                           const ShaderDefines& defines) {
+    library->mRequests++;
+    uint64_t key = PermutationKey(path, defines);
+    auto it = library->mPermutations.find(key);
+    if (it != library->mPermutations.end()) {
+        return it->second;
+    }
+
+    PreprocessedShader shader = PreprocessShader(path, defines);
+    if (shader.mValid && library->mSourceUsers[shader.mHash]++ > 0) {
+        library->mDuplicates++;
+    }
+    return library->mPermutations.emplace(key, shader).first->second;
+}
+
+void ShaderLibraryInvalidate(ShaderLibrary* library, const std::string& file) {
+    for (auto it = library->mPermutations.begin(); it != library->mPermutations.end();) {
+        const std::vector<std::string>& files = it->second.mFiles;
+        if (std::find(files.begin(), files.end(), file) == files.end()) {
+            ++it;
+            continue;
+        }
+        auto users = library->mSourceUsers.find(it->second.mHash);
+        if (users != library->mSourceUsers.end() && --users->second == 0) {
+            library->mSourceUsers.erase(users);
+        }
+        it = library->mPermutations.erase(it);
+    }
+}
@@ -0,0 +1,79 @@
+#include "UniformBuffers.hpp"
+
+#include <cstring>
+
+void CreateFrameUniforms(FrameUniforms* frameUniforms) {
+    GLint alignment = 0;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    if (alignment <= 0) {
+        alignment = 256;
+    }
+    frameUniforms->mAlignment = alignment;
+    frameUniforms->mPerObjectStride = ((sizeof(PerObjectData) + alignment - 1) / alignment) * alignment;
+
+    // Room for the PerFrame block and a few hundred objects, the ring grows when needed
+    CreateRingBuffer(&frameUniforms->mRing, 256 * frameUniforms->mPerObjectStride);
+}
+
+void DestroyFrameUniforms(FrameUniforms* frameUniforms) {
+    DestroyRingBuffer(&frameUniforms->mRing);
+    *frameUniforms = FrameUniforms();
+}
+
+void FrameUniformsBegin(FrameUniforms* frameUniforms, const Camera& camera, float time) {
+    RingBufferBeginFrame(&frameUniforms->mRing);
+
+    PerFrameData data;
+    data.mViewMatrix = camera.GetViewMatrix();
+    data.mProjectionMatrix = camera.GetProjectionMatrix();
+    data.mViewProjectionMatrix = data.mProjectionMatrix * data.mViewMatrix;
+    data.mCameraPosition = glm::vec4(camera.GetPosition(), 1.0f);
+    data.mTime = time;
+
+    RingAllocation allocation = RingBufferAllocate(&frameUniforms->mRing, sizeof(PerFrameData),
+                                                   frameUniforms->mAlignment);
+    memcpy(allocation.mData, &data, sizeof(PerFrameData));
+    frameUniforms->mPerFrameOffset = allocation.mOffset;
+
+    frameUniforms->mObjectCount = 0;
+}
+
+GLuint FrameUniformsPushObject(FrameUniforms* frameUniforms, const glm::mat4& modelMatrix) {
+    GLuint index = frameUniforms->mObjectCount++;
+    size_t offset = index * frameUniforms->mPerObjectStride;
+    if (frameUniforms->mPerObjectStaging.size() < offset + frameUniforms->mPerObjectStride) {
+        frameUniforms->mPerObjectStaging.resize(offset + frameUniforms->mPerObjectStride);
+    }
+
+    PerObjectData data;
+    data.mModelMatrix = modelMatrix;
+    memcpy(&frameUniforms->mPerObjectStaging[offset], &data, sizeof(PerObjectData));
+    return index;
+}
+
+void FrameUniformsUploadObjects(FrameUniforms* frameUniforms) {
+    RingBuffer* ring = &frameUniforms->mRing;
+
+    GLsizeiptr size = frameUniforms->mObjectCount * frameUniforms->mPerObjectStride;
+    if (size > 0) {
+        RingAllocation allocation = RingBufferAllocate(ring, size, frameUniforms->mAlignment);
+        memcpy(allocation.mData, frameUniforms->mPerObjectStaging.data(), size);
+        frameUniforms->mPerObjectOffset = allocation.mOffset;
+    }
+    RingBufferFinishWrites(ring);
+
+    // The ring moves to another region every frame, so the block is rebound every frame
+    glBindBufferRange(GL_UNIFORM_BUFFER, PER_FRAME_BINDING, ring->mBuffer,
+                      ring->mFrameOffset + frameUniforms->mPerFrameOffset, sizeof(PerFrameData));
+}
+
+void FrameUniformsBindObject(const FrameUniforms& frameUniforms, GLuint objectIndex) {
+    const RingBuffer& ring = frameUniforms.mRing;
+    glBindBufferRange(GL_UNIFORM_BUFFER, PER_OBJECT_BINDING, ring.mBuffer,
+                      ring.mFrameOffset + frameUniforms.mPerObjectOffset + objectIndex * frameUniforms.mPerObjectStride,
+                      sizeof(PerObjectData));
+}
+
+void FrameUniformsEnd(FrameUniforms* frameUniforms) {
+    RingBufferEndFrame(&frameUniforms->mRing);
+}
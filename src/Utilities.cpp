@@ -1,5 +1,10 @@
 #include "Utilities.hpp"
 
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <vector>
+
 static void GLCLearAllErrors() {
     while (glGetError() != GL_NO_ERROR) {
     }
@@ -39,3 +44,61 @@ std::string LoadShaderAsString(const std::string& filename) {
     }
     return result;
 }
+
+bool WriteFramebufferPPM(const std::string& path, int width, int height) {
+    std::vector<unsigned char> pixels((size_t)width * height * 3);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, pixels.data());
+
+    std::ofstream file(path.c_str(), std::ios::binary);
+    if (!file.is_open()) {
+        std::cout << "Could not write " << path << std::endl;
+        return false;
+    }
+    file << "P6\n" << width << " " << height << "\n255\n";
+    // GL rows start at the bottom
+    for (int y = height - 1; y >= 0; --y) {
+        file.write((const char*)&pixels[(size_t)y * width * 3], width * 3);
+    }
+    return true;
+}
+
+void WriteJsonString(std::ostream& out, const char* string) {
+    out << '"';
+    for (const char* it = string; *it != '\0'; ++it) {
+        char c = *it;
+        if (c == '"' || c == '\\') {
+            out << '\\' << c;
+        } else if ((unsigned char)c < 0x20) {
+            // Control characters can't appear raw, not even newlines
+            out << "\\u" << std::hex << std::setw(4) << std::setfill('0') << (int)c << std::dec << std::setfill(' ');
+        } else {
+            out << c;
+        }
+    }
+    out << '"';
+}
+
+static double Percentile(const std::vector<double>& sorted, double fraction) {
+    size_t rank = (size_t)std::ceil(fraction * sorted.size());
+    return sorted[rank > 0 ? rank - 1 : 0];
+}
+
+TimingStats ComputeTimingStats(std::vector<double> samples) {
+    TimingStats stats;
+    if (samples.empty()) {
+        return stats;
+    }
+    std::sort(samples.begin(), samples.end());
+    double sum = 0.0;
+    for (double sample : samples) {
+        sum += sample;
+    }
+    stats.mSamples = (uint32_t)samples.size();
+    stats.mMean = sum / samples.size();
+    stats.mP50 = Percentile(samples, 0.50);
+    stats.mP95 = Percentile(samples, 0.95);
+    stats.mP99 = Percentile(samples, 0.99);
+    stats.mMax = samples.back();
+    return stats;
+}
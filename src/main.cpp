@@ -1,18 +1,657 @@
 #include "App.hpp"
+#include "Benchmark.hpp"
+#include "Bvh.hpp"
 #include "Graphics.hpp"
 #include "MeshData.hpp"
 #include "Input.hpp"
 #include "Utilities.hpp"
 #include "Camera.hpp"
+#include "Culling.hpp"
+#include "OcclusionCuller.hpp"
+#include "OcclusionQueries.hpp"
+#include "CpuProfiler.hpp"
+#include "RenderQueue.hpp"
+#include "InstanceCuller.hpp"
+#include "InstancedRenderer.hpp"
+#include "IndirectRenderer.hpp"
+#include "GpuCuller.hpp"
+#include "SceneGenerator.hpp"
 
-void MainLoop(App app, std::vector<Mesh3D> meshes) {
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+
+// Instances of one MeshData, one instanced draw or indirect command
+struct SceneBatch {
+    const MeshData* mMeshData = nullptr;
+    // Only allocated in the pool for RenderPath::Indirect
+    GeometryHandle mGeometry = 0;
+    std::vector<InstanceData> mInstances;
+    // The first mAnimatedCount instances spin every frame
+    uint32_t mAnimatedCount = 0;
+    // Copy of the first instance in the instanced renderer, the others follow it
+    InstanceId mFirstInstance;
+    // Object of the first instance in the GPU culler, the others follow it
+    uint32_t mGpuFirstObject = 0;
+};
+
+// Everything MainLoop draws
+struct Scene {
+    std::vector<Mesh3D> mMeshes;
+    // CPU copy of each mesh's geometry, occluders are rasterized from it
+    std::vector<const MeshData*> mMeshData;
+    // The first mAnimatedMeshes meshes spin every frame
+    size_t mAnimatedMeshes = 0;
+    std::vector<SceneBatch> mBatches;
+    // Owns the geometry of generated scenes, the batches point into it
+    GeneratedScene mGenerated;
+    // Pool allocations made for this scene, meshes copied from a template share one
+    std::vector<GeometryHandle> mGeometry;
+    // Bounds of mMeshes, its visible list is what gets drawn
+    FrustumCuller mCuller;
+    // Over the same bounds, kept up to date only for App::mBvhCulling. The
+    // animated meshes, which come first, get a tree of their own.
+    Bvh mStaticBvh;
+    Bvh mDynamicBvh;
+    // Takes the hidden meshes off the visible list, only for App::mOcclusionCulling
+    OcclusionCuller mOcclusion;
+    // Per mesh, only for App::mOcclusionQueries. The queried meshes go through
+    // a queue of their own after the others, their proxy is a unit cube.
+    OcclusionQueries mQueries;
+    RenderQueue mQueryQueue;
+    // Blended over everything else, so it goes out after the queried meshes and the instances
+    RenderQueue mTransparentQueue;
+    Mesh3D mQueryProxy;
+    InstancedRenderer mInstancedRenderer;
+    // Culls the instanced renderer's groups, only for App::mInstanceCulling
+    InstanceCuller mInstanceCuller;
+    IndirectRenderer mIndirectRenderer;
+    // Culls and draws everything instead of the two above, only for App::mGpuCulling.
+    // Mesh i is object i, the batches come after.
+    GpuCuller mGpuCuller;
+};
+
+// Fills a box in front of the camera with a grid of small spheres
+std::vector<InstanceData> GenerateSphereInstances(int count) {
+    PROFILE_FUNCTION();
+    std::vector<InstanceData> instances;
+    if (count <= 0) {
+        return instances;
+    }
+
+    int side = (int)std::ceil(std::cbrt((double)count));
+    float spacing = 6.0f / side;
+
+    for (int i = 0; i < count; ++i) {
+        int x = i % side;
+        int y = (i / side) % side;
+        int z = i / (side * side);
+
+        glm::vec3 position(-3.0f + (x + 0.5f) * spacing,
+                           -3.0f + (y + 0.5f) * spacing,
+                           -3.5f - (z + 0.5f) * spacing);
+        glm::mat4 model = glm::translate(glm::mat4(1.0f), position);
+        model = glm::scale(model, glm::vec3(spacing * 0.35f));
+
+        InstanceData instance;
+        instance.mModelMatrix = model;
+        instance.mColor = glm::vec4((float)x / side, (float)y / side, (float)z / side, 1.0f);
+        instances.push_back(instance);
+    }
+    return instances;
+}
+
+// Hands batch.mInstances to whichever renderer the render path uses
+static void SceneAddBatch(App& app, Scene* scene, SceneBatch batch) {
+    if (batch.mInstances.empty()) {
+        return;
+    }
+    if (app.mRenderPath == RenderPath::Indirect) {
+        batch.mGeometry = GeometryPoolAllocate(&app.mGeometryPool, *batch.mMeshData);
+        scene->mGeometry.push_back(batch.mGeometry);
+    } else {
+        for (size_t i = 0; i < batch.mInstances.size(); ++i) {
+            const InstanceData& instance = batch.mInstances[i];
+            InstanceId id = InstancedRendererAdd(&scene->mInstancedRenderer, *batch.mMeshData,
+                                                 instance.mModelMatrix, instance.mColor);
+            if (i == 0) {
+                batch.mFirstInstance = id;
+            }
+        }
+    }
+    scene->mBatches.push_back(std::move(batch));
+}
+
+// Generated objects are meshes of the render queue on RenderPath::Queue, and
+// one batch per MeshData everywhere else
+static void SceneAddGenerated(App& app, Scene* scene, const SceneGeneratorOptions& options) {
+    GenerateScene(&scene->mGenerated, options);
+    const GeneratedScene& generated = scene->mGenerated;
+
+    if (app.mRenderPath == RenderPath::Queue) {
+        // One pool allocation per MeshData, every object shares it
+        std::vector<Mesh3D> templates(generated.mMeshes.size());
+        for (size_t i = 0; i < templates.size(); ++i) {
+            MeshDataPoolSpecification(&templates[i], &app.mGeometryPool, generated.mMeshes[i]);
+            scene->mGeometry.push_back(templates[i].mGeometry);
+            MeshSetPipeline(&templates[i], &app.mGraphicsPipeline);
+        }
+        scene->mMeshes.reserve(generated.mObjects.size());
+        for (const SceneObject& object : generated.mObjects) {
+            Mesh3D mesh = templates[object.mMesh];
+            mesh.mTransform.mModelMatrix = object.mModelMatrix;
+            scene->mMeshes.push_back(mesh);
+            scene->mMeshData.push_back(&generated.mMeshes[object.mMesh]);
+        }
+        scene->mAnimatedMeshes = generated.mAnimatedCount;
+        return;
+    }
+
+    std::vector<SceneBatch> batches(generated.mMeshes.size());
+    for (size_t i = 0; i < batches.size(); ++i) {
+        batches[i].mMeshData = &generated.mMeshes[i];
+    }
+    // Objects come animated first, so each batch keeps that order
+    for (uint32_t i = 0; i < generated.mObjects.size(); ++i) {
+        const SceneObject& object = generated.mObjects[i];
+        SceneBatch& batch = batches[object.mMesh];
+        InstanceData instance;
+        instance.mModelMatrix = object.mModelMatrix;
+        instance.mColor = object.mColor;
+        batch.mInstances.push_back(instance);
+        batch.mAnimatedCount += i < generated.mAnimatedCount ? 1 : 0;
+    }
+    for (SceneBatch& batch : batches) {
+        SceneAddBatch(app, scene, std::move(batch));
+    }
+}
+
+// "basic" is three meshes, "spheres" the same plus a field of instanced
+// spheres, 1000 unless instanceCount says otherwise
+static bool SceneAddBasic(App& app, Scene* scene, const std::string& name, int instanceCount) {
+    if (name == "spheres") {
+        instanceCount = instanceCount > 0 ? instanceCount : 1000;
+    } else if (name != "basic") {
+        std::cout << "Unknown scene " << name << std::endl;
+        return false;
+    }
+
+    // Meshes share the buffers and VAO of the geometry pool
+    Mesh3D mesh1, mesh2, mesh3;
+
+    MeshDataPoolSpecification(&mesh1, &app.mGeometryPool, MeshTemplates::Cube);
+    MeshTraslate(&mesh1, 0.0f, 0.0f, -2.0f);
+    MeshScale(&mesh1, 0.5f);
+
+    MeshDataPoolSpecification(&mesh2, &app.mGeometryPool, MeshTemplates::Sphere);
+    MeshTraslate(&mesh2, 0.5f, 0.25f, -2.0f);
+    MeshScale(&mesh2, 0.3f);
+
+    MeshDataPoolSpecification(&mesh3, &app.mGeometryPool, MeshTemplates::Tetrahedron);
+    MeshTraslate(&mesh3, -0.5f, -0.3f, -2.0f);
+    MeshScale(&mesh3, 0.75f);
+
+    // For each mesh, set them to the pipeline
+    MeshSetPipeline(&mesh1, &app.mGraphicsPipeline);
+    MeshSetPipeline(&mesh2, &app.mGraphicsPipeline);
+    MeshSetPipeline(&mesh3, &app.mGraphicsPipeline);
+
+    scene->mMeshes = {mesh1, mesh2, mesh3};
+    scene->mGeometry.insert(scene->mGeometry.end(), {mesh1.mGeometry, mesh2.mGeometry, mesh3.mGeometry});
+    scene->mMeshData = {&MeshTemplates::Cube, &MeshTemplates::Sphere, &MeshTemplates::Tetrahedron};
+    scene->mAnimatedMeshes = scene->mMeshes.size();
+
+    // Optional field of instanced spheres
+    SceneBatch spheres;
+    spheres.mMeshData = &MeshTemplates::SphereLowPoly;
+    spheres.mInstances = GenerateSphereInstances(instanceCount);
+    SceneAddBatch(app, scene, std::move(spheres));
+    return true;
+}
+
+// World-space box around a mesh, from its culling sphere
+static Aabb SceneMeshBounds(const Scene& scene, uint32_t index) {
+    const CullingBounds& bounds = scene.mCuller.mBounds;
+    glm::vec3 center(bounds.mCenterX[index], bounds.mCenterY[index], bounds.mCenterZ[index]);
+    return AabbFromSphere(center, bounds.mRadius[index]);
+}
+
+static void BuildSceneBvh(Scene* scene) {
+    std::vector<Aabb> boxes(scene->mCuller.mBounds.mCount);
+    for (uint32_t i = 0; i < boxes.size(); ++i) {
+        boxes[i] = SceneMeshBounds(*scene, i);
+    }
+    uint32_t animated = (uint32_t)scene->mAnimatedMeshes;
+    BvhBuild(&scene->mDynamicBvh, boxes, 0, animated);
+    BvhBuild(&scene->mStaticBvh, boxes, animated, (uint32_t)boxes.size() - animated);
+}
+
+// Every mesh and batch becomes one draw of the GPU culler
+static void BuildSceneGpuCuller(App& app, Scene* scene) {
+    GpuCuller* culler = &scene->mGpuCuller;
+    CreateGpuCuller(culler, &app.mGeometryPool, &app.mInstancedPipeline, &app.mShaderLibrary,
+                    app.mScreenWidth, app.mScreenHeight);
+    for (const Mesh3D& mesh : scene->mMeshes) {
+        InstanceData instance;
+        instance.mModelMatrix = mesh.mTransform.mModelMatrix;
+        GpuCullerAddDraw(culler, mesh.mGeometry, mesh.mBoundingSphere, &instance, 1);
+    }
+    for (SceneBatch& batch : scene->mBatches) {
+        batch.mGpuFirstObject = GpuCullerAddDraw(culler, batch.mGeometry, MeshDataBoundingSphere(*batch.mMeshData),
+                                                 batch.mInstances.data(), (uint32_t)batch.mInstances.size());
+    }
+    GpuCullerFinalize(culler);
+}
+
+// Known scenes are "basic", "spheres" and the generated layouts "grid", "cloud" and "city"
+bool BuildScene(App& app, Scene* scene, const std::string& name, int instanceCount,
+                const SceneGeneratorOptions& generatorOptions) {
+    PROFILE_FUNCTION();
+    CreateInstancedRenderer(&scene->mInstancedRenderer, &app.mInstancedPipeline, &app.mResources);
+    CreateIndirectRenderer(&scene->mIndirectRenderer, &app.mGeometryPool, &app.mInstancedPipeline);
+
+    SceneGeneratorOptions options = generatorOptions;
+    if (ParseSceneLayout(name, &options.mLayout)) {
+        SceneAddGenerated(app, scene, options);
+    } else if (!SceneAddBasic(app, scene, name, instanceCount)) {
+        return false;
+    }
+
+    // Static meshes keep these bounds, AnimateScene updates the others
+    CreateFrustumCuller(&scene->mCuller, app.mCullingThreads);
+    CullingBoundsResize(&scene->mCuller.mBounds, (uint32_t)scene->mMeshes.size());
+    for (uint32_t i = 0; i < scene->mMeshes.size(); ++i) {
+        const Mesh3D& mesh = scene->mMeshes[i];
+        CullingBoundsSet(&scene->mCuller.mBounds, i, mesh.mTransform.mModelMatrix, mesh.mBoundingSphere);
+    }
+    if (app.mBvhCulling) {
+        BuildSceneBvh(scene);
+        std::cout << "Frustum culling " << scene->mMeshes.size() << " meshes through a BVH of " <<
+                     scene->mStaticBvh.mNodes.size() << " static and " << scene->mDynamicBvh.mNodes.size() <<
+                     " animated nodes" << std::endl;
+    } else if (app.mFrustumCulling) {
+        std::cout << "Frustum culling " << scene->mMeshes.size() << " meshes with the " <<
+                     CullingKernelName(scene->mCuller.mKernel) << " kernel on up to " <<
+                     scene->mCuller.mThreads.size() + 1 << " threads" << std::endl;
+    }
+    if (app.mOcclusionCulling) {
+        CreateOcclusionCuller(&scene->mOcclusion, app.mCullingThreads);
+        scene->mOcclusion.mTimeBudget = app.mOcclusionBudget;
+        std::cout << "Occlusion culling at " << OCCLUSION_WIDTH << "x" << OCCLUSION_HEIGHT << " on " <<
+                     scene->mOcclusion.mWorkerCount << " threads, up to " << scene->mOcclusion.mTriangleBudget <<
+                     " occluder triangles and " << app.mOcclusionBudget << " ms per frame" << std::endl;
+    }
+    if (app.mGpuCulling) {
+        if (!GpuCullingSupported()) {
+            std::cout << "GPU culling needs OpenGL 4.3, culling on the CPU instead" << std::endl;
+            app.mGpuCulling = false;
+        } else {
+            BuildSceneGpuCuller(app, scene);
+            std::cout << "Culling " << scene->mGpuCuller.mObjectCount << " objects in " <<
+                         scene->mGpuCuller.mDraws.size() << " draws on the GPU, Hi-Z of " <<
+                         scene->mGpuCuller.mHiZLevels << " levels" << std::endl;
+        }
+    }
+    if (app.mInstanceCulling) {
+        if (app.mRenderPath == RenderPath::Indirect) {
+            std::cout << "Instance culling only works with the instanced renderer, ignored for indirect draws" <<
+                         std::endl;
+            app.mInstanceCulling = false;
+        } else {
+            CreateInstanceCuller(&scene->mInstanceCuller, &app.mShaderLibrary);
+            std::cout << "Frustum culling instances on the GPU through transform feedback" << std::endl;
+        }
+    }
+    if (app.mOcclusionQueries) {
+        if (app.mRenderPath == RenderPath::Indirect) {
+            std::cout << "Occlusion queries only work with the render queue, ignored for indirect draws" << std::endl;
+            app.mOcclusionQueries = false;
+            return true;
+        }
+        CreateOcclusionQueries(&scene->mQueries, (uint32_t)scene->mMeshes.size());
+        MeshDataPoolSpecification(&scene->mQueryProxy, &app.mGeometryPool, MeshTemplates::Cube);
+        scene->mGeometry.push_back(scene->mQueryProxy.mGeometry);
+        scene->mQueryQueue.mProxy = &scene->mQueryProxy;
+        scene->mQueryQueue.mQueryTarget = scene->mQueries.mTarget;
+        std::cout << "Occlusion queries with " <<
+                     (scene->mQueries.mTarget == GL_ANY_SAMPLES_PASSED_CONSERVATIVE ? "conservative " : "") <<
+                     "any samples passed, visible meshes queried every " << scene->mQueries.mInterval <<
+                     " frames" << std::endl;
+    }
+    return true;
+}
+
+// Hands the scene's geometry back to the pool, the meshes must not be drawn after this
+static void FreeSceneGeometry(App& app, Scene* scene) {
+    for (GeometryHandle handle : scene->mGeometry) {
+        GeometryPoolFree(&app.mGeometryPool, handle);
+    }
+    scene->mGeometry.clear();
+}
+
+// Packs the pool, the renderers notice its new buffers on their next draw
+static void DefragmentGeometry(App& app) {
+    PROFILE_FUNCTION();
+    GeometryDefragmentStats stats = GeometryPoolDefragment(&app.mGeometryPool);
+    std::cout << "Defragmented " << stats.mAllocations << " allocations into " << stats.mVertices <<
+                 " vertices and " << stats.mIndices << " indices, from " << stats.mVertexFreeBlocks <<
+                 " and " << stats.mIndexFreeBlocks << " free blocks" << std::endl;
+}
+
+// Spins the animated meshes and instances a little further
+void AnimateScene(App& app, Scene* scene) {
+    PROFILE_FUNCTION();
+    for (size_t i = 0; i < scene->mAnimatedMeshes; ++i) {
+        Mesh3D& mesh = scene->mMeshes[i];
+        MeshRotateY(&mesh, 0.5f, glm::vec3(0.0f, 1.0f, 0.0f));
+        CullingBoundsSet(&scene->mCuller.mBounds, (uint32_t)i, mesh.mTransform.mModelMatrix, mesh.mBoundingSphere);
+        if (app.mBvhCulling) {
+            BvhUpdateObject(&scene->mDynamicBvh, (uint32_t)i, SceneMeshBounds(*scene, (uint32_t)i));
+        }
+        if (app.mGpuCulling) {
+            InstanceData instance;
+            instance.mModelMatrix = mesh.mTransform.mModelMatrix;
+            GpuCullerUpdate(&scene->mGpuCuller, (uint32_t)i, &instance, 1);
+        }
+    }
+    for (SceneBatch& batch : scene->mBatches) {
+        for (uint32_t i = 0; i < batch.mAnimatedCount; ++i) {
+            InstanceData& instance = batch.mInstances[i];
+            instance.mModelMatrix = glm::rotate(instance.mModelMatrix, glm::radians(0.5f), glm::vec3(0.0f, 1.0f, 0.0f));
+            if (app.mRenderPath != RenderPath::Indirect) {
+                InstanceId id = batch.mFirstInstance;
+                id.mIndex += i;
+                *InstancedRendererGet(&scene->mInstancedRenderer, id) = instance;
+            }
+        }
+        if (app.mGpuCulling) {
+            // Animated instances come first, one upload covers them
+            GpuCullerUpdate(&scene->mGpuCuller, batch.mGpuFirstObject, batch.mInstances.data(), batch.mAnimatedCount);
+        }
+    }
+}
+
+// Through the BVH, or everything when frustum culling is off
+static void CullSceneBvh(App& app, Scene* scene) {
+    FrustumCuller* culler = &scene->mCuller;
+    uint32_t count = culler->mBounds.mCount;
+    if (app.mFrustumCulling) {
+        // Moved meshes were marked by AnimateScene
+        BvhRefit(&scene->mDynamicBvh);
+        Frustum frustum = FrustumFromCamera(app.mCamera);
+        culler->mVisible.clear();
+        BvhCullFrustum(scene->mDynamicBvh, frustum, &culler->mVisible);
+        BvhCullFrustum(scene->mStaticBvh, frustum, &culler->mVisible);
+    } else {
+        culler->mVisible.resize(count);
+        for (uint32_t i = 0; i < count; ++i) {
+            culler->mVisible[i] = i;
+        }
+    }
+    culler->mStats = CullingStats();
+    culler->mStats.mTested = count;
+    culler->mStats.mVisible = (uint32_t)culler->mVisible.size();
+    culler->mStats.mCulled = count - culler->mStats.mVisible;
+    culler->mStats.mThreads = 1;
+}
+
+// The visible meshes that cover the most of the view are rasterized as
+// occluders, then every visible mesh is tested against them
+static void OccludeScene(App& app, Scene* scene) {
+    PROFILE_FUNCTION();
+    const CullingBounds& bounds = scene->mCuller.mBounds;
+    std::vector<uint32_t>* visible = &scene->mCuller.mVisible;
+    glm::vec3 eye = app.mCamera.GetPosition();
+
+    std::vector<std::pair<float, uint32_t>> candidates;
+    for (uint32_t index : *visible) {
+        glm::vec3 center(bounds.mCenterX[index], bounds.mCenterY[index], bounds.mCenterZ[index]);
+        float size = bounds.mRadius[index] / std::max(glm::length(center - eye), 1e-3f);
+        if (size >= OCCLUSION_MIN_OCCLUDER_SIZE) {
+            candidates.push_back(std::make_pair(size, index));
+        }
+    }
+    if (candidates.size() > OCCLUSION_MAX_OCCLUDERS) {
+        std::nth_element(candidates.begin(), candidates.begin() + OCCLUSION_MAX_OCCLUDERS, candidates.end(),
+                         std::greater<std::pair<float, uint32_t>>());
+        candidates.resize(OCCLUSION_MAX_OCCLUDERS);
+    }
+    std::sort(candidates.begin(), candidates.end(), std::greater<std::pair<float, uint32_t>>());
+
+    OcclusionCuller* occlusion = &scene->mOcclusion;
+    OcclusionCullerBegin(occlusion, app.mCamera.GetProjectionMatrix() * app.mCamera.GetViewMatrix());
+    for (const std::pair<float, uint32_t>& candidate : candidates) {
+        // Smaller ones further down may still fit the budget
+        OcclusionCullerAddOccluder(occlusion, scene->mMeshData[candidate.second],
+                                   scene->mMeshes[candidate.second].mTransform.mModelMatrix);
+    }
+    OcclusionCullerRun(occlusion, bounds, visible);
+}
+
+// Leaves the meshes to draw this frame in the culler's visible list
+void CullScene(App& app, Scene* scene) {
+    PROFILE_FUNCTION();
+    FrustumCuller* culler = &scene->mCuller;
+    if (app.mFrustumCulling && !app.mBvhCulling) {
+        FrustumCullerRun(culler, FrustumFromCamera(app.mCamera));
+    } else {
+        CullSceneBvh(app, scene);
+    }
+    if (app.mOcclusionCulling) {
+        OccludeScene(app, scene);
+    }
+}
+
+// Casts a ray through the crosshair and reports the mesh it hits and the meshes around it
+void PickScene(App& app, Scene* scene) {
+    PROFILE_FUNCTION();
+    if (!app.mBvhCulling) {
+        // The tree is only kept up to date for BVH culling, otherwise build one for this pick
+        BuildSceneBvh(scene);
+    }
+
+    glm::vec3 origin = app.mCamera.GetPosition();
+    glm::vec3 direction = glm::normalize(app.mCamera.GetViewDirection());
+    uint32_t mesh = 0;
+    float distance = 0.0f;
+    // The static tree only has to look for hits nearer than the animated one found
+    bool hit = BvhRaycast(scene->mDynamicBvh, origin, direction, 100.0f, &mesh, &distance);
+    hit = BvhRaycast(scene->mStaticBvh, origin, direction, hit ? distance : 100.0f, &mesh, &distance) || hit;
+    if (!hit) {
+        std::cout << "Nothing picked" << std::endl;
+        return;
+    }
+    std::vector<uint32_t> nearby;
+    BvhQuerySphere(scene->mDynamicBvh, origin + direction * distance, 0.5f, &nearby);
+    BvhQuerySphere(scene->mStaticBvh, origin + direction * distance, 0.5f, &nearby);
+    std::cout << "Picked mesh " << mesh << " at distance " << distance << ", " << nearby.size() - 1 <<
+                 " other meshes within 0.5" << std::endl;
+}
+
+// Query for the mesh this frame, 0 when it is drawn unconditionally. Proxies
+// the camera is in or next to lose their front faces to the near plane and
+// would come back hidden, those meshes are never queried.
+static GLuint SceneMeshQuery(App& app, Scene* scene, uint32_t index) {
+    if (scene->mMeshes[index].mRenderPass != RenderPass::Opaque) {
+        return 0;
+    }
+    const CullingBounds& bounds = scene->mCuller.mBounds;
+    glm::vec3 center(bounds.mCenterX[index], bounds.mCenterY[index], bounds.mCenterZ[index]);
+    // Half the box diagonal plus room for the near plane
+    if (glm::length(center - app.mCamera.GetPosition()) < bounds.mRadius[index] * 1.75f + 0.2f) {
+        return 0;
+    }
+    return OcclusionQueriesIssue(&scene->mQueries, index);
+}
+
+static void AddQueueStats(RenderStats* stats, const RenderStats& queue) {
+    stats->mDrawCalls += queue.mDrawCalls;
+    stats->mTriangles += queue.mTriangles;
+    stats->mProgramBinds += queue.mProgramBinds;
+    stats->mVertexArrayBinds += queue.mVertexArrayBinds;
+    stats->mPassChanges += queue.mPassChanges;
+    stats->mStateChangesAvoided += queue.mStateChangesAvoided;
+}
+
+// Meshes go through the sorted render queue, instances through the instanced renderer
+void DrawSceneQueued(App& app, Scene* scene, RenderQueue* renderQueue, RenderStats* stats) {
+    // Gather model matrices into a single upload and queue the meshes
+    glm::mat4 view = app.mCamera.GetViewMatrix();
+    RenderQueueClear(renderQueue);
+    RenderQueueClear(&scene->mQueryQueue);
+    RenderQueueClear(&scene->mTransparentQueue);
+    if (app.mOcclusionQueries) {
+        OcclusionQueriesBeginFrame(&scene->mQueries);
+    }
+    for (uint32_t index : scene->mCuller.mVisible) {
+        Mesh3D& mesh = scene->mMeshes[index];
+        mesh.mObjectIndex = FrameUniformsPushObject(&app.mFrameUniforms, mesh.mTransform.mModelMatrix);
+        GLuint query = app.mOcclusionQueries ? SceneMeshQuery(app, scene, index) : 0;
+        if (mesh.mRenderPass == RenderPass::Transparent) {
+            RenderQueuePush(&scene->mTransparentQueue, &mesh, view);
+            continue;
+        }
+        if (query == 0) {
+            RenderQueuePush(renderQueue, &mesh, view);
+            continue;
+        }
+        // The proxy is the box around the culling sphere
+        const CullingBounds& bounds = scene->mCuller.mBounds;
+        glm::vec3 center(bounds.mCenterX[index], bounds.mCenterY[index], bounds.mCenterZ[index]);
+        glm::mat4 box = glm::scale(glm::translate(glm::mat4(1.0f), center), glm::vec3(2.0f * bounds.mRadius[index]));
+        GLuint proxy = FrameUniformsPushObject(&app.mFrameUniforms, box);
+        RenderQueuePushQueried(&scene->mQueryQueue, &mesh, view, query, proxy);
+    }
+    FrameUniformsUploadObjects(&app.mFrameUniforms);
+    InstancedRendererUpload(&scene->mInstancedRenderer);
+
+    // Draw Meshes, sorted so that state is only changed when it has to be
+    RenderQueueSort(renderQueue);
+    {
+        GpuProfileScope zone(&app.mGpuProfiler, "Meshes");
+        RenderQueueSubmit(renderQueue, app);
+    }
+    *stats = renderQueue->mStats;
+
+    // Tested against the depth of everything above
+    if (!scene->mQueryQueue.mPackets.empty()) {
+        RenderQueueSort(&scene->mQueryQueue);
+        {
+            GpuProfileScope zone(&app.mGpuProfiler, "Queried meshes");
+            RenderQueueSubmit(&scene->mQueryQueue, app);
+        }
+        AddQueueStats(stats, scene->mQueryQueue.mStats);
+        stats->mQueries = scene->mQueryQueue.mStats.mQueries;
+    }
+
+    // Everything sharing a MeshData goes out in one instanced draw per group
+    {
+        GpuProfileScope zone(&app.mGpuProfiler, "Instances");
+        if (app.mInstanceCulling) {
+            glm::mat4 viewProjection = app.mCamera.GetProjectionMatrix() * view;
+            InstanceCullerRun(&scene->mInstanceCuller, scene->mInstancedRenderer, viewProjection);
+            InstanceCullerDraw(scene->mInstanceCuller, scene->mInstancedRenderer, stats);
+        } else {
+            InstancedRendererDraw(scene->mInstancedRenderer, stats);
+        }
+    }
+
+    // Last, blended over every opaque mesh and instance whichever way it was drawn
+    if (!scene->mTransparentQueue.mPackets.empty()) {
+        RenderQueueSort(&scene->mTransparentQueue);
+        GpuProfileScope zone(&app.mGpuProfiler, "Transparent meshes");
+        RenderQueueSubmit(&scene->mTransparentQueue, app);
+        AddQueueStats(stats, scene->mTransparentQueue.mStats);
+    }
+}
+
+// Every mesh and instance is one command of a single indirect submission
+void DrawSceneIndirect(App& app, Scene* scene, RenderStats* stats) {
+    // No per-object blocks here, but the PerFrame block still has to be bound
+    FrameUniformsUploadObjects(&app.mFrameUniforms);
+
+    // Nothing was culled on the CPU, the GPU goes through everything
+    if (app.mGpuCulling) {
+        glm::mat4 viewProjection = app.mCamera.GetProjectionMatrix() * app.mCamera.GetViewMatrix();
+        {
+            GpuProfileScope zone(&app.mGpuProfiler, "GPU culling");
+            GpuCullerDraw(&scene->mGpuCuller, viewProjection, stats);
+        }
+        GpuCullerEndFrame(&scene->mGpuCuller, viewProjection);
+        return;
+    }
+
+    IndirectRenderer* renderer = &scene->mIndirectRenderer;
+    IndirectRendererBegin(renderer);
+    for (uint32_t index : scene->mCuller.mVisible) {
+        const Mesh3D& mesh = scene->mMeshes[index];
+        InstanceData instance;
+        instance.mModelMatrix = mesh.mTransform.mModelMatrix;
+        IndirectRendererPush(renderer, mesh.mGeometry, &instance, 1);
+    }
+    for (const SceneBatch& batch : scene->mBatches) {
+        IndirectRendererPush(renderer, batch.mGeometry, batch.mInstances.data(), (GLuint)batch.mInstances.size());
+    }
+
+    GpuProfileScope zone(&app.mGpuProfiler, "Indirect");
+    IndirectRendererSubmit(renderer, stats);
+}
+
+// Counters of one frame, logged every so often next to the GPU zones rather than every frame
+static void LogRenderStats(const RenderStats& stats) {
+    std::cout << "Draws: " << stats.mDrawCalls <<
+                 "\tProgram binds: " << stats.mProgramBinds <<
+                 "\tVAO binds: " << stats.mVertexArrayBinds <<
+                 "\tState changes avoided: " << stats.mStateChangesAvoided <<
+                 "\tVisible: " << stats.mVisible <<
+                 "\tCulled: " << stats.mCulled <<
+                 "\tOccluded: " << stats.mOccluded <<
+                 "\tQueries: " << stats.mQueries << std::endl;
+}
+
+// benchmark is null for interactive runs
+void MainLoop(App& app, Scene* scene, Benchmark* benchmark) {
 
     // Locks Mouse Cursor to the Middle of the Screen
-    SDL_WarpMouseInWindow(app.mGraphicsApplicationWindow, app.mScreenWidth/2, app.mScreenHeight/2);
-    SDL_SetRelativeMouseMode(SDL_TRUE);
+    if (!app.mHeadless) {
+        SDL_WarpMouseInWindow(app.mGraphicsApplicationWindow, app.mScreenWidth/2, app.mScreenHeight/2);
+        SDL_SetRelativeMouseMode(SDL_TRUE);
+    }
+
+    RenderQueue renderQueue;
+    renderQueue.mProfiler = &app.mGpuProfiler;
+    scene->mQueryQueue.mProfiler = &app.mGpuProfiler;
+    scene->mTransparentQueue.mProfiler = &app.mGpuProfiler;
+    RenderStats lastStats;
+    double totalFenceWait = 0.0;
+    double totalFrameTime = 0.0;
+    unsigned int frameCount = 0;
 
     while (!app.mQuit) {
-        Input(&app);
+        PROFILE_ZONE("Frame");
+        auto frameStart = std::chrono::steady_clock::now();
+
+        // There is no window to get events from when headless, and benchmarks script the camera
+        float time = SDL_GetTicks() / 1000.0f;
+        if (benchmark != nullptr) {
+            time = BenchmarkBeginFrame(benchmark, &app.mCamera);
+        } else if (!app.mHeadless) {
+            Input(&app);
+        }
+
+        // Pipelines still compiling are swapped in here, never in the middle of a frame
+        ShaderHotReloadUpdate(&app.mShaderHotReload, &app.mShaderLibrary, &app.mPipelineBuilder);
+        if (PipelineBuilderPoll(&app.mPipelineBuilder) > 0 && PipelineBuilderIdle(app.mPipelineBuilder)) {
+            ProgramCacheSave(&app.mProgramCache, false);
+        }
+
+        GpuProfilerBeginFrame(&app.mGpuProfiler);
+        GpuProfilerBeginZone(&app.mGpuProfiler, "Frame");
 
         glViewport(0, 0, app.mScreenWidth, app.mScreenHeight);
         glClearColor(0.8f, 0.8f, 0.8f, 1.f);
@@ -25,57 +664,291 @@ void MainLoop(App app, std::vector<Mesh3D> meshes) {
         glCullFace(GL_BACK);
         glFrontFace(GL_CCW);
     
+        GpuProfilerBeginZone(&app.mGpuProfiler, "Clear");
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-        
-        // Draw Meshes
-        for (Mesh3D& mesh : meshes) {
-            MeshDraw(&mesh, app);
+        GpuProfilerEndZone(&app.mGpuProfiler);
+
+        // Camera matrices are uploaded once for the whole frame
+        FrameUniformsBegin(&app.mFrameUniforms, app.mCamera, time);
+
+        AnimateScene(app, scene);
+
+        if (!app.mGpuCulling) {
+            CullScene(app, scene);
+        }
+        if (app.mPickRequested) {
+            PickScene(app, scene);
+            app.mPickRequested = false;
+        }
+
+        RenderStats stats;
+        {
+            PROFILE_ZONE("Draw scene");
+            if (app.mRenderPath == RenderPath::Indirect) {
+                DrawSceneIndirect(app, scene, &stats);
+            } else {
+                DrawSceneQueued(app, scene, &renderQueue, &stats);
+            }
+        }
+        FrameUniformsEnd(&app.mFrameUniforms);
+        GpuProfilerEndZone(&app.mGpuProfiler);
+        ResourceManagerEndFrame(&app.mResources);
+        stats.mFenceWait += app.mFrameUniforms.mRing.mLastFenceWait;
+        stats.mVisible = scene->mCuller.mStats.mVisible;
+        stats.mCulled = scene->mCuller.mStats.mCulled;
+        if (app.mOcclusionCulling) {
+            stats.mOccluded = scene->mOcclusion.mStats.mOccluded;
+            stats.mVisible -= stats.mOccluded;
+        }
+        if (app.mGpuCulling) {
+            const GpuCullStats& gpuStats = scene->mGpuCuller.mStats;
+            stats.mVisible = gpuStats.mVisible;
+            stats.mCulled = gpuStats.mCulled;
+            stats.mOccluded = gpuStats.mOccluded;
+        }
+        if (app.mInstanceCulling) {
+            const InstanceCullStats& instanceStats = scene->mInstanceCuller.mStats;
+            stats.mVisible += instanceStats.mVisible;
+            stats.mCulled += instanceStats.mInstances - instanceStats.mVisible;
+        }
+        if (app.mOcclusionQueries) {
+            // Only known once the GPU reports back, so these are last known results
+            stats.mOccluded += scene->mQueries.mStats.mHidden;
+            stats.mVisible -= scene->mQueries.mStats.mHidden;
         }
-        
+
+        lastStats = stats;
+
+
+        bool lastFrame = app.mQuit || (app.mFrameLimit > 0 && frameCount + 1 >= app.mFrameLimit);
+        if (lastFrame && !app.mCapturePath.empty()) {
+            WriteFramebufferPPM(app.mCapturePath, app.mScreenWidth, app.mScreenHeight);
+        }
+
         // Update Screen
-        SDL_GL_SwapWindow(app.mGraphicsApplicationWindow);
+        {
+            PROFILE_ZONE("Swap");
+            PresentFrame(app);
+        }
+        if (benchmark != nullptr && benchmark->mOptions.mFinish) {
+            glFinish();
+        }
+        double frameTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - frameStart).count();
+        totalFenceWait += stats.mFenceWait;
+        totalFrameTime += frameTime;
+        frameCount++;
+        if (benchmark != nullptr) {
+            BenchmarkEndFrame(benchmark, &app.mGpuProfiler, frameTime, stats);
+        }
+
+        if (app.mTraceRequested) {
+            CpuProfilerWriteTrace(app.mTracePath);
+            app.mTraceRequested = false;
+        }
+        if (app.mDefragmentRequested) {
+            DefragmentGeometry(app);
+            app.mDefragmentRequested = false;
+        }
+        if (lastFrame) {
+            app.mQuit = true;
+        }
+
+        if (benchmark == nullptr && frameCount % GPU_PROFILER_WINDOW == 0) {
+            LogRenderStats(lastStats);
+            GpuProfilerLog(app.mGpuProfiler);
+        }
+    }
+
+    // Only place the profiler is allowed to wait for the GPU
+    if (benchmark != nullptr) {
+        BenchmarkWriteResults(*benchmark, &app.mGpuProfiler);
+    }
+    GpuProfilerFlush(&app.mGpuProfiler);
+    LogRenderStats(lastStats);
+    GpuProfilerLog(app.mGpuProfiler);
+
+    if (frameCount > 0) {
+        std::cout << "Average frame time " << totalFrameTime / frameCount << " ms over " << frameCount <<
+                     " frames" << std::endl;
+        std::cout << "Waited " << totalFenceWait << " ms on ring buffer fences over " << frameCount <<
+                     " frames (" << totalFenceWait / frameCount << " ms per frame)" << std::endl;
     }
 }
 
-int main() {
+int main(int argc, char* argv[]) {
     App app;
 
+    int instanceCount = 0;
+    std::string sceneName = "basic";
+    bool benchmarking = false;
+    BenchmarkOptions benchmarkOptions;
+    double compareThreshold = 5.0;
+    SceneGeneratorOptions generatorOptions;
+    bool bvhBenchmark = false;
+    std::string compareBaseline, compareCurrent;
+    bool gpuProfile = false;
+    bool gpuProfileDraws = false;
+    bool traceAtExit = false;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--instances") == 0 && i + 1 < argc) {
+            instanceCount = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--scene") == 0 && i + 1 < argc) {
+            sceneName = argv[++i];
+        } else if (strcmp(argv[i], "--objects") == 0 && i + 1 < argc) {
+            generatorOptions.mObjectCount = (uint32_t)atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--animated") == 0 && i + 1 < argc) {
+            generatorOptions.mAnimatedFraction = (float)atof(argv[++i]);
+        } else if (strcmp(argv[i], "--subdivision") == 0 && i + 2 < argc) {
+            generatorOptions.mMinSubdivision = (uint32_t)atoi(argv[++i]);
+            generatorOptions.mMaxSubdivision = (uint32_t)atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            generatorOptions.mSeed = (uint32_t)atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--benchmark") == 0 && i + 1 < argc) {
+            sceneName = argv[++i];
+            benchmarking = true;
+        } else if (strcmp(argv[i], "--warmup") == 0 && i + 1 < argc) {
+            benchmarkOptions.mWarmupFrames = (uint32_t)atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--measure") == 0 && i + 1 < argc) {
+            benchmarkOptions.mMeasuredFrames = (uint32_t)atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--finish") == 0) {
+            benchmarkOptions.mFinish = true;
+        } else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
+            benchmarkOptions.mOutputPath = argv[++i];
+        } else if (strcmp(argv[i], "--threshold") == 0 && i + 1 < argc) {
+            compareThreshold = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--compare") == 0 && i + 2 < argc) {
+            compareBaseline = argv[++i];
+            compareCurrent = argv[++i];
+        } else if (strcmp(argv[i], "--indirect") == 0) {
+            app.mRenderPath = RenderPath::Indirect;
+        } else if (strcmp(argv[i], "--no-culling") == 0) {
+            app.mFrustumCulling = false;
+        } else if (strcmp(argv[i], "--bvh") == 0) {
+            app.mBvhCulling = true;
+        } else if (strcmp(argv[i], "--bvh-benchmark") == 0) {
+            bvhBenchmark = true;
+        } else if (strcmp(argv[i], "--occlusion") == 0) {
+            app.mOcclusionCulling = true;
+        } else if (strcmp(argv[i], "--occlusion-budget") == 0 && i + 1 < argc) {
+            app.mOcclusionBudget = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--gpu-culling") == 0) {
+            app.mGpuCulling = true;
+        } else if (strcmp(argv[i], "--defragment") == 0) {
+            app.mDefragmentRequested = true;
+        } else if (strcmp(argv[i], "--instance-culling") == 0) {
+            app.mInstanceCulling = true;
+        } else if (strcmp(argv[i], "--occlusion-queries") == 0) {
+            app.mOcclusionQueries = true;
+        } else if (strcmp(argv[i], "--cull-threads") == 0 && i + 1 < argc) {
+            app.mCullingThreads = (uint32_t)atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--instanced") == 0) {
+            app.mRenderPath = RenderPath::Instanced;
+        } else if (strcmp(argv[i], "--separable") == 0) {
+            app.mSeparableStages = true;
+        } else if (strcmp(argv[i], "--headless") == 0) {
+            app.mHeadless = true;
+        } else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+            app.mFrameLimit = (unsigned int)atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--capture") == 0 && i + 1 < argc) {
+            app.mCapturePath = argv[++i];
+        } else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+            app.mTracePath = argv[++i];
+            traceAtExit = true;
+        } else if (strcmp(argv[i], "--gpu-profile") == 0) {
+            gpuProfile = true;
+        } else if (strcmp(argv[i], "--gpu-profile-draws") == 0) {
+            gpuProfile = true;
+            gpuProfileDraws = true;
+        }
+    }
+
+    // GPU culling draws through the indirect renderer, whatever order the flags came in
+    if (app.mGpuCulling && app.mRenderPath == RenderPath::Instanced) {
+        std::cout << "GPU culling only works with indirect draws, ignored for --instanced" << std::endl;
+        app.mGpuCulling = false;
+    } else if (app.mGpuCulling) {
+        app.mRenderPath = RenderPath::Indirect;
+    }
+
+    // Comparing results needs no window or context
+    if (!compareBaseline.empty()) {
+        int regressions = CompareBenchmarks(compareBaseline, compareCurrent, compareThreshold);
+        return regressions == 0 ? 0 : 1;
+    }
+    benchmarkOptions.mScene = sceneName;
+
+    // Also CPU only, over the generated scene options (cloud unless --scene names a layout)
+    if (bvhBenchmark) {
+        SceneGeneratorOptions options = generatorOptions;
+        if (!ParseSceneLayout(sceneName, &options.mLayout)) {
+            options.mLayout = SceneLayout::Cloud;
+        }
+        RunBvhBenchmark(options);
+        return 0;
+    }
+
+    // Nothing could ever ask a headless run to quit
+    if (app.mHeadless && app.mFrameLimit == 0) {
+        app.mFrameLimit = 100;
+    }
+
     // 1. Initialize the graphics program
     InitializeProgram(&app);
+    CreateGpuProfiler(&app.mGpuProfiler, gpuProfile);
+    app.mGpuProfiler.mDrawZones = gpuProfileDraws;
 
     // Setup camera
     app.mCamera.SetProjectionMatrix(glm::radians(45.0f), 
                                     (float)app.mScreenWidth / app.mScreenHeight, 
                                     0.1f, 10.0f);
 
-    // 2. Setup meshes (geometry)
-    Mesh3D mesh1, mesh2, mesh3;
-    
-    MeshDataVertexSpecification(&mesh1, MeshTemplates::Cube);
-    MeshTraslate(&mesh1, 0.0f, 0.0f, -2.0f);
-    MeshScale(&mesh1, 0.5f);
-
-    MeshDataVertexSpecification(&mesh2, MeshTemplates::Sphere);
-    MeshTraslate(&mesh2, 0.5f, 0.25f, -2.0f);
-    MeshScale(&mesh2, 0.3f);
-
-    MeshDataVertexSpecification(&mesh3, MeshTemplates::Tetrahedron);
-    MeshTraslate(&mesh3, -0.5f, -0.3f, -2.0f);
-    MeshScale(&mesh3, 0.75f);
+    // 2. Geometry of every mesh lives in one pool
+    CreateGeometryPool(&app.mGeometryPool, VertexFormat::PositionColor, 1 << 16, 1 << 18);
 
     // 3. Create Graphics Pipeline
     CreateGraphicsPipeline(&app);
-    
-    // 3.5 For each mesh, set them to the pipeline
-    MeshSetPipeline(&mesh1, app.mGraphicsPipelineShaderProgram);
-    MeshSetPipeline(&mesh2, app.mGraphicsPipelineShaderProgram);
-    MeshSetPipeline(&mesh3, app.mGraphicsPipelineShaderProgram);
+    if (app.mHeadless || benchmarking) {
+        // Headless runs are tests and benchmarks, the fallback pipelines must never show up in them
+        PipelineBuilderFinish(&app.mPipelineBuilder);
+        ProgramCacheSave(&app.mProgramCache, false);
+    }
+    if (!app.mHeadless) {
+        StartShaderHotReload(&app.mShaderHotReload, SHADER_DIRECTORY);
+    }
+    CreateFrameUniforms(&app.mFrameUniforms);
+
+    // 3.5 Meshes and instances
+    Scene scene;
+    if (!BuildScene(app, &scene, sceneName, instanceCount, generatorOptions)) {
+        exit(1);
+    }
 
     // 4. Call the main application loop
-    MainLoop(app, {mesh1, mesh2, mesh3});
+    Benchmark benchmark;
+    if (benchmarking) {
+        CreateBenchmark(&benchmark, benchmarkOptions, &app.mGpuProfiler);
+        app.mFrameLimit = BenchmarkFrameCount(benchmark);
+    }
+    MainLoop(app, &scene, benchmarking ? &benchmark : nullptr);
 
     // 5. Cleanup
+    DestroyFrustumCuller(&scene.mCuller);
+    DestroyOcclusionCuller(&scene.mOcclusion);
+    DestroyOcclusionQueries(&scene.mQueries);
+    if (app.mGpuCulling) {
+        DestroyGpuCuller(&scene.mGpuCuller);
+    }
+    if (app.mInstanceCulling) {
+        DestroyInstanceCuller(&scene.mInstanceCuller);
+    }
+    DestroyIndirectRenderer(&scene.mIndirectRenderer);
+    FreeSceneGeometry(app, &scene);
+    DestroyInstancedRenderer(&scene.mInstancedRenderer);
     CleanUp(app);
 
+    if (traceAtExit) {
+        CpuProfilerWriteTrace(app.mTracePath);
+    }
+
     return 0;
 }